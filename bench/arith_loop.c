@@ -0,0 +1,122 @@
+#include "arith.h"
+#include "shell_cleanup.h"
+#include "shell_init.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file arith_loop.c
+ * @brief microbenchmark of $((...)) evaluation: reparsing the expression
+ * text every time against running its cached compiled program, then a
+ * counting loop script timed under msh and dash.
+ *
+ * usage: arith_loop [evaluations] [loop_count] [msh_binary]
+ */
+
+#define DEF_EVALS 2000000
+#define DEF_LOOP 200000
+#define DEF_MSH "./msh_prod"
+
+static const char *g_expr = "(i * 3 + j) % 7 - i / 2";
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double bench_interp(t_shell *shell, long evals, long long *sum) {
+  double start = now_us();
+  for (long n = 0; n < evals; n++) {
+    t_err_type err;
+    *sum += arith_interp(shell, g_expr, &err);
+  }
+  return (now_us() - start) * 1e3 / evals;
+}
+
+static double bench_compiled(t_shell *shell, long evals, long long *sum) {
+  double start = now_us();
+  for (long n = 0; n < evals; n++) {
+    t_err_type err;
+    long long res = 0;
+    const t_arith_prog *prog = arith_compile(shell, g_expr);
+    if (!prog || !arith_run(shell, prog, &res, &err))
+      return -1;
+    *sum += res;
+  }
+  return (now_us() - start) * 1e3 / evals;
+}
+
+/** @brief runs sh on script, returns wall time in ms, -1 if it failed */
+static double time_shell(const char *sh, const char *script) {
+  double start = now_us();
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    execlp(sh, sh, script, (char *)NULL);
+    _exit(127);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0)
+    return -1;
+  return (now_us() - start) / 1e3;
+}
+
+int main(int argc, char **argv) {
+  long evals = argc > 1 ? atol(argv[1]) : DEF_EVALS;
+  long loop = argc > 2 ? atol(argv[2]) : DEF_LOOP;
+  const char *msh = argc > 3 ? argv[3] : DEF_MSH;
+  if (evals <= 0 || loop <= 0) {
+    fprintf(stderr, "usage: %s [evaluations] [loop_count] [msh_binary]\n",
+            argv[0]);
+    return 1;
+  }
+
+  t_shell shell;
+  if (init_shell_state(&shell, true) == -1)
+    return 1;
+  add_to_env(&shell, "i", "12345", false, 0);
+  add_to_env(&shell, "j", "678", false, 0);
+
+  long long s1 = 0, s2 = 0;
+  double interp = bench_interp(&shell, evals, &s1);
+  double compiled = bench_compiled(&shell, evals, &s2);
+  if (compiled < 0 || s1 != s2) {
+    fprintf(stderr, "compiled result mismatch\n");
+    return 1;
+  }
+  printf("$((%s)), %ld evaluations\n", g_expr, evals);
+  printf("reparse    %10.1f ns/eval\n", interp);
+  printf("compiled   %10.1f ns/eval (%.2fx)\n", compiled, interp / compiled);
+
+  char script[] = "/tmp/msh_arith_benchXXXXXX";
+  int fd = mkstemp(script);
+  if (fd == -1) {
+    perror("mkstemp");
+    return 1;
+  }
+  dprintf(fd, "i=0\nwhile [ $i -lt %ld ]; do\n  i=$((i + 1))\ndone\ntrue\n",
+          loop);
+  close(fd);
+
+  printf("counting loop to %ld\n", loop);
+  const char *shells[] = {msh, "dash"};
+  for (int k = 0; k < 2; k++) {
+    double ms = time_shell(shells[k], script);
+    if (ms < 0)
+      printf("%-10s failed\n", shells[k]);
+    else
+      printf("%-10s %10.1f ms\n", shells[k], ms);
+  }
+
+  unlink(script);
+  cleanup_shell(&shell, 0);
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "executor.h"
+#include "shell_cleanup.h"
+#include "shell_init.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file bg_launch.c
+ * @brief microbenchmark of background job launches with job control on, the
+ * `for i in $(seq N); do work & done` fan-out.
+ *
+ * usage: bg_launch [jobs]
+ *
+ * Measures a spawned external command and a forked subshell, which joins its
+ * process group through the fork handshake. Before the handshake every
+ * launch slept 10ms, capping either case at 100 launches per second.
+ */
+
+#define DEF_JOBS 2000
+#define REAP_EVERY 64
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void reap_all(t_shell *shell) {
+  while (waitpid(-1, NULL, 0) > 0)
+    ;
+  reap_sigchld_jobs(shell);
+}
+
+static double bench(t_shell *shell, const char *cmd, long jobs) {
+  double start = now_us();
+  for (long i = 0; i < jobs; i++) {
+    char *buf = strdup(cmd);
+    t_err_code err;
+    parse_and_execute(&buf, shell, &shell->token_stream, false, &err);
+    free(buf);
+    arena_reset(&shell->arena);
+    if (i % REAP_EVERY == REAP_EVERY - 1)
+      reap_sigchld_jobs(shell);
+  }
+  double t = now_us() - start;
+  reap_all(shell);
+  return t;
+}
+
+int main(int argc, char **argv) {
+  long jobs = argc > 1 ? atol(argv[1]) : DEF_JOBS;
+  if (jobs <= 0) {
+    fprintf(stderr, "usage: %s [jobs]\n", argv[0]);
+    return 1;
+  }
+
+  t_shell shell;
+  if (init_shell_state(&shell, true) == -1)
+    return 1;
+  shell.job_control_flag = 1;
+
+  // job notices go to stdout, keep them out of the report
+  int out = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (out == -1 || null_fd == -1) {
+    perror("open");
+    return 1;
+  }
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+
+  double spawn = bench(&shell, "/bin/true &", jobs);
+  double sub = bench(&shell, "( : ) &", jobs);
+
+  fflush(stdout);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+
+  printf("%ld background jobs per case\n", jobs);
+  printf("external   %10.1f us/launch %10.0f launches/s\n", spawn / jobs,
+         jobs / (spawn / 1e6));
+  printf("subshell   %10.1f us/launch %10.0f launches/s\n", sub / jobs,
+         jobs / (sub / 1e6));
+
+  cleanup_shell(&shell, 0);
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file fork_spawn.c
+ * @brief microbenchmark of fork+execve against posix_spawn for a shell with a
+ * large resident heap.
+ *
+ * usage: fork_spawn [iterations] [heap_mb]
+ *
+ * heap_mb of touched heap stands in for a long running shell's arena, history
+ * and function table; fork copies its page tables on every launch while
+ * posix_spawn (clone CLONE_VM|CLONE_VFORK) does not.
+ */
+
+#define DEF_ITERS 2000
+#define DEF_HEAP_MB 256
+
+static char g_arg0[] = "true";
+static char *const g_argv[] = {g_arg0, NULL};
+static const char *g_path = "/bin/true";
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int run_fork(char **envp) {
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    execve(g_path, g_argv, envp);
+    _exit(127);
+  }
+  return waitpid(pid, NULL, 0) == -1 ? -1 : 0;
+}
+
+static int run_spawn(char **envp) {
+  pid_t pid;
+  posix_spawnattr_t attr;
+  sigset_t dfl;
+
+  posix_spawnattr_init(&attr);
+  sigemptyset(&dfl);
+  sigaddset(&dfl, SIGINT);
+  sigaddset(&dfl, SIGQUIT);
+  posix_spawnattr_setsigdefault(&attr, &dfl);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+  int err = posix_spawn(&pid, g_path, NULL, &attr, g_argv, envp);
+  posix_spawnattr_destroy(&attr);
+  if (err != 0) {
+    fprintf(stderr, "posix_spawn: %s\n", strerror(err));
+    return -1;
+  }
+  return waitpid(pid, NULL, 0) == -1 ? -1 : 0;
+}
+
+static double bench(int (*fn)(char **), char **envp, long iters) {
+  double start = now_us();
+  for (long i = 0; i < iters; i++) {
+    if (fn(envp) == -1)
+      return -1;
+  }
+  return (now_us() - start) / iters;
+}
+
+int main(int argc, char **argv, char **envp) {
+  long iters = argc > 1 ? atol(argv[1]) : DEF_ITERS;
+  long heap_mb = argc > 2 ? atol(argv[2]) : DEF_HEAP_MB;
+  if (iters <= 0 || heap_mb < 0) {
+    fprintf(stderr, "usage: %s [iterations] [heap_mb]\n", argv[0]);
+    return 1;
+  }
+
+  size_t heap_len = (size_t)heap_mb << 20;
+  char *heap = heap_len ? malloc(heap_len) : NULL;
+  if (heap_len && !heap) {
+    perror("malloc");
+    return 1;
+  }
+  if (heap)
+    memset(heap, 0xa5, heap_len);
+
+  double f = bench(run_fork, envp, iters);
+  double s = bench(run_spawn, envp, iters);
+  if (f < 0 || s < 0)
+    return 1;
+
+  printf("heap %ld MB, %ld launches of %s\n", heap_mb, iters, g_path);
+  printf("fork+execve  %10.1f us/launch\n", f);
+  printf("posix_spawn  %10.1f us/launch (%.2fx)\n", s, f / s);
+
+  free(heap);
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include "glob_exp.h"
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file glob_dir.c
+ * @brief glob_expand against glob(3) for `ls *.log *.log.1 *.gz` in a large
+ * synthetic directory.
+ *
+ * usage: glob_dir [files] [iterations]
+ *
+ * The directory is created under /tmp and removed afterwards. glob(3) reads
+ * and sorts the directory once per pattern, glob_expand lists it once per
+ * command, so the three patterns share one listing.
+ */
+
+#define DEF_FILES 50000
+#define DEF_ITERS 10
+
+static const char *const g_pats[] = {"*.log", "*.log.1", "*.gz"};
+static const char *const g_exts[] = {".log", ".log.1", ".gz", ".txt", ".c"};
+
+#define NPATS (sizeof(g_pats) / sizeof(*g_pats))
+#define NEXTS (sizeof(g_exts) / sizeof(*g_exts))
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int make_files(long n) {
+  char name[64];
+  for (long i = 0; i < n; i++) {
+    /* scattered so the listing does not come back in order */
+    snprintf(name, sizeof(name), "srv%ld-%05ld%s", (i * 7919) % 97, i,
+             g_exts[i % NEXTS]);
+    int fd = open(name, O_CREAT | O_WRONLY, 0644);
+    if (fd == -1) {
+      perror(name);
+      return -1;
+    }
+    close(fd);
+  }
+  return 0;
+}
+
+static void remove_files(long n) {
+  char name[64];
+  for (long i = 0; i < n; i++) {
+    snprintf(name, sizeof(name), "srv%ld-%05ld%s", (i * 7919) % 97, i,
+             g_exts[i % NEXTS]);
+    unlink(name);
+  }
+}
+
+static double bench_libc(long iters, size_t *count) {
+  double best = 0;
+  for (long i = 0; i < iters; i++) {
+    glob_t gl;
+    double t0 = now_ns();
+    for (size_t p = 0; p < NPATS; p++)
+      glob(g_pats[p], GLOB_NOCHECK | GLOB_TILDE | (p ? GLOB_APPEND : 0), NULL,
+           &gl);
+    double t = now_ns() - t0;
+    *count = gl.gl_pathc;
+    globfree(&gl);
+    if (i == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+static double bench_native(long iters, size_t *count) {
+  t_arena a;
+  arena_init(&a);
+  double best = 0;
+  for (long i = 0; i < iters; i++) {
+    size_t argc = 0;
+    size_t cap = 16;
+    char **argv = arena_alloc(&a, cap * sizeof(char *));
+    t_glob_ctx g;
+    double t0 = now_ns();
+    glob_ctx_init(&g, &a);
+    for (size_t p = 0; p < NPATS; p++)
+      if (glob_expand(&g, g_pats[p], &argv, &argc, &cap) == -1) {
+        fprintf(stderr, "glob_expand failed\n");
+        exit(1);
+      }
+    glob_ctx_free(&g);
+    double t = now_ns() - t0;
+    *count = argc;
+    arena_reset(&a);
+    if (i == 0 || t < best)
+      best = t;
+  }
+  arena_free(&a);
+  return best;
+}
+
+int main(int argc, char **argv) {
+  long n = argc > 1 ? atol(argv[1]) : DEF_FILES;
+  long iters = argc > 2 ? atol(argv[2]) : DEF_ITERS;
+  if (n <= 0 || n > 99999 || iters <= 0) {
+    fprintf(stderr, "usage: %s [files (max 99999)] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  char dir[] = "/tmp/msh_glob_XXXXXX";
+  if (!mkdtemp(dir) || chdir(dir) == -1) {
+    perror("mkdtemp");
+    return 1;
+  }
+  int ret = 1;
+  if (make_files(n) == -1)
+    goto out;
+
+  size_t cl, cn;
+  double l = bench_libc(iters, &cl);
+  double s = bench_native(iters, &cn);
+  if (cl != cn) {
+    fprintf(stderr, "match count mismatch: %zu vs %zu\n", cl, cn);
+    goto out;
+  }
+
+  printf("%ld files, %zu matches for %s %s %s\n", n, cn, g_pats[0], g_pats[1],
+         g_pats[2]);
+  printf("glob(3)      %8.2f ms\n", l / 1e6);
+  printf("glob_expand  %8.2f ms (%.2fx)\n", s / 1e6, l / s);
+  ret = 0;
+
+out:
+  remove_files(n);
+  if (chdir("/") == -1 || rmdir(dir) == -1)
+    perror(dir);
+  return ret;
+}
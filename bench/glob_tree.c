@@ -0,0 +1,179 @@
+#include "glob_exp.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file glob_tree.c
+ * @brief `**` expansion over a synthetic tree, one walker against several.
+ *
+ * usage: glob_tree [files] [threads] [iterations]
+ *
+ * The tree is built under /tmp, 3 levels of 16 directories with the files
+ * spread over the leaves, and removed afterwards. Both runs must return
+ * the same argv, element for element, or the benchmark fails.
+ */
+
+#define DEF_FILES 100000
+#define DEF_THREADS 4
+#define DEF_ITERS 5
+#define FANOUT 16
+#define NLEAVES (FANOUT * FANOUT * FANOUT)
+
+static const char *const g_pats[] = {"**/*.log", "src/**/x*"};
+#define NPATS (sizeof(g_pats) / sizeof(*g_pats))
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void leaf_path(char *buf, size_t size, long leaf) {
+  snprintf(buf, size, "src/d%ld/e%ld/f%ld", leaf / (FANOUT * FANOUT),
+           leaf / FANOUT % FANOUT, leaf % FANOUT);
+}
+
+/** @brief src/dD/eE/fF for every level, parents listed before children */
+static void tree_dir(char *buf, size_t size, int depth, long i) {
+  if (depth == 1)
+    snprintf(buf, size, "src/d%ld", i);
+  else if (depth == 2)
+    snprintf(buf, size, "src/d%ld/e%ld", i / FANOUT, i % FANOUT);
+  else
+    leaf_path(buf, size, i);
+}
+
+static long level_len(int depth) {
+  return depth == 1 ? FANOUT : depth == 2 ? FANOUT * FANOUT : NLEAVES;
+}
+
+static int make_tree(long files) {
+  char dir[64], name[96];
+  if (mkdir("src", 0755) == -1) {
+    perror("src");
+    return -1;
+  }
+  for (int depth = 1; depth <= 3; depth++) {
+    for (long i = 0; i < level_len(depth); i++) {
+      tree_dir(dir, sizeof(dir), depth, i);
+      if (mkdir(dir, 0755) == -1) {
+        perror(dir);
+        return -1;
+      }
+    }
+  }
+  for (long i = 0; i < files; i++) {
+    leaf_path(dir, sizeof(dir), (i * 7919) % NLEAVES);
+    snprintf(name, sizeof(name), "%s/x%ld.%s", dir, i, i % 3 ? "c" : "log");
+    int fd = open(name, O_CREAT | O_WRONLY, 0644);
+    if (fd == -1) {
+      perror(name);
+      return -1;
+    }
+    close(fd);
+  }
+  return 0;
+}
+
+static void remove_tree(long files) {
+  char dir[64], name[96];
+  for (long i = 0; i < files; i++) {
+    leaf_path(dir, sizeof(dir), (i * 7919) % NLEAVES);
+    snprintf(name, sizeof(name), "%s/x%ld.%s", dir, i, i % 3 ? "c" : "log");
+    unlink(name);
+  }
+  for (int depth = 3; depth >= 1; depth--) {
+    for (long i = 0; i < level_len(depth); i++) {
+      tree_dir(dir, sizeof(dir), depth, i);
+      rmdir(dir);
+    }
+  }
+  rmdir("src");
+}
+
+/** @brief best time for the patterns, argv of the last run left in out */
+static double bench(unsigned threads, long iters, t_arena *a, char ***out,
+                    size_t *count) {
+  double best = 0;
+  for (long i = 0; i < iters; i++) {
+    arena_reset(a);
+    size_t argc = 0;
+    size_t cap = 16;
+    char **argv = arena_alloc(a, cap * sizeof(char *));
+    t_glob_ctx g;
+    double t0 = now_ns();
+    glob_ctx_init(&g, a);
+    g.globstar = true;
+    g.threads = threads;
+    for (size_t p = 0; p < NPATS; p++)
+      if (glob_expand(&g, g_pats[p], &argv, &argc, &cap) == -1) {
+        fprintf(stderr, "glob_expand failed\n");
+        exit(1);
+      }
+    glob_ctx_free(&g);
+    double t = now_ns() - t0;
+    *out = argv;
+    *count = argc;
+    if (i == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  long n = argc > 1 ? atol(argv[1]) : DEF_FILES;
+  long threads = argc > 2 ? atol(argv[2]) : DEF_THREADS;
+  long iters = argc > 3 ? atol(argv[3]) : DEF_ITERS;
+  if (n <= 0 || threads <= 0 || iters <= 0) {
+    fprintf(stderr, "usage: %s [files] [threads] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  char dir[] = "/tmp/msh_globstar_XXXXXX";
+  if (!mkdtemp(dir) || chdir(dir) == -1) {
+    perror("mkdtemp");
+    return 1;
+  }
+  int ret = 1;
+  if (make_tree(n) == -1)
+    goto out;
+
+  t_arena a1, an;
+  arena_init(&a1);
+  arena_init(&an);
+  char **v1, **vn;
+  size_t c1, cn;
+  double s = bench(1, iters, &a1, &v1, &c1);
+  double p = bench((unsigned)threads, iters, &an, &vn, &cn);
+  if (c1 != cn) {
+    fprintf(stderr, "match count mismatch: %zu vs %zu\n", c1, cn);
+    goto done;
+  }
+  for (size_t i = 0; i < c1; i++) {
+    if (strcmp(v1[i], vn[i]) != 0) {
+      fprintf(stderr, "argv differs at %zu: %s vs %s\n", i, v1[i], vn[i]);
+      goto done;
+    }
+  }
+
+  printf("%ld files, %d dirs, %zu matches for %s %s\n", n, NLEAVES, c1,
+         g_pats[0], g_pats[1]);
+  printf("1 walker    %8.2f ms\n", s / 1e6);
+  printf("%ld walkers  %8.2f ms (%.2fx, %ld cores online)\n", threads, p / 1e6,
+         s / p, sysconf(_SC_NPROCESSORS_ONLN));
+  ret = 0;
+
+done:
+  arena_free(&a1);
+  arena_free(&an);
+out:
+  remove_tree(n);
+  if (chdir("/") == -1 || rmdir(dir) == -1)
+    perror(dir);
+  return ret;
+}
@@ -0,0 +1,151 @@
+#include "hashtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @file ht_lookup.c
+ * @brief microbenchmark of t_hashtable against the fixed 128-bucket chained
+ * table it replaced, at 10, 1k and 100k keys (a PATH holds a few thousand).
+ *
+ * usage: ht_lookup [lookups]
+ *
+ * Keys look like executable names; half the lookups miss, as a command that
+ * is a function or builtin first misses the bins table.
+ */
+
+#define DEF_LOOKUPS 4000000
+#define OLD_BUCKETS 128
+
+typedef struct s_old_node {
+  char *key;
+  void *value;
+  struct s_old_node *next;
+} t_old_node;
+
+typedef struct s_old_table {
+  t_old_node *buckets[OLD_BUCKETS];
+} t_old_table;
+
+static unsigned old_hash(const char *key) {
+  unsigned long h = 5381;
+  int c;
+  while ((c = *key++))
+    h = ((h << 5) + h) + c;
+  return h % OLD_BUCKETS;
+}
+
+static t_old_node *old_find(t_old_table *t, const char *key);
+
+static void old_insert(t_old_table *t, const char *key, void *value) {
+  if (old_find(t, key))
+    return;
+  t_old_node *n = malloc(sizeof(*n));
+  n->key = strdup(key);
+  n->value = value;
+  unsigned idx = old_hash(key);
+  n->next = t->buckets[idx];
+  t->buckets[idx] = n;
+}
+
+static t_old_node *old_find(t_old_table *t, const char *key) {
+  for (t_old_node *n = t->buckets[old_hash(key)]; n; n = n->next) {
+    if (strcmp(n->key, key) == 0)
+      return n;
+  }
+  return NULL;
+}
+
+static void old_free(t_old_table *t) {
+  for (int i = 0; i < OLD_BUCKETS; i++) {
+    t_old_node *n = t->buckets[i];
+    while (n) {
+      t_old_node *next = n->next;
+      free(n->key);
+      free(n);
+      n = next;
+    }
+  }
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** @brief key i, odd i never inserted so they miss */
+static void make_key(char *buf, size_t size, size_t i) {
+  static const char *const stems[] = {"git", "python", "x86_64-linux-gnu-gcc",
+                                      "ls", "systemd-analyze", "perl"};
+  snprintf(buf, size, "%s-%zu", stems[i % 6], i);
+}
+
+static void bench(size_t n, long lookups) {
+  char **keys = malloc(2 * n * sizeof(*keys));
+  for (size_t i = 0; i < 2 * n; i++) {
+    char buf[64];
+    make_key(buf, sizeof(buf), i);
+    keys[i] = strdup(buf);
+  }
+
+  t_hashtable ht;
+  ht_init(&ht);
+  t_old_table old;
+  memset(&old, 0, sizeof(old));
+
+  double t0 = now_ns();
+  for (size_t i = 0; i < 2 * n; i += 2)
+    ht_insert(&ht, keys[i], keys[i], NULL);
+  double ins_new = (now_ns() - t0) / n;
+  t0 = now_ns();
+  for (size_t i = 0; i < 2 * n; i += 2)
+    old_insert(&old, keys[i], keys[i]);
+  double ins_old = (now_ns() - t0) / n;
+
+  size_t hits_new = 0, hits_old = 0;
+  t0 = now_ns();
+  for (long i = 0; i < lookups; i++)
+    hits_new += ht_find(&ht, keys[(size_t)i % (2 * n)]) != NULL;
+  double find_new = (now_ns() - t0) / lookups;
+  // long chains make the old table slow enough to sample fewer lookups
+  long old_lookups = lookups / (1 + (long)(n / 1000));
+  t0 = now_ns();
+  for (long i = 0; i < old_lookups; i++)
+    hits_old += old_find(&old, keys[(size_t)i % (2 * n)]) != NULL;
+  double find_old = (now_ns() - t0) / old_lookups;
+
+  size_t expect = 0;
+  for (long i = 0; i < old_lookups; i++)
+    expect += ((size_t)i % (2 * n)) % 2 == 0;
+  if (hits_old != expect)
+    fprintf(stderr, "hit count mismatch: %zu vs %zu\n", hits_old, expect);
+  if (hits_new != (size_t)(lookups + 1) / 2)
+    fprintf(stderr, "hit count mismatch: %zu\n", hits_new);
+
+  printf("%7zu keys  insert %6.1f / %6.1f ns  lookup %6.1f / %6.1f ns "
+         "(%.1fx)\n",
+         n, ins_new, ins_old, find_new, find_old, find_old / find_new);
+
+  ht_flush(&ht, NULL);
+  free(ht.slots);
+  old_free(&old);
+  for (size_t i = 0; i < 2 * n; i++)
+    free(keys[i]);
+  free(keys);
+}
+
+int main(int argc, char **argv) {
+  long lookups = argc > 1 ? atol(argv[1]) : DEF_LOOKUPS;
+  if (lookups <= 0) {
+    fprintf(stderr, "usage: %s [lookups]\n", argv[0]);
+    return 1;
+  }
+
+  printf("open addressing / 128 chained buckets, half the lookups miss\n");
+  const size_t sizes[] = {10, 1000, 100000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+    bench(sizes[i], lookups);
+  return 0;
+}
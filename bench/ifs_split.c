@@ -0,0 +1,150 @@
+#include "var_exp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @file ifs_split.c
+ * @brief microbenchmark of split_ifs against the byte at a time splitter it
+ * replaced, on the output of a large command substitution.
+ *
+ * usage: ifs_split [fields] [iterations]
+ *
+ * The buffer holds short words separated by single blanks and newlines,
+ * like `$(cat list)`, and every run splits a fresh copy since splitting
+ * writes NULs into it.
+ */
+
+#define DEF_FIELDS 200000
+#define DEF_ITERS 20
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** @brief the old splitter: IFS copied and its table rebuilt per call */
+static size_t old_split(t_shell *shell, char *buf, char ***argv, t_arena *a) {
+  char *ifs = getenv_local(&shell->env, "IFS", a);
+  if (!ifs) {
+    ifs = arena_alloc(a, 4);
+    memcpy(ifs, " \t\n", 4);
+  }
+  unsigned char is_sep[256] = {0};
+  for (int i = 0; ifs[i]; i++)
+    is_sep[(unsigned char)ifs[i]] = 1;
+
+  size_t count = 0;
+  size_t cap = 32;
+  char *p = buf;
+  bool in_sq = false;
+  bool in_dq = false;
+  *argv = arena_alloc(a, sizeof(char *) * cap);
+  for (size_t i = 0; i < cap; i++)
+    (*argv)[i] = NULL;
+
+  while (*p) {
+    while (*p && !in_sq && !in_dq && is_sep[(unsigned char)*p] &&
+           (*p == ' ' || *p == '\t' || *p == '\n'))
+      p++;
+    if (!*p)
+      break;
+    if (count >= cap - 1) {
+      size_t old_cap = cap;
+      cap *= 2;
+      *argv = arena_realloc(a, *argv, cap * sizeof(char *),
+                            old_cap * sizeof(char *));
+      for (size_t i = old_cap; i < cap; i++)
+        (*argv)[i] = NULL;
+    }
+    (*argv)[count++] = p;
+    while (*p) {
+      if (*p == '\'' && !in_dq)
+        in_sq = !in_sq;
+      else if (*p == '"' && !in_sq)
+        in_dq = !in_dq;
+      if (!in_sq && !in_dq && is_sep[(unsigned char)*p])
+        break;
+      p++;
+    }
+    if (*p) {
+      char d = *p;
+      *p = '\0';
+      p++;
+      if (d != ' ' && d != '\t' && d != '\n' && (is_sep[(unsigned char)*p] || !*p)
+          && count < cap - 1)
+        (*argv)[count++] = p;
+    }
+  }
+  (*argv)[count] = NULL;
+  return count;
+}
+
+static size_t new_split(t_shell *shell, char *buf, char ***argv, t_arena *a) {
+  split_ifs(shell, buf, strlen(buf), argv, a);
+  size_t n = 0;
+  while ((*argv)[n])
+    n++;
+  return n;
+}
+
+static double bench(size_t (*fn)(t_shell *, char *, char ***, t_arena *),
+                    t_shell *shell, const char *src, size_t len, long iters,
+                    size_t *fields) {
+  char *buf = malloc(len + 1);
+  t_arena a;
+  arena_init(&a);
+  double best = 0;
+  for (long i = 0; i < iters; i++) {
+    memcpy(buf, src, len + 1);
+    char **argv;
+    double t0 = now_ns();
+    *fields = fn(shell, buf, &argv, &a);
+    double t = now_ns() - t0;
+    if (i == 0 || t < best)
+      best = t;
+    arena_reset(&a);
+  }
+  arena_free(&a);
+  free(buf);
+  return best;
+}
+
+int main(int argc, char **argv) {
+  long n = argc > 1 ? atol(argv[1]) : DEF_FIELDS;
+  long iters = argc > 2 ? atol(argv[2]) : DEF_ITERS;
+  if (n <= 0 || iters <= 0) {
+    fprintf(stderr, "usage: %s [fields] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  char *src = malloc((size_t)n * 32 + 1);
+  if (!src) {
+    perror("malloc");
+    return 1;
+  }
+  size_t len = 0;
+  for (long i = 0; i < n; i++)
+    len += sprintf(src + len, "%s%ld%c", i % 3 ? "file-" : "/usr/lib/entry_",
+                   i, i % 8 == 7 ? '\n' : ' ');
+
+  t_shell shell;
+  memset(&shell, 0, sizeof(shell));
+  ht_init(&shell.env);
+
+  size_t fo, fn;
+  double o = bench(old_split, &shell, src, len, iters, &fo);
+  double s = bench(new_split, &shell, src, len, iters, &fn);
+  if (fo != fn) {
+    fprintf(stderr, "field count mismatch: %zu vs %zu\n", fo, fn);
+    return 1;
+  }
+
+  printf("%zu fields, %.1f MB\n", fn, len / 1048576.0);
+  printf("byte loop   %8.2f ms\n", o / 1e6);
+  printf("split_ifs   %8.2f ms (%.2fx)\n", s / 1e6, o / s);
+  free(src);
+  return 0;
+}
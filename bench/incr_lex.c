@@ -0,0 +1,115 @@
+#include "lexer.h"
+#include "script_src.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @file incr_lex.c
+ * @brief microbenchmark of lexing a multi-line block as its lines arrive:
+ * relexing the whole accumulated buffer per line against resuming the lexer
+ * where the previous line ended.
+ *
+ * usage: incr_lex [iterations] [lines]
+ *
+ * The block is one function definition, the shape of a pasted or sourced
+ * function body that stays incomplete until its last line.
+ */
+
+#define DEF_ITERS 5
+#define DEF_LINES 3000
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static char **gen_lines(long n) {
+  char **lines = malloc((n + 2) * sizeof(char *));
+  if (!lines)
+    return NULL;
+  lines[0] = strdup("big() {\n");
+  for (long i = 1; i <= n; i++) {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "  echo \"line %ld: $1\" | cat > /dev/null\n",
+             i);
+    lines[i] = strdup(buf);
+  }
+  lines[n + 1] = strdup("}\n");
+  return lines;
+}
+
+/** @brief the old loop: append a line, lex everything from the start */
+static size_t relex(char **lines, long n, t_arena *a) {
+  t_unit_buf ub = {0};
+  t_token_stream ts;
+  size_t toks = 0;
+  for (long i = 0; i < n + 2; i++) {
+    unit_buf_append(&ub, lines[i], strlen(lines[i]), a);
+    char *buf = ub.data;
+    t_err_code err;
+    init_token_stream(&ts, a);
+    lex_command_line(&buf, &ts, NULL, 0, a, false, &err);
+    toks = ts.tokens_arr_len;
+  }
+  return toks;
+}
+
+/** @brief the resumable lexer: each line is lexed once */
+static size_t resume(char **lines, long n, t_arena *a) {
+  t_unit_buf ub = {0};
+  for (long i = 0; i < n + 2; i++) {
+    unit_buf_append(&ub, lines[i], strlen(lines[i]), a);
+    t_err_code err;
+    unit_buf_lex(&ub, a, &err);
+  }
+  return ub.ts.tokens_arr_len;
+}
+
+static double bench(size_t (*fn)(char **, long, t_arena *), char **lines,
+                    long n, long iters, size_t *toks) {
+  t_arena a;
+  arena_init(&a);
+  double start = now_us();
+  for (long i = 0; i < iters; i++) {
+    *toks = fn(lines, n, &a);
+    arena_reset(&a);
+  }
+  double t = (now_us() - start) / iters;
+  arena_free(&a);
+  return t;
+}
+
+int main(int argc, char **argv) {
+  long iters = argc > 1 ? atol(argv[1]) : DEF_ITERS;
+  long n = argc > 2 ? atol(argv[2]) : DEF_LINES;
+  if (iters <= 0 || n <= 0) {
+    fprintf(stderr, "usage: %s [iterations] [lines]\n", argv[0]);
+    return 1;
+  }
+
+  char **lines = gen_lines(n);
+  if (!lines) {
+    perror("malloc");
+    return 1;
+  }
+
+  size_t rt, it;
+  double r = bench(relex, lines, n, iters, &rt);
+  double s = bench(resume, lines, n, iters, &it);
+  if (rt != it) {
+    fprintf(stderr, "token count mismatch: %zu vs %zu\n", rt, it);
+    return 1;
+  }
+
+  printf("%ld line block, %zu tokens, %ld runs\n", n + 2, it, iters);
+  printf("relex per line  %12.1f us/block\n", r);
+  printf("resume          %12.1f us/block (%.2fx)\n", s, r / s);
+
+  for (long i = 0; i < n + 2; i++)
+    free(lines[i]);
+  free(lines);
+  return 0;
+}
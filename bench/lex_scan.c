@@ -0,0 +1,120 @@
+#include "lexer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @file lex_scan.c
+ * @brief throughput of lex_command_line over a generated multi-megabyte
+ * script, in MB/s and ns per token.
+ *
+ * usage: lex_scan [megabytes] [iterations]
+ *
+ * The script mixes the shapes real scripts are made of: long quoted
+ * messages, pipelines with redirections, if and for blocks, assignments and
+ * comments. A checksum of every token's type, length and offset is printed
+ * so two builds of the lexer can be checked for identical output.
+ */
+
+#define DEF_MB 8
+#define DEF_ITERS 5
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const char *const g_lines[] = {
+    "if [ -f \"$config_dir/settings.conf\" ]; then\n",
+    "  echo \"loading configuration from $config_dir, please wait\" >&2\n",
+    "fi\n",
+    "for file in $src_dir/*.c $src_dir/*.h; do\n",
+    "  grep -n 'TODO\\|FIXME' \"$file\" | sort -u >> /tmp/todo_list.txt\n",
+    "done\n",
+    "# rotate the logs before the nightly build picks them up\n",
+    "archive_name=backup-$(date +%Y%m%d)-${HOSTNAME}.tar.gz\n",
+    "while read -r line; do count=$((count + 1)); done < input.txt\n",
+    "build_flags=\"-O2 -Wall -Wextra -fstack-protector-strong\" && make\n",
+    "cat <<-EOF | tr a-z A-Z || echo failed\n",
+    "usage() { echo 'usage: deploy [--dry-run] target'; return 2; }\n",
+};
+
+static char *gen_script(size_t size, size_t *len) {
+  char *buf = malloc(size + 256);
+  if (!buf)
+    return NULL;
+
+  size_t n = sizeof(g_lines) / sizeof(*g_lines);
+  size_t off = 0;
+  for (size_t i = 0; off < size; i++) {
+    const char *l = g_lines[(i * 7) % n];
+    size_t ll = strlen(l);
+    memcpy(buf + off, l, ll);
+    off += ll;
+  }
+  buf[off] = '\0';
+  *len = off;
+  return buf;
+}
+
+static unsigned long checksum(const t_token_stream *ts, const char *buf) {
+  unsigned long h = 1469598103934665603ul;
+  for (size_t i = 0; i < ts->tokens_arr_len; i++) {
+    const t_token *t = &ts->tokens[i];
+    unsigned long v = ((unsigned long)(t->start - buf) << 24) ^
+                      (t->len << 8) ^ (unsigned long)t->type ^
+                      ((unsigned long)(unsigned char)t->trailing_delim << 56);
+    h = (h ^ v) * 1099511628211ul;
+  }
+  return h;
+}
+
+int main(int argc, char **argv) {
+  long mb = argc > 1 ? atol(argv[1]) : DEF_MB;
+  long iters = argc > 2 ? atol(argv[2]) : DEF_ITERS;
+  if (mb <= 0 || iters <= 0) {
+    fprintf(stderr, "usage: %s [megabytes] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  size_t len;
+  char *script = gen_script((size_t)mb << 20, &len);
+  if (!script) {
+    perror("malloc");
+    return 1;
+  }
+
+  t_arena a;
+  arena_init(&a);
+  t_token_stream ts;
+  size_t toks = 0;
+  unsigned long sum = 0;
+  double best = 0;
+  for (long i = 0; i < iters; i++) {
+    char *buf = script;
+    t_err_code err;
+    init_token_stream(&ts, &a);
+    double t0 = now_ns();
+    if (lex_command_line(&buf, &ts, NULL, 0, &a, false, &err) == -1) {
+      fprintf(stderr, "lex failed: %d\n", err);
+      return 1;
+    }
+    double t = now_ns() - t0;
+    if (i == 0 || t < best)
+      best = t;
+    toks = ts.tokens_arr_len;
+    sum = checksum(&ts, buf);
+    arena_reset(&a);
+  }
+
+  printf("%.1f MB script, %zu tokens, checksum %016lx\n", len / 1048576.0,
+         toks, sum);
+  printf("best of %ld  %8.1f ms  %7.1f MB/s  %5.1f ns/token\n", iters,
+         best / 1e6, len / 1048576.0 / (best / 1e9), best / toks);
+
+  arena_free(&a);
+  free(script);
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "script_cache.h"
+#include "shell_cleanup.h"
+#include "shell_init.h"
+#include "var_exp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @file script_cache.c
+ * @brief microbenchmark of the parsed-script cache: lexing, parsing and
+ * serializing a script (miss) against mapping and relocating its image (hit).
+ *
+ * usage: script_cache [iterations] [functions]
+ *
+ * The generated script defines functions with loops and conditionals, the
+ * kind of sourced library a shell re-parses on every start.
+ */
+
+#define DEF_ITERS 200
+#define DEF_FUNCS 400
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int gen_script(const char *path, long funcs) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror("fopen");
+    return -1;
+  }
+  for (long i = 0; i < funcs; i++) {
+    fprintf(f, "fn_%ld() {\n", i);
+    fprintf(f, "  for x in a b c; do\n");
+    fprintf(f, "    if [ \"$x\" = \"b\" ]; then\n");
+    fprintf(f, "      echo \"$x-%ld\" | cat > /dev/null\n", i);
+    fprintf(f, "    fi\n");
+    fprintf(f, "  done\n");
+    fprintf(f, "}\n");
+    fprintf(f, "VAR_%ld=\"value $HOME %ld\"\n", i, i);
+  }
+  return fclose(f);
+}
+
+/** @brief gets and fully relocates the image, the work exec_script does */
+static int load_all(t_shell *shell, t_script_src *script) {
+  t_script_cache sc;
+  if (script_cache_get(shell, script, &sc) == -1)
+    return -1;
+  for (size_t i = 0; i < sc.units_len; i++) {
+    char *text;
+    if (!script_cache_unit(&sc, i, &text)) {
+      script_cache_release(&sc);
+      return -1;
+    }
+  }
+  script_cache_release(&sc);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  long iters = argc > 1 ? atol(argv[1]) : DEF_ITERS;
+  long funcs = argc > 2 ? atol(argv[2]) : DEF_FUNCS;
+  if (iters <= 0 || funcs <= 0) {
+    fprintf(stderr, "usage: %s [iterations] [functions]\n", argv[0]);
+    return 1;
+  }
+
+  char dir[] = "/tmp/msh_sc_benchXXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  char script_path[64];
+  snprintf(script_path, sizeof(script_path), "%s/lib.sh", dir);
+  if (gen_script(script_path, funcs) == -1)
+    return 1;
+
+  t_script_src script;
+  if (script_src_open(&script, script_path) == -1) {
+    perror("script");
+    return 1;
+  }
+  struct stat st = script.st;
+  char img_path[96];
+  snprintf(img_path, sizeof(img_path), "%s/%llx-%llx.mshc", dir,
+           (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+
+  t_shell shell;
+  if (init_shell_state(&shell, true) == -1)
+    return 1;
+  add_to_env(&shell, SC_ENV_VAR, dir, false, 0);
+
+  double start = now_us();
+  for (long i = 0; i < iters; i++) {
+    unlink(img_path);
+    if (load_all(&shell, &script) == -1) {
+      fprintf(stderr, "script not cacheable\n");
+      return 1;
+    }
+  }
+  double miss = (now_us() - start) / iters;
+
+  start = now_us();
+  for (long i = 0; i < iters; i++) {
+    if (load_all(&shell, &script) == -1)
+      return 1;
+  }
+  double hit = (now_us() - start) / iters;
+
+  printf("%ld functions, %lld bytes, %ld runs\n", funcs, (long long)st.st_size,
+         iters);
+  printf("parse+store  %10.1f us/script\n", miss);
+  printf("mmap+reloc   %10.1f us/script (%.2fx)\n", hit, miss / hit);
+
+  script_src_close(&script);
+  unlink(img_path);
+  unlink(script_path);
+  rmdir(dir);
+  cleanup_shell(&shell, 0);
+  return 0;
+}
@@ -27,4 +27,11 @@ void arena_reset(t_arena *a);
 void arena_free(t_arena *a);
 void arena_init(t_arena *a);
 
+/**
+ * @brief moves src's regions to the end of a, src is left empty
+ *
+ * Allocations made in src stay valid for as long as a keeps them.
+ */
+void arena_adopt(t_arena *a, t_arena *src);
+
 #endif // ARENA_H
@@ -0,0 +1,62 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include "shell.h"
+#include "var_exp.h"
+#include <stdbool.h>
+
+/**
+ * @file arith.h
+ *
+ * This module declares arithmetic evaluation for $((...)). Each expression
+ * text is compiled once into a small postfix program, cached on the shell by
+ * its source text, and run on a value stack: variables are loaded straight
+ * from t_env_entry.vint, so `i=$((i+1))` neither copies nor reparses.
+ *
+ * The compiler mirrors the interpreter's grammar rule for rule, so results
+ * and errors are the same; anything it cannot express is left to the
+ * interpreter.
+ */
+
+#define ARITH_CACHE_MAX 256 ///< cached programs before the cache is flushed
+#define ARITH_STACK_MAX 64  ///< deeper expressions are interpreted
+
+/**
+ * @typedef struct s_arith_prog t_arith_prog
+ * @brief compiled expression, code and variable names in one allocation.
+ */
+typedef struct s_arith_prog t_arith_prog;
+
+/**
+ * @brief returns the cached program for expr, compiling it on a miss
+ * @param shell pointer to shell struct
+ * @param expr $((...)) body, before any expansion
+ * @return program, NULL if out of memory.
+ */
+const t_arith_prog *arith_compile(t_shell *shell, const char *expr);
+
+/**
+ * @brief runs a compiled expression
+ * @param shell pointer to shell struct
+ * @param prog program from arith_compile
+ * @param res out: result
+ * @param err out: err_none or the evaluation error
+ * @return false if prog cannot run here, the caller must expand and
+ * interpret the text instead.
+ *
+ * @note $name and ${name} only run compiled while they hold a plain
+ * non-negative integer; any other value is spliced in as text by expansion.
+ */
+bool arith_run(t_shell *shell, const t_arith_prog *prog, long long *res,
+               t_err_type *err);
+
+/**
+ * @brief interprets an already expanded expression
+ * @param shell pointer to shell struct
+ * @param expr expression text
+ * @param err out: err_none or the parse/evaluation error
+ * @return result
+ */
+long long arith_interp(t_shell *shell, const char *expr, t_err_type *err);
+
+#endif // ! ARITH_H
@@ -26,6 +26,12 @@
  */
 #define MAX_REDIR_LEN 256
 
+/**
+ * @def STATIC_ARGV_UNSET
+ * @brief static_toks of a node whose static argv prefix is not measured yet
+ */
+#define STATIC_ARGV_UNSET ((size_t)-1)
+
 /**
  * @typedef enum e_op_types t_op_type
  * @brief op types as enum for readability
@@ -45,6 +51,18 @@ typedef enum e_op_types {
   OP_FUN
 } t_op_type;
 
+/**
+ * @typedef enum e_cmd_kind t_cmd_kind
+ * @brief what the command word of a simple command node resolved to
+ */
+typedef enum e_cmd_kind {
+  CMD_UNRESOLVED = 0,
+  CMD_FUNCTION, ///< target: functions table node
+  CMD_BUILTIN,  ///< target: builtins table node
+  CMD_ASSIGN,   ///< target: builtins table node of v (var=val)
+  CMD_EXTERN    ///< target: path owned by the bins table, NULL if not found
+} t_cmd_kind;
+
 /**
  * @typedef enum e_redir_types t_redir_type
  * @brief redir types as enum for readability
@@ -76,6 +94,8 @@ typedef struct s_io_redir {
   char *hd_body;
   int src_fd;
   int target_fd;
+  int hd_fd;              ///< memfd holding hd_body for reuse, -1 if none
+  const char *hd_fd_body; ///< hd_body hd_fd was written from
 } t_io_redir;
 
 /**
@@ -101,6 +121,13 @@ typedef struct s_ast_n {
   t_token *for_var;
   t_token *for_items;
   size_t items_len;
+
+  size_t static_toks; ///< leading tokens that expand to themselves
+  size_t static_argc; ///< argv words within static_toks
+
+  t_cmd_kind cmd_kind;    ///< cached resolution of a literal command word
+  void *cmd_target;       ///< see t_cmd_kind
+  unsigned long cmd_gen;  ///< shell cmd_gen the resolution is valid for
 } t_ast_n;
 
 /**
@@ -36,6 +36,7 @@ typedef struct s_builtin {
 
 void free_builtin(void *value);
 void free_env_entry(void *value);
+void stat_cache_clear(t_stat_cache *cache);
 
 int cd_builtin(t_ast_n *node, t_shell *shell, char **argv);
 int jobs_builtin(t_ast_n *node, t_shell *shell, char **argv);
@@ -0,0 +1,38 @@
+#ifndef CMD_SUBST_H
+#define CMD_SUBST_H
+
+#include "arena.h"
+#include "shell.h"
+#include <stddef.h>
+
+/**
+ * @file cmd_subst.h
+ *
+ * This module declares the in-process mode of command substitution. Lists
+ * made only of side effect free builtins (echo, printf, test, ...) and of
+ * functions whose bodies are such lists are run in the shell itself with
+ * stdout captured into a memfd, instead of forking a subshell.
+ *
+ * Isolation is by construction: nothing that can assign variables, change
+ * directory, set traps, define functions, redirect, background or exec is
+ * accepted, so the only state the list touches ($?, positional parameters
+ * of called functions) is saved and restored around it. Anything else falls
+ * back to the fork path.
+ */
+
+/**
+ * @brief runs a command substitution without forking if it is safe to
+ * @param shell pointer to shell struct
+ * @param cmd_line text between $( and )
+ * @param a arena of buf
+ * @param buf expansion buffer, output is appended at *k
+ * @param buf_cap capacity of buf
+ * @param k write offset into buf
+ * @return 0 if the substitution ran, -1 if it must be forked (nothing ran).
+ *
+ * @note trailing newlines are left for the caller to strip.
+ */
+int subst_in_process(t_shell *shell, const char *cmd_line, t_arena *a,
+                     char **buf, size_t *buf_cap, size_t *k);
+
+#endif // ! CMD_SUBST_H
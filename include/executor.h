@@ -48,11 +48,25 @@ typedef enum e_wait_status {
 } t_wait_status;
 
 int exec_script(t_shell *shell, const char *path);
+
+/**
+ * @brief parses and executes a unit accumulated from a script
+ * @param shell pointer to shell struct
+ * @param unit unit buffer, lexed up to its end by unit_buf_lex
+ * @param script true when running a script (quiet about incomplete input)
+ * @param last_err out: parse error
+ * @return 0 success, -1 parse fail
+ *
+ * The unit's tokens are parsed as they are; with aliases defined the text is
+ * lexed again by parse_and_execute so they get expanded.
+ */
+int exec_unit(t_shell *shell, t_unit_buf *unit, bool script,
+              t_err_code *last_err);
 int parse_and_execute(char **cmd_buf, t_shell *shell,
                       t_token_stream *token_stream, bool script,
                       t_err_code *last_err);
 
-void del_local_depth(size_t depth, t_hashtable *env);
+void del_local_depth(size_t depth, t_shell *shell);
 
 int check_trap(t_shell *shell);
 
@@ -0,0 +1,90 @@
+#ifndef GLOB_EXP_H
+#define GLOB_EXP_H
+
+#include "arena.h"
+#include "hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file glob_exp.h
+ *
+ * This module declares pathname expansion. Each pattern is compiled per path
+ * component into a small op list and matched against directory listings read
+ * once per command: `cmd *.log *.log.1 *.gz` lists the directory once for
+ * all three. Listings are sorted on a precomputed 8 byte key, so a pattern
+ * whose only wildcards sit in its last component comes out sorted already.
+ *
+ * Semantics follow glob(3) with GLOB_NOCHECK | GLOB_TILDE in the C locale
+ * (the shell never sets one): a leading dot only matches a literal dot,
+ * backslash escapes, [!...] [^...] ranges and [:class:], a trailing slash
+ * keeps directories only, and a pattern without matches is left as is.
+ * Quotes and backslashes in matched names are backslash escaped, since
+ * argv is unquoted after expansion.
+ *
+ * With globstar set, a component that is exactly `**` matches any number of
+ * directories, none included. Dot directories are skipped and symlinked
+ * ones matched but not walked into; as the last component `**` matches
+ * every file below as well. The tree is listed by a few threads stealing
+ * directories from each other, idle ones sleeping until a directory is
+ * queued, and the result is sorted, so argv does not depend on which thread
+ * read what.
+ */
+
+/**
+ * @typedef struct s_glob_ent t_glob_ent
+ * @brief directory entry of a cached listing.
+ */
+typedef struct s_glob_ent {
+  const char *name; ///< NUL terminated, in the command's arena
+  uint64_t key;     ///< first 8 bytes big endian, sorts like strcmp
+  uint32_t len;
+  unsigned char type; ///< d_type, DT_UNKNOWN when the fs does not say
+  bool plain;         ///< no quote or backslash, goes into argv unescaped
+} t_glob_ent;
+
+/**
+ * @typedef struct s_glob_dir t_glob_dir
+ * @brief sorted listing of one directory, empty if it could not be read.
+ */
+typedef struct s_glob_dir {
+  t_glob_ent *ents;
+  size_t len;
+} t_glob_dir;
+
+/**
+ * @typedef struct s_glob_ctx t_glob_ctx
+ * @brief listings shared by the patterns of one command.
+ */
+typedef struct s_glob_ctx {
+  t_hashtable dirs; ///< directory path -> t_glob_dir
+  t_arena *a;       ///< listings, results and scratch
+  bool globstar;    ///< `**` recurses, off by default
+  unsigned threads; ///< walkers for `**`, 0 for one per core
+} t_glob_ctx;
+
+/**
+ * @brief empty cache on arena a, globstar off
+ */
+void glob_ctx_init(t_glob_ctx *g, t_arena *a);
+
+/**
+ * @brief drops the listing table, the listings stay in the arena
+ */
+void glob_ctx_free(t_glob_ctx *g);
+
+/**
+ * @brief appends the sorted matches of pattern to a growing argv
+ * @param g listing cache of the current command
+ * @param pattern word to expand, quotes are matched literally
+ * @param argv vector in g->a, grown with arena_realloc
+ * @param argc used slots, matches are appended at argv[*argc]
+ * @param cap slots allocated, one is always left for the terminator
+ * @return matches appended, 0 if none (the caller keeps the word), -1 on
+ * allocation failure.
+ */
+long glob_expand(t_glob_ctx *g, const char *pattern, char ***argv,
+                 size_t *argc, size_t *cap);
+
+#endif // ! GLOB_EXP_H
@@ -6,6 +6,7 @@
 #include "userinp.h"
 #include "var_exp.h"
 #include <fcntl.h>
+#include <spawn.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #define BUF_GROWTH_FACTOR 2
@@ -28,6 +29,17 @@
  */
 int redirect_io(t_shell *shell, t_ast_n *node);
 
+/**
+ * @brief replays the redirections of node as posix_spawn file actions
+ * @param fa initialized file actions object
+ * @param node pointer to ast node
+ * @return 0 success, -1 if a redirection cannot be expressed (heredoc) or on
+ * fail.
+ *
+ * @note used by the spawn launch path instead of redirect_io in a child.
+ */
+int redir_file_actions(posix_spawn_file_actions_t *fa, t_ast_n *node);
+
 int collect_pending_hds(t_ast_n *r, size_t *idx, t_shell *shell);
 
 int check_realloc_pending_hds(t_shell *shell);
@@ -35,6 +47,16 @@ int check_realloc_pending_hds(t_shell *shell);
 int read_hd_body(const char *delim, bool strip, t_shell *shell, char **out);
 
 int collect_stdin_hds(t_shell *shell, t_ast_n *root);
+
+/**
+ * @brief closes the heredoc memfds cached on the redirections of an AST
+ * @param root root node
+ *
+ * @note called before an arena AST is discarded; heap ASTs (functions) keep
+ * theirs until free_ast.
+ */
+void release_hd_fds(t_ast_n *root);
+
 /**
  * @brief restores standard i/o of process
  * @param shell pointer to shell struct
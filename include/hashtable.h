@@ -2,17 +2,35 @@
 #define HASHTABLE_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-#define HT_DEFSIZE 128
+/**
+ * @file hashtable.h
+ *
+ * String keyed table, open addressing with Robin Hood probing. Slots hold
+ * the full hash and key length next to the node pointer, so a probe only
+ * touches a node whose hash and length both match. Nodes are one allocation
+ * each (key inline) and never move, so t_ht_node pointers stay valid until
+ * their key is deleted; the slot array doubles past 3/4 load.
+ */
+
+#define HT_MIN_CAP 16 ///< slots allocated by the first insert, power of two
 
 typedef struct s_ht_node {
-  char *key;
   void *value;
-  struct s_ht_node *next;
+  size_t key_len;
+  char key[];
 } t_ht_node;
 
+typedef struct s_ht_slot {
+  uint32_t hash;
+  uint32_t key_len;
+  t_ht_node *node; ///< NULL when the slot is empty
+} t_ht_slot;
+
 typedef struct s_hashtable {
-  t_ht_node *buckets[HT_DEFSIZE];
+  t_ht_slot *slots;
+  size_t cap; ///< 0 until the first insert
   size_t count;
 } t_hashtable;
 
@@ -20,14 +38,29 @@ typedef void (*t_ht_free_fn)(void *value);
 typedef void (*t_ht_print_fn)(const char *key, void *value);
 
 void ht_init(t_hashtable *ht);
-unsigned ht_hash(const char *key);
+uint32_t ht_hash(const char *key, size_t len);
 
 t_ht_node *ht_insert(t_hashtable *ht, const char *key, void *value,
                      t_ht_free_fn free_fn);
 t_ht_node *ht_find(t_hashtable *ht, const char *key);
+
+/**
+ * @brief finds a key given by length, it need not be NUL terminated
+ * @return node, NULL if absent.
+ */
+t_ht_node *ht_find_n(t_hashtable *ht, const char *key, size_t len);
 int ht_delete(t_hashtable *ht, const char *key, t_ht_free_fn free_fn);
 int ht_flush(t_hashtable *ht, t_ht_free_fn free_fn);
 
+/**
+ * @brief iterates the table's nodes in slot order
+ * @param it cursor, 0 to start
+ * @return next node, NULL once done.
+ *
+ * @note deleting during a walk may skip entries, collect keys first.
+ */
+t_ht_node *ht_next(t_hashtable *ht, size_t *it);
+
 void ht_print(t_hashtable *ht, t_ht_print_fn print_fn);
 
 #endif
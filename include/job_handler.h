@@ -10,11 +10,32 @@
 #define MAX_JOBS 8192
 #define BUF_GROWTH_FACTOR 2
 #define INITIAL_JOB_TABLE_LENGTH 32
+#define INITIAL_PID_INDEX_LENGTH 64
 
 int add_job(t_shell* shell, t_job* job);
 int del_job(t_shell* shell, int job_id, bool flow);
 
-int add_process_to_job(t_job *job, t_process* process);
+/**
+ * @brief deletes job from the job table, pid index and completed list
+ * @return 0 success, -1 if job is not in the table
+ */
+int remove_job(t_shell* shell, t_job* job);
+
+/**
+ * @brief marks job completed and queues it for del_completed_jobs
+ */
+void mark_job_completed(t_shell* shell, t_job* job);
+
+/**
+ * @brief appends process to job and indexes it by pid
+ */
+int add_process_to_job(t_shell* shell, t_job *job, t_process* process);
+
+/**
+ * @brief drops the processes of job from the pid index
+ * @note must run before the processes are freed
+ */
+void unindex_job(t_shell* shell, t_job* job);
 
 int reset_job_table_cap(t_shell* shell);
 
@@ -31,6 +52,7 @@ int is_job_stopped(t_job* job);
 t_job* get_foreground_job(t_shell* shell);
 t_job* find_job(t_shell* shell, int job_id);
 t_job* find_job_by_pid(t_shell* shell, pid_t pid);
+t_process* find_process_by_pid(t_shell* shell, pid_t pid);
 t_process* find_process_in_job(t_job* job, pid_t pid);
 
 void print_job_info(t_job* job);
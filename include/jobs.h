@@ -28,6 +28,9 @@ typedef struct s_process {
   volatile int stopped;
   volatile int running;
   struct s_process *next;
+
+  struct s_job *job;        ///< owning job, set by add_process_to_job
+  struct s_process *hnext;  ///< next process in the same pid_index bucket
 } t_process;
 
 typedef struct s_job {
@@ -47,6 +50,12 @@ typedef struct s_job {
 
   pid_t last_pid;
 
+  size_t slot; ///< index in the job table
+
+  int done_queued; ///< on the completed jobs list
+  struct s_job *done_prev;
+  struct s_job *done_next;
+
 } t_job;
 
 #endif
@@ -86,7 +86,50 @@ typedef struct s_token_stream {
   size_t tokens_arr_len;
 } t_token_stream;
 
+/**
+ * @typedef struct s_lex_state t_lex_state
+ * @brief where a lexer run over a growing buffer stopped.
+ *
+ * Offsets rather than pointers, so the buffer may move between runs.
+ */
+typedef struct s_lex_state {
+  size_t pos; ///< offset lexing resumes at
+  bool in_single_quote;
+  bool in_double_quote;
+  bool tokenized;   ///< a word is pending (only inside open quotes)
+  size_t tok_start; ///< offset of the pending word
+  size_t word_len;
+  int nest; ///< if/loop/paren/brace openers minus closers lexed so far
+} t_lex_state;
+
 int init_token_stream(t_token_stream *token_stream, t_arena *a);
+
+void init_lex_state(t_lex_state *st);
+
+/**
+ * @brief lexes the text appended to cmd_buf since the last call
+ * @param cmd_buf NUL terminated buffer, only ever appended to
+ * @param st lexer state, from init_lex_state on the first call
+ * @param tokens token stream the new tokens are appended to
+ * @param a arena
+ * @param last_err out: ERR_UNBALANCED_QUOTES when a quote is still open
+ * @return 0 success, -1 if the buffer ends inside quotes; st keeps the open
+ * word so the next call continues it.
+ *
+ * @note no alias expansion: callers relex with lex_command_line when the
+ * alias table is not empty.
+ */
+int lex_resume(char *cmd_buf, t_lex_state *st, t_token_stream *tokens,
+               t_arena *a, t_err_code *last_err);
+
+/**
+ * @brief moves the token pointers of ts from obuf into nbuf
+ * @param ts token stream
+ * @param obuf buffer the tokens point into
+ * @param nbuf copy of obuf at a new address
+ */
+void rebase_token_stream(t_token_stream *ts, const char *obuf, char *nbuf);
+
 int lex_command_line(char **cmd_buf, t_token_stream *tokens,
                      t_hashtable *aliases, int depth, t_arena *a, bool hd,
                      t_err_code *last_err);
@@ -0,0 +1,21 @@
+#ifndef MEMFD_H
+#define MEMFD_H
+
+/**
+ * @file memfd.h
+ *
+ * This module declares anonymous in-memory files used to capture or stage
+ * shell output without a pipe (no reader process needed, no size limit).
+ */
+
+/**
+ * @brief opens an anonymous read/write file that lives in memory
+ * @param name debug name of the file (shows up in /proc/<pid>/fd)
+ * @return fd on success (close-on-exec), -1 on fail.
+ *
+ * Uses memfd_create, falling back to an unlinked file in $TMPDIR or /tmp on
+ * kernels without it.
+ */
+int mem_fd_open(const char *name);
+
+#endif // ! MEMFD_H
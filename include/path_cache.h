@@ -0,0 +1,44 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include "shell.h"
+#include <stdbool.h>
+
+/**
+ * @file path_cache.h
+ *
+ * This module declares command lookup in PATH. Nothing is scanned up front:
+ * a name is resolved on first use by probing the PATH directories in order,
+ * and the answer, found or not, is kept in shell->bins. A hit stands while
+ * neither its directory nor one ahead of it in PATH has changed, a miss while
+ * no PATH directory has, so a script calling a missing command in a loop pays
+ * a stat per directory, not a rescan. Once one has changed, every answer is
+ * probed again on its next use.
+ */
+
+/**
+ * @typedef struct s_bin t_bin
+ * @brief value of a shell->bins entry.
+ */
+typedef struct s_bin {
+  unsigned long epoch; ///< path_cache.epoch it was probed in
+  size_t dir;          ///< index of the PATH directory it was found in
+  bool found;          ///< false for a remembered miss, path is empty
+  char path[];
+} t_bin;
+
+/**
+ * @brief resolves a command name through PATH
+ * @param shell pointer to shell struct
+ * @param name command name without a '/'
+ * @return path, valid until the next reset or epoch change, NULL if name is
+ * not an executable in PATH or contains a '/'.
+ */
+const char *path_lookup(t_shell *shell, const char *name);
+
+/**
+ * @brief forgets every answer and the parsed PATH, for a new PATH or hash -r
+ */
+void path_cache_reset(t_shell *shell);
+
+#endif // ! PATH_CACHE_H
@@ -0,0 +1,98 @@
+#ifndef SCRIPT_CACHE_H
+#define SCRIPT_CACHE_H
+
+#include "ast.h"
+#include "script_src.h"
+#include "shell.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @file script_cache.h
+ *
+ * This module declares the opt-in on-disk cache of parsed scripts. A script's
+ * top level units (the buffers exec_script hands to parse_and_execute) are
+ * lexed and parsed once, then stored with their token streams and ASTs in a
+ * relocatable image: pointers are file offsets listed in a per unit
+ * relocation table, so the image is mmap'd MAP_PRIVATE and patched in place
+ * right before each unit runs.
+ *
+ * Enabled by exporting MSH_SCRIPT_CACHE=<dir>. Images are keyed on the
+ * script's (dev, inode, mtime, size) and the msh binary's identity.
+ */
+
+#define SC_ENV_VAR "MSH_SCRIPT_CACHE"
+
+/**
+ * @typedef struct s_sc_unit t_sc_unit
+ * @brief one top level unit of a cached script, all fields are file offsets.
+ */
+typedef struct s_sc_unit {
+  uint64_t lc;        ///< script line the unit ended on
+  uint64_t text_off;  ///< NUL terminated unit text
+  uint64_t root_off;  ///< root t_ast_n
+  uint64_t relocs_off;
+  uint64_t relocs_len;
+} t_sc_unit;
+
+/**
+ * @typedef struct s_script_cache t_script_cache
+ * @brief a loaded (mmap'd) or freshly built (heap) script image.
+ */
+typedef struct s_script_cache {
+  char *base;
+  size_t size;
+  bool mapped;
+  t_sc_unit *units;
+  size_t units_len;
+} t_script_cache;
+
+/**
+ * @brief checks whether the parsed-script cache is enabled
+ * @param shell pointer to shell struct
+ * @return true if MSH_SCRIPT_CACHE names a cache directory.
+ */
+bool script_cache_enabled(t_shell *shell);
+
+/**
+ * @brief gets the parsed image of script, loading or building it
+ * @param shell pointer to shell struct
+ * @param script loaded script, positioned at the start
+ * @param sc out: image
+ * @return 0 on success, -1 if the script cannot be cached; script is rewound.
+ *
+ * On a miss the script is lexed and parsed without executing anything and the
+ * image is written to the cache directory (best effort). Scripts with
+ * heredocs, parse errors or alias expansion are not cacheable.
+ */
+int script_cache_get(t_shell *shell, t_script_src *script,
+                     t_script_cache *sc);
+
+/**
+ * @brief returns the source text of unit i without relocating it
+ * @param sc pointer to image
+ * @param i unit index
+ * @return NUL terminated unit text
+ *
+ * @note used to re-lex a unit once aliases exist, since the cached tokens
+ * were lexed without any.
+ */
+const char *script_cache_text(t_script_cache *sc, size_t i);
+
+/**
+ * @brief relocates unit i of sc in place and returns its AST
+ * @param sc pointer to image
+ * @param i unit index, each unit is relocated exactly once
+ * @param text out: unit text the unit's tokens point into
+ * @return root node, NULL if the unit is malformed.
+ */
+t_ast_n *script_cache_unit(t_script_cache *sc, size_t i, char **text);
+
+/**
+ * @brief releases an image from script_cache_get
+ * @param sc pointer to image
+ */
+void script_cache_release(t_script_cache *sc);
+
+#endif // ! SCRIPT_CACHE_H
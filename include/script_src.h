@@ -0,0 +1,102 @@
+#ifndef SCRIPT_SRC_H
+#define SCRIPT_SRC_H
+
+#include "arena.h"
+#include "lexer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/**
+ * @file script_src.h
+ *
+ * This module declares the script loader: a regular script file is read
+ * into memory in one pass, then handed out line by line straight from that
+ * buffer. Pipes, FIFOs and devices are read a line at a time instead, so
+ * their commands run as the lines arrive. Top level units are accumulated
+ * in a unit buffer that grows geometrically and is lexed incrementally, so
+ * a unit spanning n lines costs O(n) copying and lexing.
+ */
+
+/**
+ * @typedef struct s_script_src t_script_src
+ * @brief a whole script in memory with a read cursor, or a stream.
+ */
+typedef struct s_script_src {
+  char *data; ///< whole script, NULL when streamed
+  size_t len;
+  size_t pos; ///< offset of the next unread line
+  size_t lc;  ///< lines handed out so far, heredoc bodies included
+  struct stat st;
+  FILE *stream; ///< non-regular script read with getline, NULL otherwise
+  char *line;   ///< getline buffer of stream
+  size_t line_cap;
+} t_script_src;
+
+/**
+ * @typedef struct s_unit_buf t_unit_buf
+ * @brief NUL terminated arena buffer a multi line unit is accumulated in,
+ * with the tokens lexed from it so far.
+ */
+typedef struct s_unit_buf {
+  char *data;
+  size_t len;
+  size_t cap;
+  t_token_stream ts; ///< tokens of data[0, lex.pos), lexed once
+  t_lex_state lex;
+} t_unit_buf;
+
+/**
+ * @brief loads the script at path
+ * @param src out: loaded script
+ * @param path script path
+ * @return 0 success, -1 fail with errno set
+ */
+int script_src_open(t_script_src *src, const char *path);
+
+/**
+ * @brief returns the next line of src
+ * @param src pointer to loaded script
+ * @param len out: line length, trailing '\n' included if present
+ * @return pointer into the script (not NUL terminated), NULL at end of file;
+ * a streamed line is only valid until the next call.
+ */
+const char *script_src_line(t_script_src *src, size_t *len);
+
+/**
+ * @brief moves the cursor of src back to the first line
+ * @param src pointer to loaded script, which must not be streamed
+ */
+void script_src_rewind(t_script_src *src);
+
+/**
+ * @brief releases a script from script_src_open
+ * @param src pointer to loaded script
+ */
+void script_src_close(t_script_src *src);
+
+/**
+ * @brief appends n bytes of s to ub, growing it in a
+ * @param ub unit buffer, zeroed when empty
+ * @param s bytes to append
+ * @param n byte count
+ * @param a arena the buffer lives in
+ * @return offset of the appended bytes in ub->data, -1 fail
+ */
+long unit_buf_append(t_unit_buf *ub, const char *s, size_t n, t_arena *a);
+
+/**
+ * @brief lexes the text appended to ub since the last call
+ * @param ub unit buffer
+ * @param a arena the buffer lives in
+ * @param last_err out: ERR_UNBALANCED_QUOTES when a quote is still open
+ * @return true if the unit may be complete, false while a quote or an
+ * if/loop/group is still open.
+ *
+ * Each line is lexed once however many lines the unit spans; callers only
+ * try to parse once this returns true.
+ */
+bool unit_buf_lex(t_unit_buf *ub, t_arena *a, t_err_code *last_err);
+
+#endif // ! SCRIPT_SRC_H
@@ -7,9 +7,11 @@
 #include "hashtable.h"
 #include "jobs.h"
 #include "lexer.h"
+#include "script_src.h"
 #include "sigstruct.h"
 #include "termstruct.h"
 #include <stdint.h>
+#include <sys/stat.h>
 
 /**
  * @file shell.h
@@ -21,19 +23,120 @@
 #define ENV_READONLY (1 << 1)
 #define ENV_HAS_VINT (1 << 2)
 #define ENV_LOCAL (1 << 3)
+#define ENV_INT_ONLY (1 << 4) ///< vint is authoritative, val not yet rebuilt
+
+#define ENV_INT_VAL_CAP 24 ///< fits any long long in decimal
 
 typedef struct s_shopts {
   bool render_autosgst;
+  bool test_statcache; ///< share stat results between consecutive tests
+  bool globstar;       ///< `**` matches across directories
 } t_shopt;
 
 typedef struct s_env_entry {
   char *name;
-  char *val;
+  char *val; ///< read through env_val, stale while ENV_INT_ONLY
+  size_t val_len; ///< strlen(val), so expansion copies it in one go
+  size_t val_cap;
   long long vint;
   unsigned char flags;
   int local_depth;
+  long envp_idx; ///< slot in t_envp vec, -1 if not exported
 } t_env_entry;
 
+/**
+ * @typedef struct s_envp t_envp
+ * @brief exported environment handed to execve/posix_spawn.
+ *
+ * Kept in sync with the env table entry by entry, so exec never rebuilds it;
+ * owners[i] is the entry vec[i] ("NAME=VAL", heap) was built from. Nothing
+ * is built at startup: the first get_envp builds it, so a shell that never
+ * runs a command does not copy its environment twice.
+ */
+typedef struct s_envp {
+  char **vec;
+  t_env_entry **owners;
+  size_t len;
+  size_t cap;
+  bool pending; ///< not built yet, envp_sync is a no-op until get_envp
+} t_envp;
+
+#define STAT_CACHE_SLOTS 8
+
+typedef struct s_stat_slot {
+  char *path;
+  bool nofollow; ///< lstat result
+  int err;       ///< errno of the failed call, 0 if st is valid
+  struct stat st;
+} t_stat_slot;
+
+/**
+ * @typedef struct s_stat_cache t_stat_cache
+ * @brief stat results shared by a run of test commands,
+ * `[ -f x ] && [ -r x ]` stats x once.
+ *
+ * Only trusted while nothing but test runs: the executor clears it on every
+ * command line, loop iteration, redirection, forked command substitution and
+ * any other command.
+ */
+typedef struct s_stat_cache {
+  t_stat_slot slots[STAT_CACHE_SLOTS];
+  size_t len;
+  size_t next; ///< slot replaced once full
+} t_stat_cache;
+
+#define IFS_CACHE_MAX 16 ///< longer IFS values are reclassified on each split
+
+/**
+ * @typedef struct s_ifs_cache t_ifs_cache
+ * @brief byte classes field splitting built for the IFS in value.
+ *
+ * split_ifs compares the current IFS against value, a few bytes, and only
+ * rebuilds the tables when it changed. With SSSE3 or AVX2, which prod's
+ * -march=native turns on, nib_lo/nib_hi classify 16 or 32 bytes at a time:
+ * a byte is a separator or quote iff the entries for its low and high nibble
+ * share a bit.
+ */
+typedef struct s_ifs_cache {
+  bool valid;
+  bool unset; ///< built for an unset IFS, i.e. " \t\n"
+  size_t len;
+  char value[IFS_CACHE_MAX];
+  unsigned char cls[256]; ///< IFS_SEP, IFS_WS and IFS_QUOTE bits
+  bool ws_only;           ///< no separator yields empty fields
+  bool nib_ok;            ///< the nibble tables are exact for cls
+  unsigned char nib_lo[16];
+  unsigned char nib_hi[16];
+} t_ifs_cache;
+
+/**
+ * @typedef struct s_path_dir t_path_dir
+ * @brief a PATH directory and how it looked when last stat'ed.
+ */
+typedef struct s_path_dir {
+  char *dir;
+  bool seen; ///< stat succeeded, the fields below are valid
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+} t_path_dir;
+
+/**
+ * @typedef struct s_path_cache t_path_cache
+ * @brief PATH split into directories on the first lookup.
+ *
+ * Every shell->bins entry carries the epoch it was probed in. The epoch
+ * moves when PATH is reset or a directory is seen to have changed, which
+ * makes all entries stale at once.
+ */
+typedef struct s_path_cache {
+  t_path_dir *dirs;
+  size_t len;
+  bool parsed;
+  bool stamped; ///< dirs hold the stats answers are checked against
+  unsigned long epoch;
+} t_path_cache;
+
 typedef struct s_fd_backup {
   int src_fd;
   int saved_fd;
@@ -69,14 +172,22 @@ typedef struct s_exec_ctx {
  */
 typedef struct shell_s {
 
-  t_hashtable bins;
+  t_hashtable bins; ///< command name -> t_bin, filled by path_lookup
   t_hashtable env;
   t_hashtable builtins;
   t_hashtable aliases;
   t_hashtable functions;
+  t_hashtable arith_cache; ///< $((...)) text -> compiled t_arith_prog
+
+  t_envp envp;
 
   t_job **job_table;
   t_job *fg_job;
+  t_job *done_jobs; ///< completed jobs left for del_completed_jobs
+
+  /* pid -> process buckets chained through t_process.hnext, so reaping a
+   * child does not scan the job table */
+  t_process **pid_index;
 
   t_token_stream token_stream;
   t_ast ast;
@@ -85,12 +196,17 @@ typedef struct shell_s {
 
   char **argv;
   const char *path;
+  t_path_cache path_cache;
   char *prompt;
   int prompt_rows;
   char *sh_name;
 
   bool exflag;
 
+  /* bumped whenever functions, aliases or PATH entries change, invalidates
+   * the command resolutions cached on ast nodes */
+  unsigned long cmd_gen;
+
   t_arena arena;
   t_shell_sigtable shell_sigtable;
   t_term_ctrl term_ctrl;
@@ -100,6 +216,10 @@ typedef struct shell_s {
 
   size_t job_table_cap;
   size_t job_count;
+  size_t job_free_hint; ///< no free job table slot below this index
+
+  size_t pid_index_cap;
+  size_t pid_index_len;
 
   pid_t pgid;
   int argc;
@@ -114,13 +234,17 @@ typedef struct shell_s {
   int rows;
   int cols;
 
-  FILE *script_fstream;
+  t_script_src *script_src;    ///< script being run, NULL when not in one
+  struct s_snap_rec *snap_rec; ///< rc run being recorded, see snapshot.h
+  bool history_loaded;         ///< ~/.msh_history read, see history_load
 
   char **pending_hds;
   size_t pending_hds_cap;
   size_t pending_hds_len;
 
   t_shopt shopts;
+  t_stat_cache stat_cache;
+  t_ifs_cache ifs_cache;
 
   char *traps[NSIG];
 
@@ -68,8 +68,6 @@
  */
 extern char **environ;
 
-void refresh_path_bins(t_shell *shell);
-
 size_t visible_len(const char *s, int cols, int *rows);
 
 void prompt_metrics(const char *s, int term_cols, size_t *rows, size_t *cols);
@@ -81,6 +79,15 @@ int replace_home_dir(char **buf, const char *home);
 char *expand_prompt(t_shell *shell, const char *src);
 
 int get_shell_prompt(t_shell *shell);
+
+/**
+ * @brief reads ~/.msh_history into shell->history, once
+ * @param shell pointer to shell struct
+ *
+ * Interactive startup leaves this to the first prompt, after it is drawn;
+ * everything that walks the history calls it first.
+ */
+void history_load(t_shell *shell);
 /**
  * @def init_shell_state(t_shell* shell)
  * @param shell pointer to shell struct
@@ -0,0 +1,64 @@
+#ifndef SIG_EVENTS_H
+#define SIG_EVENTS_H
+
+#include <signal.h>
+
+/**
+ * @file sig_events.h
+ *
+ * This module declares the shell's signal event source: sig_handler writes
+ * every caught signal (child state changes, traps, SIGWINCH, SIGINT) into a
+ * non-blocking self-pipe so a single poll() can wait on signals and an input
+ * fd together, waking exactly once per event instead of relying on EINTR.
+ *
+ * The pipe belongs to the process that created it; a forked subshell that
+ * waits gets its own, so it never steals its parent's wakeups.
+ */
+
+/** @brief lowest fd number the pipe is moved to, clear of user fds 0-9 */
+#define SIG_EVENTS_FD_MIN 10
+
+/** @brief sig_events_wait result: at least one signal was caught */
+#define SIG_EV_SIGNAL 0x1
+/** @brief sig_events_wait result: the input fd is readable */
+#define SIG_EV_INPUT 0x2
+
+/**
+ * @brief creates the event pipe for the calling process
+ * @return 0 success, -1 fail
+ *
+ * @note called from init_pa_sigtable so signals caught before the first wait
+ * are queued; sig_events_wait calls it again in forked children.
+ */
+int sig_events_init(void);
+
+/**
+ * @brief queues sig on the event pipe, async-signal-safe
+ * @param sig signal number
+ */
+void sig_events_notify(int sig);
+
+/**
+ * @brief routes sig through sig_handler if it is not already
+ * @param sig signal number
+ * @param old out: previous action, to restore once done waiting
+ * @return 1 if the handler was installed, 0 if already caught, -1 fail.
+ *
+ * @note scripts run with SIGCHLD at its default, which never reaches the pipe.
+ * Also gives a forked subshell its own pipe.
+ */
+int sig_events_catch(int sig, struct sigaction *old);
+
+/**
+ * @brief waits for a signal event or for in_fd to become readable
+ * @param in_fd fd to watch for input, -1 for signals only
+ * @param timeout_ms poll timeout, -1 to block
+ * @return SIG_EV_* bitmask, 0 on timeout, -1 fail.
+ *
+ * SIGCHLD is unblocked for the duration of the wait (the executor blocks it
+ * while a command line runs) and the pipe is drained; callers inspect sigs[]
+ * to see which signals arrived.
+ */
+int sig_events_wait(int in_fd, int timeout_ms);
+
+#endif // ! SIG_EVENTS_H
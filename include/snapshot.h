@@ -0,0 +1,90 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "ast.h"
+#include "shell.h"
+#include <stdint.h>
+
+/**
+ * @file snapshot.h
+ *
+ * This module declares the opt-in warm-start snapshot of ~/.mshrc. When the
+ * rc file is run, what it leaves behind is recorded: aliases, functions as
+ * serialized ASTs, shopts and the variables it set or unset. The next
+ * interactive start mmaps the snapshot and replays that state instead of
+ * lexing, parsing and running the rc file.
+ *
+ * Only a declarative rc is recorded: every top level command must be an
+ * assignment, function definition or one of alias, unalias, export,
+ * readonly, unset, shopt, true, false and `:`, with no redirection, pipe,
+ * subshell, command substitution, unquoted glob or expansion of a volatile
+ * parameter ($$, $PWD, $RANDOM, ...). Such an rc leaves the same state
+ * whenever it starts from the same environment, so a snapshot is keyed on
+ * the rc file's (dev, inode, size, mtime), the msh binary's identity and a
+ * hash of the environment minus volatile variables.
+ *
+ * Enabled by exporting MSH_SNAPSHOT=<file>. PATH is not part of the
+ * snapshot: commands are looked up lazily (see path_cache.h), so there is
+ * no PATH index left to save at startup.
+ */
+
+#define SNAP_ENV_VAR "MSH_SNAPSHOT"
+
+/**
+ * @typedef struct s_snap_file t_snap_file
+ * @brief identity of a file a snapshot depends on.
+ */
+typedef struct s_snap_file {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} t_snap_file;
+
+/**
+ * @typedef struct s_snap_key t_snap_key
+ * @brief what a snapshot is valid for.
+ */
+typedef struct s_snap_key {
+  t_snap_file rc;
+  t_snap_file build; ///< the msh binary
+  uint64_t env;      ///< hash of the non-volatile variables before the rc
+} t_snap_key;
+
+/**
+ * @typedef struct s_snap_rec t_snap_rec
+ * @brief an rc run being recorded.
+ */
+typedef struct s_snap_rec {
+  char *path; ///< snapshot file
+  t_snap_key key;
+  t_hashtable pre; ///< variables before the rc ran, name -> t_snap_var
+  bool tainted;    ///< the rc did something a snapshot cannot replay
+} t_snap_rec;
+
+/**
+ * @brief replays the snapshot of rc_path if it is still valid
+ * @param shell pointer to shell struct
+ * @param rc_path rc file about to be run
+ * @return 0 if the snapshot was applied and the rc must not run, -1
+ * otherwise; with MSH_SNAPSHOT set, recording then starts in shell->snap_rec.
+ */
+int snapshot_load(t_shell *shell, const char *rc_path);
+
+/**
+ * @brief marks the recording tainted unless root only declares state
+ * @param shell pointer to shell struct
+ * @param root unit about to run
+ */
+void snapshot_check(t_shell *shell, const t_ast_n *root);
+
+/**
+ * @brief ends the recording, writing the snapshot if the rc stayed pure
+ * @param shell pointer to shell struct
+ *
+ * @note no-op when nothing is being recorded.
+ */
+void snapshot_store(t_shell *shell);
+
+#endif // ! SNAPSHOT_H
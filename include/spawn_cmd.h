@@ -0,0 +1,60 @@
+#ifndef SPAWN_CMD_H
+#define SPAWN_CMD_H
+
+#include "shell.h"
+#include <spawn.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * @file spawn_cmd.h
+ *
+ * This module declares the posix_spawn based launch path for external
+ * commands. glibc implements posix_spawn with clone(CLONE_VM|CLONE_VFORK), so
+ * the shell's page tables are never copied for a plain command launch.
+ */
+
+/**
+ * @typedef struct s_spawn_io t_spawn_io
+ * @brief fd wiring replayed in the spawned child before exec.
+ *
+ * in_fd/out_fd are dup'd onto stdin/stdout (-1 for none), every fd in pipes
+ * is closed afterwards, then the redirections of redir_node (if any) are
+ * applied in order.
+ */
+typedef struct s_spawn_io {
+  int in_fd;
+  int out_fd;
+  int (*pipes)[2];
+  int pipes_len;
+  t_ast_n *redir_node;
+} t_spawn_io;
+
+/**
+ * @brief resolves a command name to an executable path
+ * @param shell pointer to shell struct
+ * @param name command name, returned as is when it contains a '/'
+ * @return path on success, NULL if not found in PATH
+ *
+ * Names without a '/' go through path_lookup.
+ */
+const char *resolve_cmd_path(t_shell *shell, const char *name);
+
+/**
+ * @brief spawns an external command without forking the shell
+ * @param shell pointer to shell struct
+ * @param job job the process joins (process group)
+ * @param path resolved executable path
+ * @param argv NULL terminated argv
+ * @param io fd wiring for the child, NULL to inherit the shell's fds
+ * @return pid of the child on success, -1 on failure with errno set.
+ *
+ * Process group joining and the child signal reset done by init_ch_sigtable
+ * in forked children are expressed through spawn attributes instead.
+ *
+ * @note callers fall back to fork on -1 so error reporting stays the same.
+ */
+pid_t spawn_cmd(t_shell *shell, t_job *job, const char *path, char **argv,
+                const t_spawn_io *io);
+
+#endif // ! SPAWN_CMD_H
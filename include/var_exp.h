@@ -112,10 +112,59 @@ void strip_quotes(char *str);
 
 int add_to_env(t_shell *shell, const char *var, const char *val, bool local,
                size_t depth);
+
+/**
+ * @brief assigns an integer without building its text
+ * @param shell pointer to shell struct
+ * @param var variable name
+ * @param v value
+ * @param local true if function local
+ * @param depth function depth of local
+ * @return 0 on success, -1 on fail (readonly, alloc).
+ *
+ * The decimal string is produced by env_val the first time the variable is
+ * read as text; exported variables are rebuilt right away for envp.
+ */
+int add_to_env_int(t_shell *shell, const char *var, long long v, bool local,
+                   size_t depth);
+
+/**
+ * @brief returns the text value of entry, building it from vint if stale
+ * @param entry pointer to env entry
+ * @return value, NULL if unset or on alloc fail.
+ */
+char *env_val(t_env_entry *entry);
+
 char *getenv_local(t_hashtable *env, const char *var_name, t_arena *a);
 const char *getenv_local_ref(t_hashtable *env, const char *var_name);
-char **flatten_env(t_hashtable *env, t_arena *a);
-void remove_from_env(t_hashtable *env, const char *var_name);
+
+/**
+ * @brief looks a variable up by a name slice, borrowing its value
+ * @param env env table
+ * @param name start of the name, need not be NUL terminated
+ * @param name_len length of the name
+ * @param val_len out: length of the value, may be NULL
+ * @return value owned by the entry, NULL if unset; valid until the variable
+ * is next assigned or unset.
+ */
+const char *getenv_local_ref_n(t_hashtable *env, const char *name,
+                               size_t name_len, size_t *val_len);
+/**
+ * @brief returns the cached exported environment
+ * @param shell pointer to shell struct
+ * @return NULL terminated envp, owned by shell; valid until env changes.
+ */
+char **get_envp(t_shell *shell);
+
+/**
+ * @brief patches the envp slot of entry after its value or flags changed
+ * @param shell pointer to shell struct
+ * @param entry pointer to env entry
+ * @return 0 on success, -1 on alloc fail.
+ */
+int envp_sync(t_shell *shell, t_env_entry *entry);
+
+void remove_from_env(t_shell *shell, const char *var_name);
 void print_env(t_hashtable *env, bool exported_only, bool local_only);
 
 /**
@@ -163,10 +212,47 @@ t_err_type expand_var(t_shell *shell, char **buf, size_t *buf_cap,
 t_err_type expand_make_argv(t_shell *shell, char ***argv, t_token *start,
                             const size_t segment_len, t_arena *a);
 
+/**
+ * @brief expand_make_argv for the tokens of a simple command node
+ * @param shell pointer to shell struct
+ * @param argv out: NULL terminated argv
+ * @param node simple command node
+ * @param a arena the argv is allocated in
+ * @param literal_cmd out (nullable): true if argv[0] is a cached literal word
+ * @return err_none on success, expansion error otherwise.
+ *
+ * Leading words with no expansion syntax are measured once and cached on the
+ * node, they are copied into argv as is and only the remaining tokens go
+ * through expand_make_argv. Loop bodies re-run the same nodes every
+ * iteration, so they skip the expansion pipeline for their literal words.
+ */
+t_err_type expand_node_argv(t_shell *shell, char ***argv, t_ast_n *node,
+                            t_arena *a, bool *literal_cmd);
+
+/**
+ * @brief finds the word expand_node_argv will produce as argv[0] verbatim
+ * @param shell pointer to shell struct
+ * @param node simple command node
+ * @return token of the command word, NULL if argv[0] needs expansion.
+ */
+const t_token *literal_cmd_word(t_shell *shell, t_ast_n *node);
+
 t_err_type make_buf(t_shell *shell, t_token *start, size_t segment_len,
                     t_arena *a, char **buf, size_t *buf_cap, bool hd);
 
 t_err_type expand_into_buf(t_shell *shell, const char *src, t_arena *a,
                            char **buf, size_t *buf_cap);
 
+/**
+ * @brief splits an expanded buffer into fields on IFS, in place
+ * @param shell pointer to shell struct
+ * @param buf expanded text, NUL terminated, separators become NULs
+ * @param k strlen(buf)
+ * @param argv out: NULL terminated fields pointing into buf
+ * @param a arena argv is allocated in
+ * @return err_none, err_fatal if argv cannot be allocated.
+ */
+t_err_type split_ifs(t_shell *shell, char *buf, size_t k, char ***argv,
+                     t_arena *a);
+
 #endif // ! VAR_EXP_H
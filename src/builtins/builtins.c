@@ -7,10 +7,13 @@
 #include "executor.h"
 #include "job_handler.h"
 #include "jobs.h"
+#include "path_cache.h"
 #include "shell.h"
 #include "shell_init.h"
+#include "sig_events.h"
 #include "sigstruct.h"
 #include "sigtable_init.h"
+#include "spawn_cmd.h"
 #include "var_exp.h"
 #include <linux/limits.h>
 #include <stdlib.h>
@@ -25,7 +28,7 @@ static void check_rehash(t_shell *shell, const char *var_name) {
       shell->path_len = 0;
     }
 
-    refresh_path_bins(shell);
+    path_cache_reset(shell);
   }
 }
 
@@ -86,7 +89,7 @@ static int update_no_noti_jobs(t_shell *shell) {
     }
 
     if (job && is_job_completed(job) && job->position == P_BACKGROUND) {
-      job->state = S_COMPLETED;
+      mark_job_completed(shell, job);
     } else if (job && is_job_stopped(job)) {
       job->state = S_STOPPED;
       job->position = P_BACKGROUND;
@@ -493,7 +496,7 @@ int shift_builtin(t_ast_n *node, t_shell *shell, char **argv) {
     n = (int)val;
   }
 
-  if (argv[2]) {
+  if (argv[1] && argv[2]) {
     fprintf(stderr, "shift: too many arguments\n");
     return 1;
   }
@@ -536,11 +539,14 @@ static int set_var_flags(t_shell *shell, char **argv, unsigned char flags) {
     t_ht_node *nd = ht_find(&shell->env, var_name);
     if (nd) {
       t_env_entry *entry = (t_env_entry *)nd->value;
-      size_t val_len = strlen(entry->val);
+      const char *val = env_val(entry);
+      if (!val)
+        return -1;
+      size_t val_len = strlen(val);
       var_val = arena_alloc(&shell->arena, val_len + 1);
       if (!var_val)
         return -1;
-      memcpy(var_val, entry->val, val_len + 1);
+      memcpy(var_val, val, val_len + 1);
 
       entry->flags = flags;
     } else {
@@ -571,6 +577,7 @@ static int set_var_flags(t_shell *shell, char **argv, unsigned char flags) {
   if (n) {
     t_env_entry *e = (t_env_entry *)n->value;
     e->flags |= flags;
+    envp_sync(shell, e);
   }
 
   check_rehash(shell, var_name);
@@ -623,7 +630,7 @@ int eval_builtin(t_ast_n *node, t_shell *shell, char **argv) {
 
   t_token_stream vs;
   t_err_code err;
-  parse_and_execute(&buf, shell, &vs, shell->script_fstream != NULL, &err);
+  parse_and_execute(&buf, shell, &vs, shell->script_src != NULL, &err);
 
   return 0;
 }
@@ -1074,15 +1081,12 @@ int command_builtin(t_ast_n *node, t_shell *shell, char **argv) {
     return status;
   }
 
-  char **env = flatten_env(&shell->env, &shell->arena);
+  char **env = get_envp(shell);
+  // resolved before the fork, so the lookup stays cached in the shell
+  const char *path = resolve_cmd_path(shell, argv[0]);
   if (ctx->pipeline || ctx->is_subshell) {
-    if (strchr(argv[0], '/')) {
-      execve(argv[0], argv, env);
-    } else {
-      t_ht_node *bin = ht_find(&shell->bins, argv[0]);
-      if (bin)
-        execve(bin->value, argv, env);
-    }
+    if (path)
+      execve(path, argv, env);
 
     fprintf(stderr, "msh: command \"%s\" not found\n", argv[0]);
     _exit(127);
@@ -1097,13 +1101,8 @@ int command_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   if (pid == 0) {
     init_ch_sigtable(&shell->shell_sigtable);
 
-    if (strchr(argv[0], '/')) {
-      execve(argv[0], argv, env);
-    } else {
-      t_ht_node *bin = ht_find(&shell->bins, argv[0]);
-      if (bin)
-        execve(bin->value, argv, env);
-    }
+    if (path)
+      execve(path, argv, env);
 
     fprintf(stderr, "msh: command \"%s\" not found\n", argv[0]);
     _exit(127);
@@ -1141,49 +1140,15 @@ int set_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   return 0;
 }
 
-int test_builtin(t_ast_n *node, t_shell *shell, char **argv) {
-  int argc = 0;
-  while (argv[argc])
-    argc++;
-
-  if (argc < 2 || *(argv[argc - 1]) != ']') {
-    fprintf(stderr, "msh: expected ']'\n");
-    return 2;
-  }
-
-  if (argc == 2)
-    return 1;
-  if (argc == 3)
-    return (argv[1] && strlen(argv[1]) > 0) ? 0 : 1;
-
-  if (argc == 5) {
-    char *left = argv[1];
-    char *op = argv[2];
-    char *right = argv[3];
-
-    int val1 = atoi(left);
-    int val2 = atoi(right);
-
-    if (strcmp(op, "-lt") == 0)
-      return (val1 < val2) ? 0 : 1;
-    if (strcmp(op, "-gt") == 0)
-      return (val1 > val2) ? 0 : 1;
-    if (strcmp(op, "-eq") == 0)
-      return (val1 == val2) ? 0 : 1;
-    if (strcmp(op, "-ne") == 0)
-      return val1 != val2 ? 0 : 1;
-    if (strcmp(op, "-le") == 0)
-      return (val1 <= val2) ? 0 : 1;
-    if (strcmp(op, "-ge") == 0)
-      return (val1 >= val2) ? 0 : 1;
-    if (strcmp(op, "=") == 0)
-      return (strcmp(left, right) == 0) ? 0 : 1;
-    if (strcmp(op, "!=") == 0)
-      return (strcmp(left, right) != 0) ? 0 : 1;
-  }
-
-  fprintf(stderr, "msh: test: too many arguments or unknown operator\n");
-  return 2;
+/** @brief returns the flag behind a shopt name, NULL if unknown */
+static bool *shopt_ref(t_shell *shell, const char *name) {
+  if (strcmp(name, "autosuggest") == 0)
+    return &shell->shopts.render_autosgst;
+  if (strcmp(name, "statcache") == 0)
+    return &shell->shopts.test_statcache;
+  if (strcmp(name, "globstar") == 0)
+    return &shell->shopts.globstar;
+  return NULL;
 }
 
 int shopt_builtin(t_ast_n *node, t_shell *shell, char **argv) {
@@ -1192,38 +1157,28 @@ int shopt_builtin(t_ast_n *node, t_shell *shell, char **argv) {
     return 1;
   }
 
-  if (strcmp(argv[1], "-s") == 0) {
-
+  bool set = strcmp(argv[1], "-s") == 0;
+  if (set || strcmp(argv[1], "-u") == 0) {
     if (argv[2] == NULL) {
       fprintf(stderr, "shopt: missing option\n");
       return 1;
     }
 
-    if (strcmp(argv[2], "autosuggest") == 0)
-      shell->shopts.render_autosgst = true;
-    else {
-      fprintf(stderr, "shopt: unknown option\n");
-      return 1;
-    }
-  } else if (strcmp(argv[1], "-u") == 0) {
-    if (argv[2] == NULL) {
-      fprintf(stderr, "shopt: missing option\n");
-      return 1;
-    }
-    if (strcmp(argv[2], "autosuggest") == 0)
-      shell->shopts.render_autosgst = false;
-    else {
+    bool *opt = shopt_ref(shell, argv[2]);
+    if (!opt) {
       fprintf(stderr, "shopt: unknown option\n");
       return 1;
     }
+    *opt = set;
+    if (opt == &shell->shopts.test_statcache)
+      stat_cache_clear(&shell->stat_cache);
   } else {
-    if (strcmp(argv[1], "autosuggest") == 0) {
-      shell->shopts.render_autosgst ? printf("autosuggest     on")
-                                    : printf("autosuggest     off");
-    } else {
+    bool *opt = shopt_ref(shell, argv[1]);
+    if (!opt) {
       fprintf(stderr, "shopt: unknown option\n");
       return 1;
     }
+    printf("%-16s%s", argv[1], *opt ? "on" : "off");
   }
 
   return 0;
@@ -1295,7 +1250,7 @@ int kill_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   if (signum == SIGKILL || signum == SIGTERM || signum == SIGHUP ||
       signum == SIGINT) {
     printf("[%d] Killed - %d\n", job_id, target);
-    job->state = S_COMPLETED;
+    mark_job_completed(shell, job);
   } else if (signum == SIGSTOP || signum == SIGTSTP || signum == SIGTTIN ||
              signum == SIGTTOU) {
     job->state = S_STOPPED;
@@ -1333,9 +1288,9 @@ int type_builtin(t_ast_n *node, t_shell *shell, char **argv) {
       continue;
     }
 
-    t_ht_node *path_node = ht_find(&shell->bins, name);
-    if (path_node && path_node->value) {
-      printf("%s is %s\n", name, (char *)path_node->value);
+    const char *path = path_lookup(shell, name);
+    if (path) {
+      printf("%s is %s\n", name, path);
       continue;
     }
 
@@ -1357,7 +1312,7 @@ int unset_builtin(t_ast_n *node, t_shell *shell, char **argv) {
     return -1;
   }
 
-  remove_from_env(&shell->env, argv[1]);
+  remove_from_env(shell, argv[1]);
 
   check_rehash(shell, argv[1]);
   return 0;
@@ -1425,8 +1380,23 @@ int wait_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   int status;
   pid_t pid;
   int had_children = 0;
+
+  struct sigaction old_chld;
+  int caught = sig_events_catch(SIGCHLD, &old_chld);
+  // without a handler nothing would wake the event wait, block in waitpid
+  int wopts = caught == -1 ? 0 : WNOHANG;
   while (1) {
-    pid = waitpid(-1, &status, 0);
+    pid = waitpid(-1, &status, wopts);
+    if (pid == 0) {
+      // children left, none changed state: sleep until the next signal
+      if (!sigs[SIGCHLD] && sig_events_wait(-1, -1) == -1)
+        break;
+      sigs[SIGCHLD] = 0;
+      if (sigs[SIGINT])
+        break;
+      check_trap(shell);
+      continue;
+    }
     if (pid < 0) {
       if (errno == EINTR) {
         if (sigs[SIGINT])
@@ -1436,8 +1406,10 @@ int wait_builtin(t_ast_n *node, t_shell *shell, char **argv) {
       break;
     }
     if (shell->job_control_flag) {
-      t_job *job = find_job_by_pid(shell, pid);
-      t_process *proc = find_process_in_job(job, pid);
+      t_process *proc = find_process_by_pid(shell, pid);
+      if (!proc)
+        continue;
+      t_job *job = proc->job;
       if (WIFEXITED(status) || WIFSIGNALED(status)) {
         proc->completed = 1;
         proc->stopped = 0;
@@ -1445,15 +1417,17 @@ int wait_builtin(t_ast_n *node, t_shell *shell, char **argv) {
       }
 
       if (is_job_completed(job)) {
-        job->state = S_COMPLETED;
+        mark_job_completed(shell, job);
         print_job_info(job);
         if (job->depth > 0)
-          del_local_depth(job->depth, &shell->env);
+          del_local_depth(job->depth, shell);
       }
     } else {
       shell->last_exit_status = WEXITSTATUS(status);
     }
   }
+  if (caught == 1)
+    sigaction(SIGCHLD, &old_chld, NULL);
   (void)node;
   (void)argv;
 
@@ -1481,7 +1455,9 @@ int times_builtin(t_ast_n *node, t_shell *shell, char **argv) {
 }
 
 static void print_hash(const char *key, void *value) {
-  printf("%s=%s\n", key, (char *)value);
+  t_bin *b = value;
+  if (b->found)
+    printf("%s=%s\n", key, b->path);
 }
 int hash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   (void)node;
@@ -1492,8 +1468,7 @@ int hash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   }
 
   if (strcmp(argv[1], "-r") == 0) {
-    ht_flush(&shell->bins, free);
-    refresh_path_bins(shell);
+    path_cache_reset(shell);
     return (0);
   }
 
@@ -1501,15 +1476,15 @@ int hash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
     int status = 0;
 
     for (int i = 2; argv[i]; i++) {
-      t_ht_node *n = ht_find(&shell->bins, argv[i]);
+      const char *path = path_lookup(shell, argv[i]);
 
-      if (!n) {
+      if (!path) {
         fprintf(stderr, "hash: %s: not found\n", argv[i]);
         status = 1;
         continue;
       }
 
-      printf("%s\n", (char *)n->value);
+      printf("%s\n", path);
     }
 
     return status;
@@ -1523,6 +1498,7 @@ int hash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
         fprintf(stderr, "hash: %s: not found\n", argv[i]);
         status = 1;
       }
+      shell->cmd_gen++;
     }
 
     return status;
@@ -1530,7 +1506,7 @@ int hash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
 
   int status = 0;
   for (int i = 1; argv[i]; i++) {
-    if (!ht_find(&shell->bins, argv[i])) {
+    if (!path_lookup(shell, argv[i])) {
       fprintf(stderr, "hash: %s: not found\n", argv[i]);
       status = 1;
     }
@@ -1540,7 +1516,7 @@ int hash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
 }
 
 int rehash_builtin(t_ast_n *node, t_shell *shell, char **argv) {
-  refresh_path_bins(shell);
+  path_cache_reset(shell);
   return 0;
 }
 
@@ -1585,6 +1561,7 @@ int alias_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   size_t alias_len = strlen(argv[1]) - eq_idx - 1;
   char *aliased_cmd = strndup(argv[1] + eq_idx + 1, alias_len);
   t_ht_node *n = insert_alias(&(shell->aliases), alias, aliased_cmd);
+  shell->cmd_gen++;
   free(aliased_cmd);
   free(alias);
   if (!n) {
@@ -1607,6 +1584,7 @@ int unalias_builtin(t_ast_n *node, t_shell *shell, char **argv) {
     printf("\nmsh: unalias <alias>");
     return 0;
   }
+  shell->cmd_gen++;
   if (strcmp(argv[1], "all") == 0) {
     ht_flush(&shell->aliases, free_alias);
     return 0;
@@ -1680,6 +1658,7 @@ int env_builtin(t_ast_n *node, t_shell *shell, char **argv) {
  */
 int history_builtin(t_ast_n *node, t_shell *shell, char **argv) {
 
+  history_load(shell);
   if (shell->history.size == 0) {
     return 0;
   }
@@ -1709,70 +1688,64 @@ int exec_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   if (argv[1] == NULL)
     return -1;
 
-  t_ht_node *bin_node = ht_find(&shell->bins, argv[1]);
-  char **env = flatten_env(&shell->env, &shell->arena);
+  const char *path = resolve_cmd_path(shell, argv[1]);
+  char **env = get_envp(shell);
 
-  if (bin_node) {
-    execve((char *)bin_node->value, argvv, env);
-  } else if (strchr(argv[1], '/')) {
-    execve(argv[1], argvv, env);
-  }
+  if (path)
+    execve(path, argvv, env);
 
   _exit(127);
 }
 
-static char *append_script_line(char *old_buf, const char *new_line,
-                                t_arena *a) {
-  size_t old_len = old_buf ? strlen(old_buf) : 0;
-  size_t new_len = strlen(new_line);
-
-  char *new_buf = arena_realloc(a, old_buf, old_len + new_len + 1, old_len);
-
-  memcpy(new_buf + old_len, new_line, new_len + 1);
-  return new_buf;
-}
 int source_builtin(t_ast_n *node, t_shell *shell, char **argv) {
   if (argv[1] == NULL) {
     fprintf(stderr, "msh: source: filename argument required\n");
     return -1;
   }
 
-  FILE *script = fopen(argv[1], "r");
-  if (!script) {
+  t_script_src src;
+  if (script_src_open(&src, argv[1]) == -1) {
     perror("msh: source");
     return -1;
   }
 
-  char *line = NULL;
-  size_t cap = 0;
-  char *total_buf = NULL;
+  const char *line;
+  size_t line_len;
+  t_unit_buf unit = {0};
 
   t_region *p_mark;
   size_t off_mark;
+  t_region *try_mark;
+  size_t try_off;
 
-  while (getline(&line, &cap, script) != -1) {
-    char *p = line;
-    while (*p && isspace((unsigned char)*p))
+  while ((line = script_src_line(&src, &line_len)) != NULL) {
+    const char *p = line;
+    while (p < line + line_len && isspace((unsigned char)*p))
       p++;
-    if (*p == '#' || *p == '\0')
+    if (p == line + line_len || *p == '#')
       continue;
-    arena_get_mark(&shell->arena, &p_mark, &off_mark);
+    if (!unit.data)
+      arena_get_mark(&shell->arena, &p_mark, &off_mark);
 
-    total_buf = append_script_line(total_buf, line, &shell->arena);
+    if (unit_buf_append(&unit, line, line_len, &shell->arena) == -1)
+      break;
     t_err_code last_err;
-    if (parse_and_execute(&total_buf, shell, &shell->token_stream, true,
-                          &last_err) == 0) {
-      total_buf = NULL;
+    if (!unit_buf_lex(&unit, &shell->arena, &last_err))
+      continue;
+    arena_get_mark(&shell->arena, &try_mark, &try_off);
+    if (exec_unit(shell, &unit, true, &last_err) == 0) {
+      unit = (t_unit_buf){0};
       arena_rollback(&shell->arena, p_mark, off_mark);
+    } else {
+      arena_rollback(&shell->arena, try_mark, try_off);
     }
   }
 
-  if (total_buf != NULL) {
+  if (unit.data != NULL) {
     fprintf(stderr, "msh: source: unexpected EOF\n");
   }
 
-  free(line);
-  fclose(script);
+  script_src_close(&src);
   return 0;
 }
 
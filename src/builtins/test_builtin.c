@@ -0,0 +1,373 @@
+/**
+ * @file test_builtin.c
+ * @brief Implementation of the test and [ builtins
+ *
+ * Follows the POSIX argument-count rules for up to four operands and parses
+ * longer expressions with ! ( ) -a -o precedence. Integers are 64-bit; file
+ * predicates stat through the shell's stat cache.
+ */
+
+#include "builtins.h"
+#include <limits.h>
+
+/**
+ * @typedef struct s_test_ctx t_test_ctx
+ * @brief operands of one test command and the parse position in them.
+ */
+typedef struct s_test_ctx {
+  t_shell *shell;
+  const char *name; ///< "test" or "[", for messages
+  char **argv;
+  int pos;
+  int end;
+  bool err; ///< set once a message was printed, the command returns 2
+} t_test_ctx;
+
+static bool test_or(t_test_ctx *t);
+
+static bool test_error(t_test_ctx *t, const char *arg, const char *msg) {
+  if (!t->err) {
+    if (arg)
+      fprintf(stderr, "msh: %s: %s: %s\n", t->name, arg, msg);
+    else
+      fprintf(stderr, "msh: %s: %s\n", t->name, msg);
+  }
+  t->err = true;
+  return false;
+}
+
+void stat_cache_clear(t_stat_cache *cache) {
+  for (size_t i = 0; i < cache->len; i++) {
+    free(cache->slots[i].path);
+    cache->slots[i].path = NULL;
+  }
+  cache->len = 0;
+  cache->next = 0;
+}
+
+/**
+ * @brief stat or lstat path, answered from the stat cache when it holds it
+ * @return 0 success, -1 with errno set on fail.
+ */
+static int test_stat(t_test_ctx *t, const char *path, bool nofollow,
+                     struct stat *st) {
+  t_stat_cache *c = &t->shell->stat_cache;
+  if (!t->shell->shopts.test_statcache)
+    return nofollow ? lstat(path, st) : stat(path, st);
+
+  for (size_t i = 0; i < c->len; i++) {
+    t_stat_slot *s = &c->slots[i];
+    if (s->nofollow == nofollow && strcmp(s->path, path) == 0) {
+      if (s->err) {
+        errno = s->err;
+        return -1;
+      }
+      *st = s->st;
+      return 0;
+    }
+  }
+
+  int ret = nofollow ? lstat(path, st) : stat(path, st);
+  int err = ret == -1 ? errno : 0;
+  char *dup = strdup(path);
+  if (!dup) {
+    errno = err;
+    return ret;
+  }
+
+  size_t i = c->len;
+  if (c->len < STAT_CACHE_SLOTS) {
+    c->len++;
+  } else {
+    i = c->next;
+    c->next = (c->next + 1) % STAT_CACHE_SLOTS;
+    free(c->slots[i].path);
+  }
+  c->slots[i].path = dup;
+  c->slots[i].nofollow = nofollow;
+  c->slots[i].err = err;
+  if (!err)
+    c->slots[i].st = *st;
+
+  errno = err;
+  return ret;
+}
+
+/** @brief parses a 64-bit integer operand, blanks around it allowed */
+static bool test_int(t_test_ctx *t, const char *s, long long *out) {
+  char *end;
+  errno = 0;
+  long long v = strtoll(s, &end, 10);
+  const char *p = s;
+  while (isspace((unsigned char)*p))
+    p++;
+  while (isspace((unsigned char)*end))
+    end++;
+  if (end == p || *end != '\0')
+    return test_error(t, s, "integer expression expected");
+  if (errno == ERANGE)
+    return test_error(t, s, "integer out of range");
+  *out = v;
+  return true;
+}
+
+static bool is_unary_op(const char *s) {
+  return s[0] == '-' && s[1] && !s[2] && strchr("bcdefghknprstuwxzGLOS", s[1]);
+}
+
+/** @brief binary primaries, -a and -o are connectives and handled apart */
+static bool is_binary_op(const char *s) {
+  static const char *const ops[] = {"=",   "==",  "!=",  "<",   ">",
+                                    "-eq", "-ne", "-lt", "-le", "-gt",
+                                    "-ge", "-nt", "-ot", "-ef", NULL};
+  for (size_t i = 0; ops[i]; i++) {
+    if (strcmp(s, ops[i]) == 0)
+      return true;
+  }
+  return false;
+}
+
+static bool test_unary(t_test_ctx *t, char op, const char *arg) {
+  struct stat st;
+
+  switch (op) {
+  case 'n':
+    return arg[0] != '\0';
+  case 'z':
+    return arg[0] == '\0';
+  case 't': {
+    long long fd;
+    if (!test_int(t, arg, &fd))
+      return false;
+    return fd >= 0 && fd <= INT_MAX && isatty((int)fd);
+  }
+  case 'r':
+    return access(arg, R_OK) == 0;
+  case 'w':
+    return access(arg, W_OK) == 0;
+  case 'x':
+    return access(arg, X_OK) == 0;
+  case 'h':
+  case 'L':
+    return test_stat(t, arg, true, &st) == 0 && S_ISLNK(st.st_mode);
+  }
+
+  if (test_stat(t, arg, false, &st) == -1)
+    return false;
+
+  switch (op) {
+  case 'b':
+    return S_ISBLK(st.st_mode);
+  case 'c':
+    return S_ISCHR(st.st_mode);
+  case 'd':
+    return S_ISDIR(st.st_mode);
+  case 'e':
+    return true;
+  case 'f':
+    return S_ISREG(st.st_mode);
+  case 'g':
+    return st.st_mode & S_ISGID;
+  case 'k':
+    return st.st_mode & S_ISVTX;
+  case 'p':
+    return S_ISFIFO(st.st_mode);
+  case 's':
+    return st.st_size > 0;
+  case 'S':
+    return S_ISSOCK(st.st_mode);
+  case 'u':
+    return st.st_mode & S_ISUID;
+  case 'G':
+    return st.st_gid == getegid();
+  case 'O':
+    return st.st_uid == geteuid();
+  }
+  return false;
+}
+
+/** @brief -nt / -ot: a missing file is older than any existing one */
+static bool test_newer(t_test_ctx *t, const char *l, const char *r) {
+  struct stat sl, sr;
+  if (test_stat(t, l, false, &sl) == -1)
+    return false;
+  if (test_stat(t, r, false, &sr) == -1)
+    return true;
+  if (sl.st_mtim.tv_sec != sr.st_mtim.tv_sec)
+    return sl.st_mtim.tv_sec > sr.st_mtim.tv_sec;
+  return sl.st_mtim.tv_nsec > sr.st_mtim.tv_nsec;
+}
+
+static bool test_binary(t_test_ctx *t, const char *l, const char *op,
+                        const char *r) {
+  if (op[0] != '-') {
+    int cmp = strcmp(l, r);
+    if (op[0] == '=')
+      return cmp == 0;
+    if (op[0] == '!')
+      return cmp != 0;
+    return op[0] == '<' ? cmp < 0 : cmp > 0;
+  }
+
+  if (strcmp(op, "-nt") == 0)
+    return test_newer(t, l, r);
+  if (strcmp(op, "-ot") == 0)
+    return test_newer(t, r, l);
+  if (strcmp(op, "-ef") == 0) {
+    struct stat sl, sr;
+    return test_stat(t, l, false, &sl) == 0 &&
+           test_stat(t, r, false, &sr) == 0 && sl.st_dev == sr.st_dev &&
+           sl.st_ino == sr.st_ino;
+  }
+  if (strcmp(op, "-a") == 0)
+    return l[0] != '\0' && r[0] != '\0';
+  if (strcmp(op, "-o") == 0)
+    return l[0] != '\0' || r[0] != '\0';
+
+  long long a, b;
+  if (!test_int(t, l, &a) || !test_int(t, r, &b))
+    return false;
+  if (strcmp(op, "-eq") == 0)
+    return a == b;
+  if (strcmp(op, "-ne") == 0)
+    return a != b;
+  if (strcmp(op, "-lt") == 0)
+    return a < b;
+  if (strcmp(op, "-le") == 0)
+    return a <= b;
+  if (strcmp(op, "-gt") == 0)
+    return a > b;
+  return a >= b;
+}
+
+static bool test_primary(t_test_ctx *t) {
+  if (t->pos >= t->end)
+    return test_error(t, NULL, "argument expected");
+
+  char **a = t->argv + t->pos;
+  int left = t->end - t->pos;
+
+  if (strcmp(a[0], "!") == 0) {
+    t->pos++;
+    return !test_primary(t);
+  }
+  if (left >= 3 && is_binary_op(a[1])) {
+    t->pos += 3;
+    return test_binary(t, a[0], a[1], a[2]);
+  }
+  if (strcmp(a[0], "(") == 0 && left >= 2) {
+    t->pos++;
+    bool r = test_or(t);
+    if (t->pos >= t->end || strcmp(t->argv[t->pos], ")") != 0)
+      return test_error(t, NULL, "')' expected");
+    t->pos++;
+    return r;
+  }
+  if (is_unary_op(a[0]) && left >= 2) {
+    t->pos += 2;
+    return test_unary(t, a[0][1], a[1]);
+  }
+  t->pos++;
+  return a[0][0] != '\0';
+}
+
+static bool test_and(t_test_ctx *t) {
+  bool r = test_primary(t);
+  while (t->pos < t->end && strcmp(t->argv[t->pos], "-a") == 0) {
+    t->pos++;
+    bool rhs = test_primary(t);
+    r = r && rhs;
+  }
+  return r;
+}
+
+static bool test_or(t_test_ctx *t) {
+  bool r = test_and(t);
+  while (t->pos < t->end && strcmp(t->argv[t->pos], "-o") == 0) {
+    t->pos++;
+    bool rhs = test_and(t);
+    r = r || rhs;
+  }
+  return r;
+}
+
+/**
+ * @brief evaluates argv[pos..end), by operand count as POSIX specifies for
+ * up to four operands, with the expression parser beyond that
+ */
+static bool test_eval(t_test_ctx *t) {
+  char **a = t->argv + t->pos;
+  int n = t->end - t->pos;
+
+  switch (n) {
+  case 0:
+    return false;
+  case 1:
+    t->pos++;
+    return a[0][0] != '\0';
+  case 2:
+    if (strcmp(a[0], "!") == 0) {
+      t->pos += 2;
+      return a[1][0] == '\0';
+    }
+    if (is_unary_op(a[0])) {
+      t->pos += 2;
+      return test_unary(t, a[0][1], a[1]);
+    }
+    return test_error(t, a[0], "unary operator expected");
+  case 3:
+    if (is_binary_op(a[1]) || strcmp(a[1], "-a") == 0 ||
+        strcmp(a[1], "-o") == 0) {
+      t->pos += 3;
+      return test_binary(t, a[0], a[1], a[2]);
+    }
+    if (strcmp(a[0], "!") == 0) {
+      t->pos++;
+      return !test_eval(t);
+    }
+    if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0) {
+      t->pos += 3;
+      return a[1][0] != '\0';
+    }
+    break;
+  case 4:
+    if (strcmp(a[0], "!") == 0) {
+      t->pos++;
+      return !test_eval(t);
+    }
+    if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0) {
+      t->pos++;
+      t->end--;
+      bool r = test_eval(t);
+      t->pos++;
+      t->end++;
+      return r;
+    }
+    break;
+  }
+
+  bool r = test_or(t);
+  if (!t->err && t->pos < t->end)
+    return test_error(t, t->argv[t->pos], "unexpected argument");
+  return r;
+}
+
+int test_builtin(t_ast_n *node, t_shell *shell, char **argv) {
+  int argc = 0;
+  while (argv[argc])
+    argc++;
+
+  t_test_ctx t = {shell, argv[0], argv, 1, argc, false};
+  if (strcmp(argv[0], "[") == 0) {
+    if (strcmp(argv[argc - 1], "]") != 0) {
+      fprintf(stderr, "msh: [: missing ']'\n");
+      return 2;
+    }
+    t.end--;
+  }
+
+  bool r = test_eval(&t);
+  if (t.err)
+    return 2;
+  return r ? 0 : 1;
+}
@@ -3,105 +3,198 @@
 #include <string.h>
 
 void ht_init(t_hashtable *ht) {
-  memset(ht->buckets, 0, sizeof(ht->buckets));
+  ht->slots = NULL;
+  ht->cap = 0;
   ht->count = 0;
 }
 
-unsigned ht_hash(const char *key) {
-  unsigned long h = 5381;
-  int c;
+#define HASH_SEED 5381u
 
-  while ((c = *key++))
-    h = ((h << 5) + h) + c;
-    
+/** @brief mixes the high bits down into the low ones used as the index */
+static uint32_t hash_final(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+/** @brief DJB2 over the full 32 bits, a shift-add step per byte */
+uint32_t ht_hash(const char *key, size_t len) {
+  uint32_t h = HASH_SEED;
 
-  return h % HT_DEFSIZE;
+  for (size_t i = 0; i < len; i++)
+    h = ((h << 5) + h) + (unsigned char)key[i];
+  return hash_final(h);
 }
 
-t_ht_node *ht_find(t_hashtable *ht, const char *key) {
-  unsigned idx = ht_hash(key);
-  t_ht_node *n = ht->buckets[idx];
+/** @brief ht_hash of a NUL terminated key, measuring it in the same pass */
+static uint32_t hash_str(const char *key, size_t *len) {
+  uint32_t h = HASH_SEED;
+  const char *p = key;
 
-  while (n) {
-    if (strcmp(n->key, key) == 0)
-      return n;
-    n = n->next;
+  for (; *p; p++)
+    h = ((h << 5) + h) + (unsigned char)*p;
+  *len = p - key;
+  return hash_final(h);
+}
+
+/** @brief how far the entry in slot i sits from its home slot */
+static size_t slot_dist(const t_hashtable *ht, size_t i) {
+  return (i - (ht->slots[i].hash & (ht->cap - 1))) & (ht->cap - 1);
+}
+
+/** @brief returns the slot index holding key, cap if absent */
+static size_t ht_lookup(const t_hashtable *ht, const char *key, size_t len,
+                        uint32_t h) {
+  if (ht->cap == 0)
+    return 0;
+
+  size_t mask = ht->cap - 1;
+  size_t i = h & mask;
+  for (size_t d = 0;; d++, i = (i + 1) & mask) {
+    const t_ht_slot *s = &ht->slots[i];
+    // robin hood: a richer entry means ours would have displaced it
+    if (!s->node || slot_dist(ht, i) < d)
+      return ht->cap;
+    if (s->hash == h && s->key_len == len &&
+        memcmp(s->node->key, key, len) == 0)
+      return i;
   }
-  return NULL;
+}
+
+/** @brief places a slot not yet in the table, displacing richer entries */
+static void ht_place(t_hashtable *ht, t_ht_slot in) {
+  size_t mask = ht->cap - 1;
+  size_t i = in.hash & mask;
+
+  for (size_t d = 0; ht->slots[i].node; d++, i = (i + 1) & mask) {
+    size_t sd = slot_dist(ht, i);
+    if (sd < d) {
+      t_ht_slot tmp = ht->slots[i];
+      ht->slots[i] = in;
+      in = tmp;
+      d = sd;
+    }
+  }
+  ht->slots[i] = in;
+}
+
+/** @brief doubles the slot array, hashes are cached so keys are not read */
+static int ht_grow(t_hashtable *ht) {
+  size_t old_cap = ht->cap;
+  t_ht_slot *old = ht->slots;
+  size_t cap = old_cap ? old_cap * 2 : HT_MIN_CAP;
+
+  t_ht_slot *slots = calloc(cap, sizeof(*slots));
+  if (!slots)
+    return -1;
+
+  ht->slots = slots;
+  ht->cap = cap;
+  for (size_t i = 0; i < old_cap; i++) {
+    if (old[i].node)
+      ht_place(ht, old[i]);
+  }
+  free(old);
+  return 0;
+}
+
+t_ht_node *ht_find_n(t_hashtable *ht, const char *key, size_t len) {
+  size_t i = ht_lookup(ht, key, len, ht_hash(key, len));
+  return i < ht->cap ? ht->slots[i].node : NULL;
+}
+
+t_ht_node *ht_find(t_hashtable *ht, const char *key) {
+  size_t len;
+  uint32_t h = hash_str(key, &len);
+  size_t i = ht_lookup(ht, key, len, h);
+  return i < ht->cap ? ht->slots[i].node : NULL;
 }
 
 t_ht_node *ht_insert(t_hashtable *ht, const char *key, void *value,
                      t_ht_free_fn freefn) {
-  unsigned idx = ht_hash(key);
-  t_ht_node *n = ht_find(ht, key);
-
-  if (n && freefn) {
-    freefn(n->value);
-    n->value = value;
-    return n;
-  } else if (n) {
+  size_t len;
+  uint32_t h = hash_str(key, &len);
+  size_t i = ht_lookup(ht, key, len, h);
+
+  if (i < ht->cap) {
+    t_ht_node *n = ht->slots[i].node;
+    if (freefn) {
+      freefn(n->value);
+      n->value = value;
+    }
     return n;
   }
 
-  n = malloc(sizeof(*n));
+  if ((ht->count + 1) * 4 > ht->cap * 3 && ht_grow(ht) == -1)
+    return NULL;
+
+  t_ht_node *n = malloc(sizeof(*n) + len + 1);
   if (!n)
     return NULL;
 
-  n->key = strdup(key);
+  memcpy(n->key, key, len + 1);
+  n->key_len = len;
   n->value = value;
-  n->next = ht->buckets[idx];
-  ht->buckets[idx] = n;
+  ht_place(ht, (t_ht_slot){.hash = h, .key_len = (uint32_t)len, .node = n});
   ht->count++;
 
   return n;
 }
 
 int ht_delete(t_hashtable *ht, const char *key, t_ht_free_fn free_fn) {
-  unsigned idx = ht_hash(key);
-  t_ht_node **cur = &ht->buckets[idx];
-
-  while (*cur) {
-    if (strcmp((*cur)->key, key) == 0) {
-      t_ht_node *tmp = *cur;
-      *cur = tmp->next;
-
-      if (free_fn)
-        free_fn(tmp->value);
-
-      free(tmp->key);
-      free(tmp);
-      ht->count--;
-      return 0;
-    }
-    cur = &(*cur)->next;
+  size_t len;
+  uint32_t h = hash_str(key, &len);
+  size_t i = ht_lookup(ht, key, len, h);
+  if (i >= ht->cap)
+    return -1;
+
+  t_ht_node *n = ht->slots[i].node;
+  if (free_fn)
+    free_fn(n->value);
+  free(n);
+
+  // backward shift: pull displaced successors one slot closer to home
+  size_t mask = ht->cap - 1;
+  size_t j = (i + 1) & mask;
+  while (ht->slots[j].node && slot_dist(ht, j) > 0) {
+    ht->slots[i] = ht->slots[j];
+    i = j;
+    j = (j + 1) & mask;
   }
-  return -1;
+  ht->slots[i] = (t_ht_slot){0};
+  ht->count--;
+  return 0;
 }
 
 int ht_flush(t_hashtable *ht, t_ht_free_fn free_fn) {
-  for (int i = 0; i < HT_DEFSIZE; i++) {
-    t_ht_node *n = ht->buckets[i];
-    while (n) {
-      t_ht_node *next = n->next;
-      if (free_fn)
-        free_fn(n->value);
-      free(n->key);
-      free(n);
-      n = next;
-    }
-    ht->buckets[i] = NULL;
+  for (size_t i = 0; i < ht->cap; i++) {
+    t_ht_node *n = ht->slots[i].node;
+    if (!n)
+      continue;
+    if (free_fn)
+      free_fn(n->value);
+    free(n);
+    ht->slots[i] = (t_ht_slot){0};
   }
   ht->count = 0;
   return 0;
 }
 
+t_ht_node *ht_next(t_hashtable *ht, size_t *it) {
+  while (*it < ht->cap) {
+    t_ht_node *n = ht->slots[(*it)++].node;
+    if (n)
+      return n;
+  }
+  return NULL;
+}
+
 void ht_print(t_hashtable *ht, t_ht_print_fn print_fn) {
-  for (int i = 0; i < HT_DEFSIZE; i++) {
-    t_ht_node *n = ht->buckets[i];
-    while (n) {
-      if (print_fn)
-        print_fn(n->key, n->value);
-      n = n->next;
-    }
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(ht, &it))) {
+    if (print_fn)
+      print_fn(n->key, n->value);
   }
 }
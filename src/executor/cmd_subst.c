@@ -0,0 +1,257 @@
+#include "cmd_subst.h"
+#include "builtins.h"
+#include "hashtable.h"
+#include "lexer.h"
+#include "memfd.h"
+#include "parser.h"
+#include "var_exp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @file cmd_subst.c
+ * @brief implementation of in-process command substitution.
+ */
+
+#define SUBST_FN_DEPTH 4
+
+static bool is_pure_builtin(t_builtin_func fn) {
+  return fn == echo_builtin || fn == printf_builtin || fn == true_builtin ||
+         fn == false_builtin || fn == test_builtin || fn == nop_builtin ||
+         fn == pwd_builtin;
+}
+
+/**
+ * @brief checks a token for expansions that act outside the substitution
+ *
+ * ${v:=w} assigns in the parent and $$ must be the pid of a subshell.
+ */
+static bool tok_leaks(const t_token *t) {
+  for (size_t i = 0; i + 1 < t->len; i++) {
+    if (t->start[i] == ':' && t->start[i + 1] == '=')
+      return true;
+    if (t->start[i] == '$' && t->start[i + 1] == '$')
+      return true;
+  }
+  return false;
+}
+
+static bool is_pure_list(t_shell *shell, t_ast_n *node, int depth);
+
+/**
+ * @brief checks that a simple command resolves to a pure builtin or to a
+ * function with a pure body
+ */
+static bool is_pure_simple(t_shell *shell, t_ast_n *node, int depth) {
+  if (node->redir_bool || node->io_redir)
+    return false;
+  for (size_t i = 0; i < node->tok_segment_len; i++) {
+    if (tok_leaks(&node->tok_start[i]))
+      return false;
+  }
+
+  const t_token *word = literal_cmd_word(shell, node);
+  if (!word)
+    return false;
+
+  t_ht_node *fn_node = ht_find_n(&shell->functions, word->start, word->len);
+  if (fn_node) {
+    const char *fun_nest = getenv_local_ref(&shell->env, "FUNCNEST");
+    int fnestmax = fun_nest ? atoi(fun_nest) : 10;
+    if (depth >= SUBST_FN_DEPTH ||
+        shell->exec_ctx.fnest_d + depth + 1 >= fnestmax)
+      return false;
+    return is_pure_list(shell, fn_node->value, depth + 1);
+  }
+
+  t_ht_node *builtin_node =
+      ht_find_n(&shell->builtins, word->start, word->len);
+  return builtin_node &&
+         is_pure_builtin(((t_builtin *)builtin_node->value)->fn);
+}
+
+static bool is_pure_list(t_shell *shell, t_ast_n *node, int depth) {
+  if (!node)
+    return true;
+  if (node->background)
+    return false;
+
+  switch (node->op_type) {
+  case OP_SIMPLE:
+    return is_pure_simple(shell, node, depth);
+  case OP_SEQ:
+  case OP_AND:
+  case OP_OR:
+    return is_pure_list(shell, node->left, depth) &&
+           is_pure_list(shell, node->right, depth);
+  case OP_IF:
+    return is_pure_list(shell, node->left, depth) &&
+           is_pure_list(shell, node->right, depth) &&
+           is_pure_list(shell, node->sub_ast_root, depth);
+  default:
+    return false;
+  }
+}
+
+static void run_list(t_shell *shell, t_ast_n *node);
+
+/**
+ * @brief mirrors exec_simple_command for a command accepted by is_pure_simple
+ */
+static void run_simple(t_shell *shell, t_ast_n *node) {
+  t_region *p = NULL;
+  size_t off = 0;
+  arena_get_mark(&shell->arena, &p, &off);
+
+  char **argv = NULL;
+  t_err_type err = expand_node_argv(shell, &argv, node, &shell->arena, NULL);
+  if (err == err_fatal) {
+    perror("fatal err expanding argv");
+    exit(1);
+  }
+  if (!argv || !argv[0]) {
+    arena_rollback(&shell->arena, p, off);
+    return;
+  }
+
+  t_ht_node *fn_node = ht_find(&shell->functions, argv[0]);
+  if (fn_node) {
+    char **curr_argv = shell->argv;
+    int curr_argc = shell->argc;
+    shell->argv = argv;
+    for (shell->argc = 0; argv[shell->argc]; shell->argc++)
+      ;
+    shell->exec_ctx.fnest_d++;
+
+    run_list(shell, fn_node->value);
+
+    shell->exec_ctx.fnest_d--;
+    shell->argv = curr_argv;
+    shell->argc = curr_argc;
+  } else {
+    t_ht_node *builtin_node = ht_find(&shell->builtins, argv[0]);
+    t_builtin *b = (t_builtin *)builtin_node->value;
+    shell->last_exit_status = b->fn(node, shell, argv);
+  }
+
+  arena_rollback(&shell->arena, p, off);
+}
+
+/**
+ * @brief mirrors exec_list for a list accepted by is_pure_list
+ */
+static void run_list(t_shell *shell, t_ast_n *node) {
+  if (!node)
+    return;
+
+  switch (node->op_type) {
+  case OP_SIMPLE:
+    run_simple(shell, node);
+    break;
+  case OP_SEQ:
+    run_list(shell, node->left);
+    run_list(shell, node->right);
+    break;
+  case OP_AND:
+    run_list(shell, node->left);
+    if (shell->last_exit_status == 0)
+      run_list(shell, node->right);
+    break;
+  case OP_OR:
+    run_list(shell, node->left);
+    if (shell->last_exit_status != 0)
+      run_list(shell, node->right);
+    break;
+  case OP_IF:
+    run_list(shell, node->left);
+    if (shell->last_exit_status == 0)
+      run_list(shell, node->right);
+    else
+      run_list(shell, node->sub_ast_root);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief appends everything written to fd to buf
+ */
+static void read_capture(int fd, t_arena *a, char **buf, size_t *buf_cap,
+                         size_t *k) {
+  if (lseek(fd, 0, SEEK_SET) == -1)
+    return;
+
+  while (1) {
+    if (*k + 4096 >= *buf_cap) {
+      size_t new_cap = *buf_cap * 2;
+      *buf = arena_realloc(a, *buf, new_cap, *buf_cap);
+      *buf_cap = new_cap;
+    }
+
+    ssize_t n = read(fd, *buf + *k, *buf_cap - *k - 1);
+    if (n <= 0)
+      break;
+
+    *k += n;
+  }
+}
+
+int subst_in_process(t_shell *shell, const char *cmd_line, t_arena *a,
+                     char **buf, size_t *buf_cap, size_t *k) {
+  // function definitions are never pure, and the parser reports malformed
+  // ones itself, which would print twice with the fork fallback
+  if (strstr(cmd_line, "()"))
+    return -1;
+
+  t_region *p = NULL;
+  size_t off = 0;
+  arena_get_mark(&shell->arena, &p, &off);
+
+  // the lexer may rewrite its buffer for aliases, the fork path needs the
+  // original text
+  size_t len = strlen(cmd_line);
+  char *line = arena_alloc(&shell->arena, len + 1);
+  memcpy(line, cmd_line, len + 1);
+
+  t_token_stream ts;
+  t_ast ast;
+  t_ast_n *root = NULL;
+  t_err_code last_err = -1;
+  init_token_stream(&ts, &shell->arena);
+  init_ast(&ast);
+  if (lex_command_line(&line, &ts, &shell->aliases, 0, &shell->arena, 0,
+                       &last_err) != -1)
+    root = build_ast(&ast, &ts, &shell->arena, &last_err);
+
+  int out_fd = -1;
+  int saved_fd = -1;
+  if (root && is_pure_list(shell, root, 0)) {
+    fflush(stdout);
+    out_fd = mem_fd_open("subst");
+    saved_fd = out_fd != -1 ? dup(STDOUT_FILENO) : -1;
+  }
+  if (saved_fd == -1) {
+    if (out_fd != -1)
+      close(out_fd);
+    arena_rollback(&shell->arena, p, off);
+    return -1;
+  }
+
+  dup2(out_fd, STDOUT_FILENO);
+  int saved_status = shell->last_exit_status;
+
+  run_list(shell, root);
+  fflush(stdout);
+
+  shell->last_exit_status = saved_status;
+  dup2(saved_fd, STDOUT_FILENO);
+  close(saved_fd);
+
+  arena_rollback(&shell->arena, p, off);
+  read_capture(out_fd, a, buf, buf_cap, k);
+  close(out_fd);
+  return 0;
+}
@@ -1,11 +1,18 @@
 #include "executor.h"
+#include "arith.h"
 #include "ast.h"
 #include "handle_io_redir.h"
 #include "hashtable.h"
 #include "jobs.h"
 #include "lexer.h"
+#include "path_cache.h"
+#include "script_cache.h"
 #include "shell.h"
 #include "shell_init.h"
+#include "sig_events.h"
+#include "snapshot.h"
+#include "spawn_cmd.h"
+#include <errno.h>
 #include <signal.h>
 
 #define DEFSIZE_PIDS 8
@@ -27,7 +34,7 @@ int check_trap(t_shell *shell) {
                          .pipeline = NULL,
                          .flow = false,
                          .fnest_d = 0,
-                         .script = (shell->script_fstream != NULL),
+                         .script = (shell->script_src != NULL),
                          .continue_loop = false,
                          .break_loop = false,
                          .return_fun = false,
@@ -40,7 +47,7 @@ int check_trap(t_shell *shell) {
         sigs[i] = 0;
       int stat =
           parse_and_execute(&shell->traps[i], shell, &shell->token_stream,
-                            shell->script_fstream != NULL, &last_err);
+                            shell->script_src != NULL, &last_err);
       shell->exec_ctx = tmp_ctx;
       return stat;
     }
@@ -49,29 +56,70 @@ int check_trap(t_shell *shell) {
   return NO_TRAP;
 }
 
-void del_local_depth(size_t depth, t_hashtable *env) {
-  for (size_t i = 0; i < env->count; ++i) {
-    t_ht_node *h = env->buckets[i];
-    while (h) {
-      t_ht_node *n = h->next;
-      t_env_entry *v = (t_env_entry *)h->value;
-      if (v && (v->flags & ENV_LOCAL) && v->local_depth == depth) {
-        remove_from_env(env, h->key);
-      }
-      h = n;
-    }
+void del_local_depth(size_t depth, t_shell *shell) {
+  t_hashtable *env = &shell->env;
+  size_t n_locals = 0;
+  size_t it = 0;
+  t_ht_node *h;
+  while ((h = ht_next(env, &it))) {
+    t_env_entry *v = (t_env_entry *)h->value;
+    if (v && (v->flags & ENV_LOCAL) && v->local_depth == depth)
+      n_locals++;
+  }
+  if (n_locals == 0)
+    return;
+
+  // deleting shifts slots under the cursor, nodes themselves stay put
+  t_ht_node **locals = malloc(n_locals * sizeof(*locals));
+  if (!locals) {
+    perror("malloc");
+    return;
+  }
+  size_t k = 0;
+  it = 0;
+  while ((h = ht_next(env, &it)) && k < n_locals) {
+    t_env_entry *v = (t_env_entry *)h->value;
+    if (v && (v->flags & ENV_LOCAL) && v->local_depth == depth)
+      locals[k++] = h;
   }
+  for (size_t i = 0; i < k; i++)
+    remove_from_env(shell, locals[i]->key);
+  free(locals);
 }
 
-static char *append_script_line(char *old_buf, const char *new_line,
-                                t_arena *a) {
+/* process group handshake: a job child forked by fork_job_child blocks on
+ * this pipe until the parent has placed it and recorded it in the job */
+static int pgrp_sync[2] = {-1, -1};
+
+static void pgrp_sync_close(void) {
+  for (int k = 0; k < 2; k++) {
+    if (pgrp_sync[k] != -1)
+      close(pgrp_sync[k]);
+    pgrp_sync[k] = -1;
+  }
+}
 
-  size_t old_len = old_buf ? strlen(old_buf) : 0;
-  size_t new_len = strlen(new_line);
+/**
+ * @brief forks a process that will join job's process group
+ * @return fork's return value
+ *
+ * With job control on, opens the handshake pipe first; the child waits in
+ * child_join_pgrp until parent_place_child_pgrp closes the parent's end.
+ */
+static pid_t fork_job_child(t_shell *shell) {
+  pgrp_sync_close();
+  if (shell->job_control_flag && !shell->exec_ctx.is_subshell &&
+      pipe(pgrp_sync) == -1) {
+    perror("pipe: pgrp sync");
+    pgrp_sync[0] = pgrp_sync[1] = -1;
+  }
 
-  char *new_buf = arena_realloc(a, old_buf, old_len + new_len + 1, old_len + 1);
-  memcpy(new_buf + old_len, new_line, new_len + 1);
-  return new_buf;
+  // build a lazy envp once here rather than in every child
+  get_envp(shell);
+  pid_t pid = fork();
+  if (pid == -1)
+    pgrp_sync_close();
+  return pid;
 }
 
 static void child_join_pgrp(t_shell *shell, t_job *job) {
@@ -84,17 +132,29 @@ static void child_join_pgrp(t_shell *shell, t_job *job) {
       _exit(EXIT_FAILURE);
     }
   }
+
+  if (pgrp_sync[0] == -1)
+    return;
+  close(pgrp_sync[1]);
+  pgrp_sync[1] = -1;
+  char c;
+  // EOF once the parent is done with us
+  while (read(pgrp_sync[0], &c, 1) == -1 && errno == EINTR)
+    ;
+  pgrp_sync_close();
 }
 static int parent_place_child_pgrp(t_shell *shell, t_job *job, pid_t pid) {
   if (!shell->job_control_flag)
     return 0;
+  int ret = 0;
   if (setpgid(pid, job->pgid) < 0) {
     if (errno != EPERM && errno != EACCES && errno != ESRCH) {
       perror("setpgid: parent place child pgrp");
-      return -1;
+      ret = -1;
     }
   }
-  return 0;
+  pgrp_sync_close();
+  return ret;
 }
 
 static void print_err(t_err_code last_err, size_t lc, bool is_script,
@@ -339,57 +399,107 @@ int parse_pending_hd(t_shell *shell, int cnt_hd, char **delims, bool *strip) {
   return 0;
 }
 
-int exec_script(t_shell *shell, const char *path) {
-  FILE *script = fopen(path, "r");
-  shell->script_fstream = script;
-  if (!script) {
-    errno = EINVAL;
-    perror("msh: open");
-    return -1;
-  }
-
-  char *line = NULL;
-  size_t lc = 0;
-  size_t last_err_line = 0;
-  size_t cap = 0;
-  char *total_buf = NULL;
-  t_err_code last_err;
+static void exec_cached_script(t_shell *shell, t_script_cache *sc);
 
-  char **delims = arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(char *));
-  size_t delims_cap = INIT_HD_CAP;
-  bool *strip = arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(bool));
-  size_t strip_cap = INIT_HD_CAP;
+/**
+ * @brief allocates the heredoc bookkeeping of a script unit
+ *
+ * Called again after every arena_reset, since the arrays live in the arena.
+ */
+static void init_script_unit(t_shell *shell, char ***delims, size_t *delims_cap,
+                             bool **strip, size_t *strip_cap) {
+  *delims = arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(char *));
+  *delims_cap = INIT_HD_CAP;
+  *strip = arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(bool));
+  *strip_cap = INIT_HD_CAP;
 
   shell->pending_hds =
       (char **)arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(char *));
   shell->pending_hds_cap = INIT_HD_CAP;
   shell->pending_hds_len = 0;
+}
+
+int exec_script(t_shell *shell, const char *path) {
+  t_script_src src;
+  if (script_src_open(&src, path) == -1) {
+    errno = EINVAL;
+    perror("msh: open");
+    return -1;
+  }
+  shell->script_src = &src;
+
+  t_script_cache sc;
+  if (script_cache_enabled(shell) && script_cache_get(shell, &src, &sc) == 0) {
+    exec_cached_script(shell, &sc);
+    script_cache_release(&sc);
+    script_src_close(&src);
+    shell->script_src = NULL;
+    return 0;
+  }
 
-  while (getline(&line, &cap, script) != -1) {
-    char *p = line;
-    while (*p && isspace(*p))
+  const char *line;
+  size_t line_len;
+  size_t last_err_line = 0;
+  t_unit_buf unit = {0};
+  t_err_code last_err = -1;
+  t_region *p_mark;
+  size_t off_mark;
+
+  char **delims;
+  size_t delims_cap;
+  bool *strip;
+  size_t strip_cap;
+  init_script_unit(shell, &delims, &delims_cap, &strip, &strip_cap);
+
+  while ((line = script_src_line(&src, &line_len)) != NULL) {
+    const char *p = line;
+    while (p < line + line_len && isspace((unsigned char)*p))
       p++;
-    lc++;
-    if ((*p == '#' || *p == '\0') && last_err != ERR_UNBALANCED_QUOTES)
+    size_t lc = src.lc;
+    if ((p == line + line_len || *p == '#') &&
+        last_err != ERR_UNBALANCED_QUOTES)
       continue;
 
-    int cnt =
-        cnt_hd_delims(shell, line, &delims, &delims_cap, &strip, &strip_cap);
+    long off = unit_buf_append(&unit, line, line_len, &shell->arena);
+    if (off == -1) {
+      fprintf(stderr, "msh: script buffer alloc fail\n");
+      break;
+    }
+
+    int cnt = cnt_hd_delims(shell, unit.data + off, &delims, &delims_cap,
+                            &strip, &strip_cap);
     if (cnt > 0 && parse_pending_hd(shell, cnt, delims, strip) == -1) {
       fprintf(stderr, "msh: parse pending hd fail\n");
+      script_src_close(&src);
+      shell->script_src = NULL;
       return -1;
     }
 
-    total_buf = append_script_line(total_buf, line, &shell->arena);
-    size_t k = strlen(total_buf);
-    if (k >= 2 && total_buf[k - 2] == '\\') {
-      total_buf[k - 1] = '\0';
-      total_buf[k - 2] = '\0';
+    size_t k = unit.len;
+    if (k >= 2 && unit.data[k - 2] == '\\') {
+      unit.len -= 2;
+      unit.data[unit.len] = '\0';
       continue;
     }
-    if (parse_and_execute(&total_buf, shell, &shell->token_stream, true,
-                          &last_err) == 0) {
-      total_buf = NULL;
+
+    /* lines are lexed once, as they arrive; parsing is only tried once no
+     * quote or compound command is left open */
+    if (!unit_buf_lex(&unit, &shell->arena, &last_err)) {
+      if (last_err != ERR_UNBALANCED_QUOTES)
+        continue;
+      if (unit.data[k - 1] == '\n') {
+        last_err_line = lc;
+        continue;
+      }
+      print_err(last_err, lc, true, true);
+      continue;
+    }
+
+    /* a failed attempt only leaves garbage behind: drop it so a unit that
+     * spans many lines does not pile up one AST per attempt */
+    arena_get_mark(&shell->arena, &p_mark, &off_mark);
+    if (exec_unit(shell, &unit, true, &last_err) == 0) {
+      unit = (t_unit_buf){0};
       arena_reset(&shell->arena);
 #ifdef DEBUG
       fprintf(stdout, "stdout: exec l: %zu\n", lc);
@@ -399,41 +509,37 @@ int exec_script(t_shell *shell, const char *path) {
       fflush(stderr);
 #endif
 
-      shell->pending_hds =
-          (char **)arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(char *));
-      shell->pending_hds_cap = INIT_HD_CAP;
-      shell->pending_hds_len = 0;
+      init_script_unit(shell, &delims, &delims_cap, &strip, &strip_cap);
     } else {
-      if (last_err == ERR_UNBALANCED_QUOTES && total_buf[k - 1] == '\n') {
+      arena_rollback(&shell->arena, p_mark, off_mark);
+      if (last_err == ERR_UNBALANCED_QUOTES && unit.data[k - 1] == '\n') {
         last_err_line = lc;
         continue;
       }
       print_err(last_err, lc, true, true);
     }
   }
-  if (total_buf != NULL) {
+  if (unit.data != NULL) {
+    /* attempts were skipped while a compound was open: parse once for the
+     * error to report */
+    if (unit_buf_lex(&unit, &shell->arena, &last_err) || last_err == -1)
+      build_ast(&shell->ast, &unit.ts, &shell->arena, &last_err);
     // is_script false here to print all errors not just ones that could pop up
     // from incomplete accumulation
     print_err(last_err, last_err_line, false, true);
     fprintf(stderr, "msh: unexpected EOF while looking for matching token\n");
   }
 
-  free(line);
-  fclose(script);
-  shell->script_fstream = NULL;
+  script_src_close(&src);
+  shell->script_src = NULL;
   return 0;
 }
 
 static void wait_for_job_slot(t_shell *shell) {
-  sigset_t mask, oldmask, emptymask;
-
-  sigemptyset(&mask);
-  sigaddset(&mask, SIGCHLD);
-  sigprocmask(SIG_BLOCK, &mask, &oldmask);
-
   while (is_job_table_full(shell)) {
-    sigemptyset(&emptymask);
-    sigsuspend(&emptymask);
+    if (!sigs[SIGCHLD] && sig_events_wait(-1, -1) == -1)
+      break;
+    sigs[SIGCHLD] = 0;
 
     reap_sigchld_jobs(shell);
 
@@ -441,17 +547,20 @@ static void wait_for_job_slot(t_shell *shell) {
       break;
     }
   }
-
-  sigprocmask(SIG_SETMASK, &oldmask, NULL);
 }
+
 void del_completed_jobs(t_shell *shell) {
-  for (int i = 0; i < shell->job_table_cap; i++) {
-    t_job *j = shell->job_table[i];
-    if (!j)
+  while (shell->done_jobs) {
+    t_job *j = shell->done_jobs;
+    if (j->state == S_COMPLETED) {
+      remove_job(shell, j);
       continue;
-
-    if (j->state == S_COMPLETED)
-      del_job(shell, j->job_id, false);
+    }
+    shell->done_jobs = j->done_next;
+    if (shell->done_jobs)
+      shell->done_jobs->done_prev = NULL;
+    j->done_next = NULL;
+    j->done_queued = 0;
   }
 }
 
@@ -478,14 +587,10 @@ int reap_sigchld_jobs(t_shell *shell) {
 
     reaped = 0;
 
-    t_job *job = find_job_by_pid(shell, pid);
-    if (!job) {
-      continue;
-    }
-
-    t_process *process = find_process_in_job(job, pid);
+    t_process *process = find_process_by_pid(shell, pid);
     if (!process)
       continue;
+    t_job *job = process->job;
 
     if (WIFEXITED(status) || WIFSIGNALED(status)) {
       process->completed = 1;
@@ -504,10 +609,10 @@ int reap_sigchld_jobs(t_shell *shell) {
     }
 
     if (is_job_completed(job)) {
-      job->state = S_COMPLETED;
+      mark_job_completed(shell, job);
       print_job_info(job);
       if (job->depth > 0)
-        del_local_depth(job->depth, &shell->env);
+        del_local_depth(job->depth, shell);
     }
   }
 
@@ -635,6 +740,8 @@ static t_process *make_process(pid_t pid) {
   process->running = 0;
 
   process->next = NULL;
+  process->job = NULL;
+  process->hnext = NULL;
 
   return process;
 }
@@ -644,7 +751,7 @@ static pid_t exec_bg_fun(t_shell *shell, t_ast_n *node, t_job *job,
 
   t_exec_ctx *ctx = &shell->exec_ctx;
 
-  pid_t pid = fork();
+  pid_t pid = fork_job_child(shell);
   if (pid == -1) {
     perror("fork");
     return -1;
@@ -685,7 +792,7 @@ static pid_t exec_bg_fun(t_shell *shell, t_ast_n *node, t_job *job,
     t_process *process = make_process(pid);
     if (!process)
       return -1;
-    if (add_process_to_job(job, process) == -1) {
+    if (add_process_to_job(shell, job, process) == -1) {
       perror("fail to add process to job");
       return -1;
     }
@@ -698,58 +805,67 @@ static pid_t exec_bg_fun(t_shell *shell, t_ast_n *node, t_job *job,
   return pid;
 }
 
-static pid_t exec_extern_cmd(t_shell *shell, t_ast_n *node, t_job *job,
+/**
+ * @brief replaces the current (forked) process image with argv[0]
+ * @param shell pointer to shell struct
+ * @param path resolved path of argv[0], NULL if not found
+ * @param argv NULL terminated argv
+ *
+ * @note never returns, exits 127 if the command cannot be executed.
+ */
+static void exec_or_die(t_shell *shell, const char *path, char **argv) {
+  char **env = get_envp(shell);
+  if (path)
+    execve(path, argv, env);
+
+  fprintf(stderr, "msh: command \"%s\" not found\n", argv[0]);
+  _exit(127);
+}
+
+static pid_t exec_extern_cmd(t_shell *shell, t_job *job, const char *path,
                              char **argv) {
 
   t_exec_ctx *ctx = &shell->exec_ctx;
 
-  if (ctx->pipeline) {
-    char **env = flatten_env(&shell->env, &shell->arena);
-    if (strchr(argv[0], '/')) {
-      execve(argv[0], argv, env);
-    } else {
-      t_ht_node *bin_node = ht_find(&shell->bins, argv[0]);
-      if (!bin_node) {
-        refresh_path_bins(shell);
-        bin_node = ht_find(&shell->bins, argv[0]);
-      }
-      if (bin_node)
-        execve(bin_node->value, argv, env);
+  if (ctx->pipeline)
+    exec_or_die(shell, path, argv);
+
+  /* redirections of node are already applied to the shell's fds here */
+  pid_t pid = -1;
+  if (path)
+    pid = spawn_cmd(shell, job, path, argv, NULL);
+
+  // path may be cached on the node from before the file went away
+  if (pid == -1 && path && (errno == ENOENT || errno == EACCES) &&
+      !strchr(argv[0], '/')) {
+    const char *again = path_lookup(shell, argv[0]);
+    if (again != path) {
+      path = again;
+      if (path)
+        pid = spawn_cmd(shell, job, path, argv, NULL);
     }
-    fprintf(stderr, "msh: command \"%s\" not found\n", argv[0]);
-    _exit(127);
   }
 
-  pid_t pid = fork();
   if (pid == -1) {
-    perror("fork fail exec_extern");
-    return -1;
-  }
+    pid = fork_job_child(shell);
+    if (pid == -1) {
+      perror("fork fail exec_extern");
+      return -1;
+    }
 
-  if (pid == 0) {
+    if (pid == 0) {
 
-    if (job->pgid == -1)
-      job->pgid = getpid();
+      if (job->pgid == -1)
+        job->pgid = getpid();
 
-    child_join_pgrp(shell, job);
-    init_ch_sigtable(&(shell->shell_sigtable));
+      child_join_pgrp(shell, job);
+      init_ch_sigtable(&(shell->shell_sigtable));
 
-    char **env = flatten_env(&shell->env, &shell->arena);
-    if (strchr(argv[0], '/')) {
-      execve(argv[0], argv, env);
-    } else {
-      t_ht_node *bin_node = ht_find(&shell->bins, argv[0]);
-      if (!bin_node) {
-        refresh_path_bins(shell);
-        bin_node = ht_find(&shell->bins, argv[0]);
-      }
-      if (bin_node)
-        execve(bin_node->value, argv, env);
+      exec_or_die(shell, path, argv);
     }
+  }
 
-    fprintf(stderr, "msh: command \"%s\" not found\n", argv[0]);
-    _exit(127);
-  } else if (shell->job_control_flag) {
+  if (shell->job_control_flag) {
 
     if (job->pgid == -1)
       job->pgid = pid;
@@ -757,7 +873,7 @@ static pid_t exec_extern_cmd(t_shell *shell, t_ast_n *node, t_job *job,
     t_process *process = make_process(pid);
     if (!process)
       return -1;
-    if (add_process_to_job(job, process) == -1) {
+    if (add_process_to_job(shell, job, process) == -1) {
       perror("fail to add process to job");
       return -1;
     }
@@ -777,7 +893,7 @@ static pid_t exec_bg_builtin(t_ast_n *node, t_shell *shell, t_job *job,
     return -1;
   }
 
-  pid_t pid = fork();
+  pid_t pid = fork_job_child(shell);
   if (pid == -1) {
     perror("fork fail exec_extern");
     return -1;
@@ -802,7 +918,7 @@ static pid_t exec_bg_builtin(t_ast_n *node, t_shell *shell, t_job *job,
     t_process *process = make_process(pid);
     if (!process)
       return -1;
-    if (add_process_to_job(job, process) == -1) {
+    if (add_process_to_job(shell, job, process) == -1) {
       perror("fail to add process to job");
       return -1;
     }
@@ -831,6 +947,126 @@ int is_set_var(char **argv) {
     return 1;
 }
 
+/**
+ * @brief resolves argv[0] to a function, builtin or external command
+ * @param shell pointer to shell struct
+ * @param node simple command node the resolution is cached on
+ * @param argv expanded argv
+ * @param literal true if argv[0] is the node's literal command word
+ * @param target out: see t_cmd_kind
+ * @return kind of command argv[0] names.
+ *
+ * Literal command words are resolved once and reused until shell->cmd_gen
+ * moves, words produced by an expansion are looked up on every call.
+ */
+static t_cmd_kind resolve_cmd(t_shell *shell, t_ast_n *node, char **argv,
+                              bool literal, void **target) {
+  if (literal && node->cmd_kind != CMD_UNRESOLVED &&
+      node->cmd_gen == shell->cmd_gen) {
+    *target = node->cmd_target;
+    return node->cmd_kind;
+  }
+
+  t_cmd_kind kind;
+  t_ht_node *n = ht_find(&shell->functions, argv[0]);
+  if (n) {
+    kind = CMD_FUNCTION;
+    *target = n;
+  } else if ((n = ht_find(&shell->builtins, argv[0]))) {
+    if (strcmp(n->key, "v") == 0) {
+      // v is only reached through assignments, the word itself is external
+      shell->exflag = 0;
+      *target = (void *)resolve_cmd_path(shell, argv[0]);
+      return CMD_EXTERN;
+    }
+    kind = CMD_BUILTIN;
+    *target = n;
+  } else if (is_set_var(argv)) {
+    // depends on argv[1], never cached
+    *target = ht_find(&shell->builtins, "v");
+    return CMD_ASSIGN;
+  } else {
+    kind = CMD_EXTERN;
+    *target = (void *)resolve_cmd_path(shell, argv[0]);
+    if (!*target || strchr(argv[0], '/'))
+      return kind;
+  }
+
+  if (literal) {
+    node->cmd_kind = kind;
+    node->cmd_target = *target;
+    node->cmd_gen = shell->cmd_gen;
+  }
+  return kind;
+}
+
+/**
+ * @brief runs a lone NAME=$((expr)) word without expanding it to text
+ * @param shell pointer to shell struct
+ * @param node simple command node
+ * @param job pointer to job
+ * @return true if handled, false to take the generic expansion path.
+ *
+ * The result is stored with add_to_env_int, so counting loops neither
+ * format, split nor reparse the value. Errors and expressions the arith
+ * module cannot run compiled go the generic way, which reports them.
+ */
+static bool exec_arith_assign(t_shell *shell, t_ast_n *node, t_job *job) {
+  if (shell->exec_ctx.pipeline || job->position != P_FOREGROUND)
+    return false;
+
+  // the lexer splits the word at $ and parens, its tokens must abut
+  const t_token *t = node->tok_start;
+  const char *s = t[0].start;
+  for (size_t k = 1; k < node->tok_segment_len; k++) {
+    if (t[k].start != t[k - 1].start + t[k - 1].len)
+      return false;
+  }
+  const t_token *last = &t[node->tok_segment_len - 1];
+  size_t len = last->start + last->len - s;
+  size_t name_len = 0;
+  if (len == 0 || !(isalpha(s[0]) || s[0] == '_'))
+    return false;
+  while (name_len < len && (isalnum(s[name_len]) || s[name_len] == '_'))
+    name_len++;
+  if (name_len + 6 > len || memcmp(s + name_len, "=$((", 4) != 0)
+    return false;
+
+  // the "))" closing $(( must end the word, like expand_arith scans it
+  int ad = 2;
+  size_t i = name_len + 4;
+  while (i < len && ad > 0) {
+    if (s[i] == '(')
+      ad++;
+    else if (s[i] == ')')
+      ad--;
+    i++;
+  }
+  char name[256], expr[256];
+  size_t expr_len = len - name_len - 6;
+  if (ad != 0 || i != len || name_len >= sizeof(name) ||
+      expr_len >= sizeof(expr))
+    return false;
+  memcpy(name, s, name_len);
+  name[name_len] = '\0';
+  memcpy(expr, s + name_len + 4, expr_len);
+  expr[expr_len] = '\0';
+  // PATH needs v_builtin's rehash
+  if (strcmp(name, "PATH") == 0)
+    return false;
+
+  long long v;
+  t_err_type err;
+  const t_arith_prog *prog = arith_compile(shell, expr);
+  if (!prog || !arith_run(shell, prog, &v, &err) || err != err_none)
+    return false;
+
+  add_to_env_int(shell, name, v, false, 0);
+  job->command = strndup(s, len);
+  job->last_exit_status = shell->last_exit_status = 0;
+  return true;
+}
+
 /**
  * @brief executes simple command in node
  * @param node pointer to ast node
@@ -842,6 +1078,8 @@ static pid_t exec_simple_command(t_ast_n *node, t_shell *shell, t_job *job) {
   t_exec_ctx *ctx = &shell->exec_ctx;
   if (!node)
     return -1;
+  if (exec_arith_assign(shell, node, job))
+    return 0;
 
   t_region *p = NULL;
   size_t off = 0;
@@ -849,8 +1087,9 @@ static pid_t exec_simple_command(t_ast_n *node, t_shell *shell, t_job *job) {
     arena_get_mark(&shell->arena, &p, &off);
 
   char **argv = NULL;
-  t_err_type err_ret = expand_make_argv(shell, &argv, node->tok_start,
-                                        node->tok_segment_len, &shell->arena);
+  bool literal = false;
+  t_err_type err_ret =
+      expand_node_argv(shell, &argv, node, &shell->arena, &literal);
   if (err_ret == err_fatal) {
     perror("fatal err expanding argv");
     exit(1);
@@ -860,22 +1099,23 @@ static pid_t exec_simple_command(t_ast_n *node, t_shell *shell, t_job *job) {
   }
   job->command = strdup(argv[0]);
 
-  t_ht_node *fn_node = ht_find(&shell->functions, argv[0]);
+  void *target = NULL;
+  t_cmd_kind kind = resolve_cmd(shell, node, argv, literal, &target);
 
-  const char *vn = "FUNCNEST";
-  const char *fun_nest = getenv_local(&shell->env, vn, &shell->arena);
-  int fnestmax = 10;
-  if (fun_nest)
-    fnestmax = atoi(fun_nest);
+  if (kind == CMD_FUNCTION) {
+    t_ht_node *fn_node = (t_ht_node *)target;
+    const char *fun_nest = getenv_local_ref(&shell->env, "FUNCNEST");
+    int fnestmax = 10;
+    if (fun_nest)
+      fnestmax = atoi(fun_nest);
 
-  if (fn_node) {
     if (ctx->fnest_d >= fnestmax) {
       fprintf(stderr,
               "msh: maximum nested function calls, increase FUNCNEST "
               "via export FUNCNEST\nFUNCNEST=%d",
               fnestmax);
       job->last_exit_status = shell->last_exit_status = 1;
-      del_local_depth(ctx->fnest_d, &shell->env);
+      del_local_depth(ctx->fnest_d, shell);
       return 0;
     }
     if (job->position == P_FOREGROUND) {
@@ -892,7 +1132,7 @@ static pid_t exec_simple_command(t_ast_n *node, t_shell *shell, t_job *job) {
       // this can never be == 0 here but guarding to be safe as to not delete
       // every not exported variable
       if (ctx->fnest_d > 0)
-        del_local_depth(ctx->fnest_d, &shell->env);
+        del_local_depth(ctx->fnest_d, shell);
       ctx->fnest_d--;
       shell->argv = curr_argv;
       shell->argc = curr_argc;
@@ -907,17 +1147,17 @@ static pid_t exec_simple_command(t_ast_n *node, t_shell *shell, t_job *job) {
     }
   }
 
-  t_ht_node *builtin_imp = ht_find(&shell->builtins, argv[0]);
-  if (builtin_imp && strcmp(builtin_imp->key, "exit") != 0)
+  t_ht_node *builtin_imp = kind == CMD_EXTERN ? NULL : (t_ht_node *)target;
+  if (kind != CMD_BUILTIN ||
+      ((t_builtin *)builtin_imp->value)->fn != test_builtin)
+    stat_cache_clear(&shell->stat_cache);
+  if (kind == CMD_BUILTIN &&
+      ((t_builtin *)builtin_imp->value)->fn != exit_builtin)
     shell->exflag = 0;
-  if (builtin_imp && strcmp(builtin_imp->key, "v") == 0)
-    builtin_imp = NULL;
-  else if (!builtin_imp && is_set_var(argv)) {
-    builtin_imp = ht_find(&shell->builtins, "v");
-  }
 
   if (builtin_imp == NULL) {
-    pid_t ret_pid = exec_extern_cmd(shell, node, job, argv);
+    pid_t ret_pid =
+        exec_extern_cmd(shell, job, (const char *)target, argv);
     arena_rollback(&shell->arena, p, off);
     return ret_pid;
   } else if (job->position == P_FOREGROUND) {
@@ -944,7 +1184,7 @@ static pid_t exec_subshell(t_ast_n *node, t_shell *shell, t_job *job) {
 
   t_exec_ctx *ctx = &shell->exec_ctx;
 
-  pid_t pid = fork();
+  pid_t pid = fork_job_child(shell);
   if (pid < 0) {
     perror("241: fork fail");
     return -1;
@@ -988,7 +1228,7 @@ static pid_t exec_subshell(t_ast_n *node, t_shell *shell, t_job *job) {
     t_process *process = make_process(pid);
     if (!process)
       return -1;
-    if (add_process_to_job(job, process) == -1) {
+    if (add_process_to_job(shell, job, process) == -1) {
       perror("fail to add process to jod");
       return -1;
     }
@@ -1015,6 +1255,10 @@ static pid_t exec_command(t_ast_n *node, t_shell *shell, t_job *job) {
   if (!node)
     return -1;
 
+  // only a run of plain test commands may share stat results
+  if (node->redir_bool || node->io_redir || node->op_type != OP_SIMPLE)
+    stat_cache_clear(&shell->stat_cache);
+
   bool restore_io_flag = 0;
   if (node->redir_bool) {
     if (redirect_io(shell, node) == -1) {
@@ -1099,6 +1343,122 @@ static void close_pipeline_fds(int (*pipes)[2], int n) {
   }
 }
 
+/**
+ * @brief dups the pipe ends of stage i onto stdio and closes all pipe fds
+ * @param pipes pipeline pipes
+ * @param count_cmd number of stages in pipeline
+ * @param i index of stage
+ */
+static void child_wire_pipe(int (*pipes)[2], int count_cmd, int i) {
+  if (i > 0 && dup2(pipes[i - 1][0], STDIN_FILENO) == -1)
+    perror("dup2");
+  if (i < count_cmd - 1 && dup2(pipes[i][1], STDOUT_FILENO) == -1)
+    perror("dup2");
+
+  for (int j = 0; j < count_cmd - 1; j++) {
+    close(pipes[j][0]);
+    close(pipes[j][1]);
+  }
+}
+
+/**
+ * @brief checks if a pipeline stage can be expanded in the parent and spawned
+ * @param shell pointer to shell struct
+ * @param stage flattened pipeline stage
+ * @return true if stage is spawnable.
+ *
+ * The command word must be a literal naming neither a function nor a builtin,
+ * so it is known to be external before any expansion runs. Words with command
+ * substitution or assigning/erroring parameter expansions are refused, since
+ * expanding those in the parent is observable; heredocs have no file action.
+ */
+static bool is_spawnable_stage(t_shell *shell, t_ast_n *stage) {
+  if (stage->op_type != OP_SIMPLE || stage->tok_segment_len == 0)
+    return false;
+
+  t_token *first = &stage->tok_start[0];
+  if (first->type != TOKEN_SIMPLE || first->len == 0)
+    return false;
+
+  for (size_t k = 0; k < first->len; k++) {
+    if (strchr("$`'\"\\*?[{~=", first->start[k]))
+      return false;
+  }
+
+  if (ht_find_n(&shell->functions, first->start, first->len) ||
+      ht_find_n(&shell->builtins, first->start, first->len))
+    return false;
+
+  for (size_t t = 0; t < stage->tok_segment_len; t++) {
+    t_token *tok = &stage->tok_start[t];
+    if (tok->type == TOKEN_HEREDOC || tok->type == TOKEN_HEREDOC_STRIP)
+      return false;
+    for (size_t k = 0; k < tok->len; k++) {
+      char c = tok->start[k];
+      char nc = k + 1 < tok->len ? tok->start[k + 1] : '\0';
+      if (c == '`' || (c == '$' && nc == '(') ||
+          (c == ':' && (nc == '=' || nc == '?')))
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief expands a spawnable stage in the parent and spawns it
+ * @param shell pointer to shell struct
+ * @param stage flattened pipeline stage
+ * @param job pointer to pipeline job
+ * @param pipes pipeline pipes
+ * @param count_cmd number of stages in pipeline
+ * @param i index of stage
+ * @return pid of stage, -1 on fail.
+ *
+ * @note if posix_spawn fails the stage is forked with the already expanded
+ * argv so words are never expanded twice.
+ */
+static pid_t spawn_pipe_stage(t_shell *shell, t_ast_n *stage, t_job *job,
+                              int (*pipes)[2], int count_cmd, int i) {
+  char **argv = NULL;
+  t_err_type err_ret =
+      expand_node_argv(shell, &argv, stage, &shell->arena, NULL);
+  if (err_ret == err_fatal || argv == NULL || argv[0] == NULL) {
+    perror("fatal err expanding argv");
+    return -1;
+  }
+
+  t_spawn_io io = {.in_fd = i > 0 ? pipes[i - 1][0] : -1,
+                   .out_fd = i < count_cmd - 1 ? pipes[i][1] : -1,
+                   .pipes = pipes,
+                   .pipes_len = count_cmd - 1,
+                   .redir_node = stage};
+
+  pid_t pid = -1;
+  const char *path = resolve_cmd_path(shell, argv[0]);
+  if (path)
+    pid = spawn_cmd(shell, job, path, argv, &io);
+  if (pid != -1)
+    return pid;
+
+  pid = fork_job_child(shell);
+  if (pid == 0) {
+    if (job->pgid == -1)
+      job->pgid = getpid();
+
+    child_join_pgrp(shell, job);
+    child_wire_pipe(pipes, count_cmd, i);
+
+    init_ch_sigtable(&shell->shell_sigtable);
+
+    if (stage->redir_bool && redirect_io(shell, stage) == -1) {
+      fprintf(stderr, "msh: redirect io\n");
+      _exit(shell->last_exit_status);
+    }
+    exec_or_die(shell, path, argv);
+  }
+  return pid;
+}
+
 /**
  * @brief executes pipe command on flattened list
  * @param node pointer to ast node
@@ -1155,7 +1515,11 @@ static pid_t exec_pipe(t_ast_n *node, t_shell *shell, t_job *job) {
   int i = 0;
   while (exec && i < count_cmd) {
 
-    pid_t pid = fork();
+    pid_t pid = 0;
+    if (is_spawnable_stage(shell, exec))
+      pid = spawn_pipe_stage(shell, exec, job, pipes, count_cmd, i);
+    if (pid == 0)
+      pid = fork_job_child(shell);
     if (pid == -1) {
       close_pipeline_fds(pipes, count_cmd - 1);
       return -1;
@@ -1163,67 +1527,17 @@ static pid_t exec_pipe(t_ast_n *node, t_shell *shell, t_job *job) {
 
     if (pid == 0) {
 
-      if (i == 0) {
-
-        if (job->pgid == -1)
-          job->pgid = getpid();
-        child_join_pgrp(shell, job);
-        if (dup2(pipes[i][1], STDOUT_FILENO) == -1) {
-          perror("dup2");
-        }
-
-        for (int j = 0; j < count_cmd - 1; j++) {
-          close(pipes[j][0]);
-          close(pipes[j][1]);
-        }
-
-        init_ch_sigtable(&shell->shell_sigtable);
-
-        exec_command(exec, shell, job);
-
-        _exit(shell->last_exit_status);
-      } else if (i == count_cmd - 1) {
+      if (job->pgid == -1)
+        job->pgid = getpid();
 
-        if (job->pgid == -1)
-          job->pgid = getpid();
+      child_join_pgrp(shell, job);
+      child_wire_pipe(pipes, count_cmd, i);
 
-        child_join_pgrp(shell, job);
-        if (dup2(pipes[i - 1][0], STDIN_FILENO) == -1) {
-          perror("dup2");
-        }
-        for (int j = 0; j < count_cmd - 1; j++) {
-          close(pipes[j][0]);
-          close(pipes[j][1]);
-        }
+      init_ch_sigtable(&shell->shell_sigtable);
 
-        init_ch_sigtable(&shell->shell_sigtable);
+      exec_command(exec, shell, job);
 
-        exec_command(exec, shell, job);
-
-        _exit(shell->last_exit_status);
-      } else {
-
-        if (job->pgid == -1)
-          job->pgid = getpid();
-
-        child_join_pgrp(shell, job);
-        if (dup2(pipes[i - 1][0], STDIN_FILENO) == -1) {
-          perror("dup2");
-        }
-        if (dup2(pipes[i][1], STDOUT_FILENO) == -1) {
-          perror("dup2");
-        }
-        for (int j = 0; j < count_cmd - 1; j++) {
-          close(pipes[j][0]);
-          close(pipes[j][1]);
-        }
-
-        init_ch_sigtable(&shell->shell_sigtable);
-
-        exec_command(exec, shell, job);
-
-        _exit(shell->last_exit_status);
-      }
+      _exit(shell->last_exit_status);
     } else if (shell->job_control_flag) {
 
       if (job->pgid == -1 && i == 0) {
@@ -1233,12 +1547,13 @@ static pid_t exec_pipe(t_ast_n *node, t_shell *shell, t_job *job) {
       t_process *process = make_process(pid);
       if (!process) {
         perror("make process");
+        unindex_job(shell, job);
         cleanup_job_struct(job);
         close_pipeline_fds(pipes, count_cmd - 1);
         return -1;
       }
 
-      add_process_to_job(job, process);
+      add_process_to_job(shell, job, process);
 
       if (parent_place_child_pgrp(shell, job, pid) == -1) {
         close_pipeline_fds(pipes, count_cmd - 1);
@@ -1301,6 +1616,8 @@ static int exec_job(char *cmd_buf, t_ast_n *node, t_shell *shell) {
 
   ctx->pipeline = NULL;
   pid_t lpid = exec_command(node, shell, job);
+  // releases a child left waiting by a launch that failed halfway
+  pgrp_sync_close();
   if (shell->job_control_flag && job->position == P_FOREGROUND) {
 
     t_pgrp tc;
@@ -1340,7 +1657,6 @@ static int exec_job(char *cmd_buf, t_ast_n *node, t_shell *shell) {
   } else if (shell->job_control_flag && job->pgid != -1) {
     if (!ctx->is_subshell)
       print_job_info(job);
-    usleep(10000);
     return WAIT_FINISHED;
   } else if (!shell->job_control_flag) {
     /* builtins set shell exit status - return pid 0 */
@@ -1435,7 +1751,7 @@ static int exec_cond_bg(char *cmd_buf, t_ast_n *node, t_shell *shell) {
 
     t_process *process = make_process(pid);
     if (process) {
-      add_process_to_job(job, process);
+      add_process_to_job(shell, job, process);
       job->last_pid = pid;
     }
 
@@ -1481,6 +1797,7 @@ static int exec_list(char *cmd_buf, t_ast_n *node, t_shell *shell) {
       fprintf(stderr, "\nmsh: failed to insert function");
       return -1;
     }
+    shell->cmd_gen++;
     return 0;
   }
   case OP_SEQ:
@@ -1522,6 +1839,7 @@ static int exec_list(char *cmd_buf, t_ast_n *node, t_shell *shell) {
       if (is_job_table_full(shell)) {
         wait_for_job_slot(shell);
       }
+      stat_cache_clear(&shell->stat_cache);
 
       t_wait_status wait;
       wait = exec_list(cmd_buf, node->left, shell);
@@ -1561,6 +1879,7 @@ static int exec_list(char *cmd_buf, t_ast_n *node, t_shell *shell) {
       if (is_job_table_full(shell)) {
         wait_for_job_slot(shell);
       }
+      stat_cache_clear(&shell->stat_cache);
 
       t_wait_status wait;
       wait = exec_list(cmd_buf, node->left, shell);
@@ -1643,11 +1962,15 @@ static int exec_list(char *cmd_buf, t_ast_n *node, t_shell *shell) {
  * @return -1 on fail, 0 on success.
  *
  */
-int parse_and_execute(char **cmd_buf, t_shell *shell,
-                      t_token_stream *token_stream, bool script,
-                      t_err_code *last_err) {
-  *last_err = -1;
-
+/**
+ * @brief executes a parsed command buffer
+ * @param cmd_buf command buffer the tokens of root point into
+ * @param root root of the buffer's ast
+ * @param shell pointer to shell struct
+ * @param script true if not called from an interactive command line
+ */
+static void exec_parsed(char *cmd_buf, t_ast_n *root, t_shell *shell,
+                        bool script) {
   t_fd_backup *saved_fd_prevs = shell->exec_ctx.fd_prevs;
   size_t saved_fd_prevs_len = shell->exec_ctx.fd_prevs_len;
   size_t saved_fd_prevs_cap = shell->exec_ctx.fd_prevs_cap;
@@ -1657,29 +1980,9 @@ int parse_and_execute(char **cmd_buf, t_shell *shell,
   shell->exec_ctx.fd_prevs = NULL;
   shell->exec_ctx.fd_prevs_len = 0;
   shell->exec_ctx.fd_prevs_cap = 0;
-
-  init_token_stream(token_stream, &shell->arena);
-  t_hashtable *aliases = &(shell->aliases);
-  if (lex_command_line(cmd_buf, token_stream, aliases, 0, &shell->arena, 0,
-                       last_err) == -1) {
-    shell->exec_ctx.fd_prevs = saved_fd_prevs;
-    shell->exec_ctx.fd_prevs_len = saved_fd_prevs_len;
-    shell->exec_ctx.fd_prevs_cap = saved_fd_prevs_cap;
-    shell->exec_ctx.cnt_rstr = saved_cnt_rstr;
-    return -1;
-  }
-
-  t_ast_n *root;
-  if ((root = build_ast(&(shell->ast), token_stream, &shell->arena,
-                        last_err)) == NULL) {
-    shell->exec_ctx.fd_prevs = saved_fd_prevs;
-    shell->exec_ctx.fd_prevs_len = saved_fd_prevs_len;
-    shell->exec_ctx.fd_prevs_cap = saved_fd_prevs_cap;
-    shell->exec_ctx.cnt_rstr = saved_cnt_rstr;
-    if (!script)
-      print_err(*last_err, 0, script, false);
-    return -1;
-  }
+  stat_cache_clear(&shell->stat_cache);
+  if (shell->snap_rec)
+    snapshot_check(shell, root);
 
   if (shell->is_interactive) {
 
@@ -1714,7 +2017,8 @@ int parse_and_execute(char **cmd_buf, t_shell *shell,
   sa_winch.sa_flags = 0;
   sigaction(SIGWINCH, &sa_winch, &osa_winch);
 
-  exec_list(*cmd_buf, root, shell);
+  exec_list(cmd_buf, root, shell);
+  release_hd_fds(root);
 
   shell->exec_ctx.fd_prevs = saved_fd_prevs;
   shell->exec_ctx.fd_prevs_len = saved_fd_prevs_len;
@@ -1732,5 +2036,84 @@ int parse_and_execute(char **cmd_buf, t_shell *shell,
   shell->exec_ctx.pipeline_pids = NULL;
   sigs[SIGINT] = 0;
   sigs[SIGTSTP] = 0;
+}
+
+int parse_and_execute(char **cmd_buf, t_shell *shell,
+                      t_token_stream *token_stream, bool script,
+                      t_err_code *last_err) {
+  *last_err = -1;
+
+  init_token_stream(token_stream, &shell->arena);
+  t_hashtable *aliases = &(shell->aliases);
+  if (lex_command_line(cmd_buf, token_stream, aliases, 0, &shell->arena, 0,
+                       last_err) == -1)
+    return -1;
+
+  t_ast_n *root;
+  if ((root = build_ast(&(shell->ast), token_stream, &shell->arena,
+                        last_err)) == NULL) {
+    if (!script)
+      print_err(*last_err, 0, script, false);
+    return -1;
+  }
+
+  exec_parsed(*cmd_buf, root, shell, script);
+  return 0;
+}
+
+int exec_unit(t_shell *shell, t_unit_buf *unit, bool script,
+              t_err_code *last_err) {
+  if (shell->aliases.count > 0) {
+    char *buf = unit->data;
+    return parse_and_execute(&buf, shell, &shell->token_stream, script,
+                             last_err);
+  }
+
+  *last_err = -1;
+  t_ast_n *root = build_ast(&shell->ast, &unit->ts, &shell->arena, last_err);
+  if (!root)
+    return -1;
+  exec_parsed(unit->data, root, shell, script);
   return 0;
 }
+
+/**
+ * @brief executes the units of a parsed-script image in order
+ * @param shell pointer to shell struct
+ * @param sc pointer to image from script_cache_get
+ *
+ * Units are relocated and run without lexing or parsing; once the script has
+ * defined aliases a unit is re-lexed from its text instead, since the cached
+ * tokens were produced with an empty alias table.
+ */
+static void exec_cached_script(t_shell *shell, t_script_cache *sc) {
+  t_err_code last_err;
+
+  for (size_t i = 0; i < sc->units_len; i++) {
+    shell->pending_hds =
+        (char **)arena_alloc(&shell->arena, INIT_HD_CAP * sizeof(char *));
+    shell->pending_hds_cap = INIT_HD_CAP;
+    shell->pending_hds_len = 0;
+
+    if (shell->aliases.count > 0) {
+      const char *src = script_cache_text(sc, i);
+      size_t len = strlen(src);
+      char *buf = arena_alloc(&shell->arena, len + 1);
+      memcpy(buf, src, len + 1);
+      if (parse_and_execute(&buf, shell, &shell->token_stream, true,
+                            &last_err) == -1)
+        print_err(last_err, sc->units[i].lc, true, true);
+    } else {
+      char *text;
+      t_ast_n *root = script_cache_unit(sc, i, &text);
+      if (!root) {
+        fprintf(stderr, "msh: corrupt script cache\n");
+        break;
+      }
+      shell->ast.root = root;
+      exec_parsed(text, root, shell, true);
+    }
+
+    arena_reset(&shell->arena);
+  }
+}
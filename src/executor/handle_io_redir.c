@@ -2,8 +2,11 @@
 #include "ast.h"
 #include "lexer.h"
 #include "shell.h"
+#include "memfd.h"
 #include "var_exp.h"
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 
 /**
@@ -75,43 +78,127 @@ static int get_redir_flags(t_ast_n *node, int index) {
   return flags;
 }
 
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
 /**
- * @brief handles heredoc_io
- * @return 0 success, -1 fail (fatal)
- * @param shell pointer to shell struct
- * @param index index of io_redir arr
- * @param node pointer to ast node
+ * @brief delivers a heredoc body that fits the pipe buffer through a pipe
+ * @return read end of the pipe, -1 fail
  *
- * Function first calls mkstemp(template) on defined char template[] to create a
- * temp file to read heredoc i/o into fcntl and unlink assure the deletion of
- * the flag after heredoc is read. reading of user input for heredoc handled
- * within this function.
+ * A write of at most PIPE_BUF bytes never blocks on an empty pipe, so the
+ * body is written up front and the write end closed before anyone reads.
  */
-static int heredoc_io(t_shell *shell, int index, t_ast_n *node) {
-  char template[] = "/tmp/heredocXXXXXX";
-  int heredoc_fd = mkstemp(template);
-  if (heredoc_fd == -1) {
-    perror("mkstemp fatal error");
+static int heredoc_pipe(const char *body, size_t len) {
+  int p[2];
+  if (pipe(p) == -1) {
+    perror("heredoc_io pipe");
+    return -1;
+  }
+  if (write_all(p[1], body, len) == -1) {
+    perror("heredoc_io write");
+    close(p[0]);
+    close(p[1]);
     return -1;
   }
-  fcntl(heredoc_fd, F_SETFD, FD_CLOEXEC);
-  unlink(template);
+  close(p[1]);
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  return p[0];
+}
 
-  char *body = node->io_redir[index]->hd_body;
-  if (body) {
-    if (write(heredoc_fd, body, strlen(body)) == -1) {
+/**
+ * @brief delivers a heredoc body through the memfd cached on its redirection
+ * @return fd positioned at the start of the body, -1 fail
+ *
+ * The memfd is filled once per body and kept on the redirection, so a heredoc
+ * inside a loop is not rewritten on every iteration. Each use reopens it
+ * through /proc for a private file offset, falling back to a rewound dup.
+ */
+static int heredoc_memfd(t_io_redir *redir, const char *body, size_t len) {
+  if (redir->hd_fd == -1 || redir->hd_fd_body != body) {
+    if (redir->hd_fd == -1) {
+      redir->hd_fd = mem_fd_open("heredoc");
+      if (redir->hd_fd == -1) {
+        perror("heredoc_io memfd");
+        return -1;
+      }
+    } else if (ftruncate(redir->hd_fd, 0) == -1 ||
+               lseek(redir->hd_fd, 0, SEEK_SET) == -1) {
+      perror("heredoc_io truncate");
+      return -1;
+    }
+    redir->hd_fd_body = NULL;
+    if (write_all(redir->hd_fd, body, len) == -1) {
       perror("heredoc_io write");
-      close(heredoc_fd);
       return -1;
     }
+    redir->hd_fd_body = body;
   }
 
-  if (lseek(heredoc_fd, 0, SEEK_SET) == -1) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", redir->hd_fd);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd != -1)
+    return fd;
+
+  if (lseek(redir->hd_fd, 0, SEEK_SET) == -1) {
     perror("lseek fatal error");
-    close(heredoc_fd);
     return -1;
   }
-  return heredoc_fd;
+  fd = fcntl(redir->hd_fd, F_DUPFD_CLOEXEC, 0);
+  if (fd == -1)
+    perror("heredoc_io dup");
+  return fd;
+}
+
+/**
+ * @brief handles heredoc_io
+ * @return fd to read the body from, -1 fail (fatal)
+ * @param shell pointer to shell struct
+ * @param index index of io_redir arr
+ * @param node pointer to ast node
+ *
+ * Bodies are read and expanded before execution (collect_pending_hds), so
+ * here they only need delivering: through a pipe when they fit its buffer,
+ * through a cached memfd otherwise. Nothing touches the filesystem.
+ */
+static int heredoc_io(t_shell *shell, int index, t_ast_n *node) {
+  (void)shell;
+  t_io_redir *redir = node->io_redir[index];
+  const char *body = redir->hd_body ? redir->hd_body : "";
+  size_t len = strlen(body);
+
+  if (len <= PIPE_BUF)
+    return heredoc_pipe(body, len);
+  return heredoc_memfd(redir, body, len);
+}
+
+void release_hd_fds(t_ast_n *root) {
+  if (!root)
+    return;
+  if (root->io_redir) {
+    for (size_t i = 0; root->io_redir[i]; i++) {
+      t_io_redir *rd = root->io_redir[i];
+      if (rd->hd_fd == -1)
+        continue;
+      close(rd->hd_fd);
+      rd->hd_fd = -1;
+      rd->hd_fd_body = NULL;
+    }
+  }
+  release_hd_fds(root->sub_ast_root);
+  release_hd_fds(root->left);
+  release_hd_fds(root->right);
 }
 
 int check_realloc_pending_hds(t_shell *shell) {
@@ -141,9 +228,31 @@ int check_realloc_pending_hds(t_shell *shell) {
   return 0;
 }
 
-int read_hd_body(const char *delim, bool strip, t_shell *shell, char **out) {
+/**
+ * @brief reads the next heredoc line, from the running script or stdin
+ * @return line length as getline, -1 at end of input
+ */
+static ssize_t hd_getline(t_shell *shell, char **line, size_t *cap) {
+  if (shell->is_interactive || !shell->script_src)
+    return getline(line, cap, stdin);
 
-  FILE *stream = shell->is_interactive ? stdin : shell->script_fstream;
+  size_t len;
+  const char *src = script_src_line(shell->script_src, &len);
+  if (!src)
+    return -1;
+  if (len + 1 > *cap) {
+    char *nline = realloc(*line, len + 1);
+    if (!nline)
+      return -1;
+    *line = nline;
+    *cap = len + 1;
+  }
+  memcpy(*line, src, len);
+  (*line)[len] = '\0';
+  return (ssize_t)len;
+}
+
+int read_hd_body(const char *delim, bool strip, t_shell *shell, char **out) {
 
   size_t buf_cap = 512;
   size_t buf_len = 0;
@@ -172,7 +281,7 @@ int read_hd_body(const char *delim, bool strip, t_shell *shell, char **out) {
 
   if (shell->is_interactive)
     fprintf(stderr, "HEREDOC>> ");
-  while ((nr = getline(&line, &line_cap, stream)) != -1) {
+  while ((nr = hd_getline(shell, &line, &line_cap)) != -1) {
 
     if (nr > 0 && line[nr - 1] == '\n')
       line[--nr] = '\0';
@@ -390,6 +499,33 @@ int redirect_io(t_shell *shell, t_ast_n *node) {
   return 0;
 }
 
+int redir_file_actions(posix_spawn_file_actions_t *fa, t_ast_n *node) {
+  if (!node->io_redir)
+    return 0;
+
+  for (int i = 0; node->io_redir[i] != NULL; i++) {
+    t_io_redir *redir = node->io_redir[i];
+    t_redir_type typ = redir->io_redir_type;
+
+    if (typ == IO_HEREDOC || typ == IO_HEREDOC_STRIP)
+      return -1;
+
+    int err;
+    if (typ == IO_DUP_IN || typ == IO_DUP_OUT) {
+      err = posix_spawn_file_actions_adddup2(fa, redir->target_fd,
+                                             redir->src_fd);
+    } else {
+      if (redir->filename == NULL)
+        return -1;
+      err = posix_spawn_file_actions_addopen(fa, redir->src_fd, redir->filename,
+                                             get_redir_flags(node, i), 0644);
+    }
+    if (err != 0)
+      return -1;
+  }
+  return 0;
+}
+
 /**
  * @brief restores I/O file descriptors backed up by restore_io into shell
  * struct.
@@ -0,0 +1,166 @@
+#include "path_cache.h"
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file path_cache.c
+ * @brief implementation of lazy PATH lookup with remembered answers.
+ */
+
+/** @brief splits PATH into dirs, empty entries are skipped */
+static void parse_path(t_shell *shell) {
+  t_path_cache *pc = &shell->path_cache;
+  pc->parsed = true;
+  if (!shell->path)
+    return;
+
+  size_t n = 1;
+  for (size_t i = 0; i < shell->path_len; i++)
+    n += shell->path[i] == ':';
+  pc->dirs = calloc(n, sizeof(t_path_dir));
+  if (!pc->dirs) {
+    perror("calloc");
+    return;
+  }
+
+  const char *s = shell->path;
+  const char *end = shell->path + shell->path_len;
+  while (s < end) {
+    const char *colon = memchr(s, ':', end - s);
+    size_t len = (colon ? colon : end) - s;
+    if (len) {
+      char *dir = strndup(s, len);
+      if (!dir) {
+        perror("strndup");
+        return;
+      }
+      pc->dirs[pc->len++].dir = dir;
+    }
+    s += len + 1;
+  }
+}
+
+/**
+ * @brief stats the first n PATH directories
+ * @return true if one differs from the last stamp.
+ */
+static bool stamp_dirs(t_path_cache *pc, size_t n) {
+  bool changed = false;
+  for (size_t i = 0; i < n; i++) {
+    t_path_dir *d = &pc->dirs[i];
+    struct stat st;
+    bool seen = stat(d->dir, &st) == 0;
+    if (seen == d->seen &&
+        (!seen || (st.st_dev == d->dev && st.st_ino == d->ino &&
+                   st.st_mtim.tv_sec == d->mtime.tv_sec &&
+                   st.st_mtim.tv_nsec == d->mtime.tv_nsec)))
+      continue;
+    changed = true;
+    d->seen = seen;
+    if (seen) {
+      d->dev = st.st_dev;
+      d->ino = st.st_ino;
+      d->mtime = st.st_mtim;
+    }
+  }
+  pc->stamped = true;
+  return changed;
+}
+
+/** @brief looks name up in each PATH directory in order */
+static t_bin *probe(t_path_cache *pc, const char *name) {
+  char full[PATH_MAX];
+  for (size_t i = 0; i < pc->len; i++) {
+    int len = snprintf(full, sizeof(full), "%s/%s", pc->dirs[i].dir, name);
+    if (len < 0 || (size_t)len >= sizeof(full))
+      continue;
+    struct stat st;
+    if (stat(full, &st) == -1 || S_ISDIR(st.st_mode) ||
+        access(full, X_OK) == -1)
+      continue;
+    t_bin *b = malloc(sizeof(*b) + len + 1);
+    if (!b) {
+      perror("malloc");
+      return NULL;
+    }
+    b->epoch = pc->epoch;
+    b->dir = i;
+    b->found = true;
+    memcpy(b->path, full, len + 1);
+    return b;
+  }
+
+  t_bin *b = malloc(sizeof(*b) + 1);
+  if (!b) {
+    perror("malloc");
+    return NULL;
+  }
+  b->epoch = pc->epoch;
+  b->dir = pc->len;
+  b->found = false;
+  b->path[0] = '\0';
+  return b;
+}
+
+/** @brief makes every entry stale, nodes caching their paths resolve again */
+static void next_epoch(t_shell *shell) {
+  shell->path_cache.epoch++;
+  shell->cmd_gen++;
+}
+
+const char *path_lookup(t_shell *shell, const char *name) {
+  t_path_cache *pc = &shell->path_cache;
+  if (!*name || strchr(name, '/'))
+    return NULL;
+  if (!pc->parsed)
+    parse_path(shell);
+
+  t_ht_node *n = ht_find(&shell->bins, name);
+  t_bin *old = n ? n->value : NULL;
+  if (old && old->epoch == pc->epoch) {
+    // a hit stands until its directory or one before it changes, a miss
+    // until any PATH directory does
+    if (!stamp_dirs(pc, old->found ? old->dir + 1 : pc->len))
+      return old->found ? old->path : NULL;
+    next_epoch(shell);
+  }
+
+  // answers probed from here on are checked against these stamps
+  if (!pc->stamped)
+    stamp_dirs(pc, pc->len);
+
+  t_bin *b = probe(pc, name);
+  if (!b)
+    return NULL;
+  if (old && old->found && b->found && strcmp(old->path, b->path) == 0) {
+    // same answer, keep the path nodes may still point at
+    old->epoch = b->epoch;
+    free(b);
+    return old->path;
+  }
+  if (n) {
+    free(n->value);
+    n->value = b;
+  } else if (!ht_insert(&shell->bins, name, b, free)) {
+    free(b);
+    return NULL;
+  }
+  return b->found ? b->path : NULL;
+}
+
+void path_cache_reset(t_shell *shell) {
+  t_path_cache *pc = &shell->path_cache;
+  ht_flush(&shell->bins, free);
+  for (size_t i = 0; i < pc->len; i++)
+    free(pc->dirs[i].dir);
+  free(pc->dirs);
+  pc->dirs = NULL;
+  pc->len = 0;
+  pc->parsed = false;
+  pc->stamped = false;
+  next_epoch(shell);
+}
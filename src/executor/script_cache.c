@@ -0,0 +1,783 @@
+#include "script_cache.h"
+#include "lexer.h"
+#include "parser.h"
+#include "var_exp.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file script_cache.c
+ * @brief implementation of the on-disk parsed-script cache.
+ */
+
+#define SC_MAGIC 0x4348534dU // "MSHC"
+#define SC_VERSION 3
+#define SC_ALIGN 16
+#define SC_DEF_CAP (64 * 1024)
+
+typedef struct s_sc_key {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} t_sc_key;
+
+typedef struct s_sc_hdr {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t node_size;
+  uint32_t tok_size;
+  t_sc_key script;
+  t_sc_key build;
+  uint64_t units_off;
+  uint64_t units_len;
+  uint64_t size;
+} t_sc_hdr;
+
+/**
+ * @typedef struct s_sc_b t_sc_b
+ * @brief image under construction plus the unit currently being emitted.
+ */
+typedef struct s_sc_b {
+  char *data;
+  size_t len;
+  size_t cap;
+
+  uint64_t *relocs;
+  size_t relocs_len;
+  size_t relocs_cap;
+
+  t_sc_unit *units;
+  size_t units_len;
+  size_t units_cap;
+
+  size_t text_len;
+
+  const t_token *toks;
+  size_t toks_len;
+  uint64_t toks_off;
+} t_sc_b;
+
+bool script_cache_enabled(t_shell *shell) {
+  const char *dir = getenv_local_ref(&shell->env, SC_ENV_VAR);
+  return dir && *dir;
+}
+
+static void key_of_stat(t_sc_key *key, const struct stat *st) {
+  key->dev = st->st_dev;
+  key->ino = st->st_ino;
+  key->size = st->st_size;
+  key->mtime_sec = st->st_mtim.tv_sec;
+  key->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static bool key_eq(const t_sc_key *a, const t_sc_key *b) {
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+         a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+/**
+ * @brief reserves n zeroed bytes at SC_ALIGN in the image
+ * @return offset of the reservation, -1 on alloc fail
+ */
+static int64_t sc_alloc(t_sc_b *b, size_t n) {
+  size_t off = (b->len + SC_ALIGN - 1) & ~((size_t)SC_ALIGN - 1);
+  if (off + n > b->cap) {
+    size_t ncap = b->cap ? b->cap : SC_DEF_CAP;
+    while (off + n > ncap)
+      ncap *= BUF_GROWTH_FACTOR;
+    char *ndata = realloc(b->data, ncap);
+    if (!ndata)
+      return -1;
+    b->data = ndata;
+    b->cap = ncap;
+  }
+  memset(b->data + b->len, 0, off + n - b->len);
+  b->len = off + n;
+  return off;
+}
+
+/**
+ * @brief stores target as the pointer in slot and records slot for relocation
+ * @return 0 success, -1 on alloc fail
+ */
+static int sc_ptr(t_sc_b *b, uint64_t slot, uint64_t target) {
+  if (target == 0)
+    return 0;
+
+  if (b->relocs_len == b->relocs_cap) {
+    size_t ncap = b->relocs_cap ? b->relocs_cap * BUF_GROWTH_FACTOR : 64;
+    uint64_t *nrel = realloc(b->relocs, ncap * sizeof(uint64_t));
+    if (!nrel)
+      return -1;
+    b->relocs = nrel;
+    b->relocs_cap = ncap;
+  }
+  b->relocs[b->relocs_len++] = slot;
+
+  uintptr_t v = target;
+  memcpy(b->data + slot, &v, sizeof(v));
+  return 0;
+}
+
+static int64_t sc_bytes(t_sc_b *b, const char *s, size_t len) {
+  int64_t off = sc_alloc(b, len + 1);
+  if (off == -1)
+    return -1;
+  memcpy(b->data + off, s, len);
+  return off;
+}
+
+/**
+ * @brief translates a pointer into the unit's token stream to an offset
+ * @return offset, 0 for NULL, -1 if tok lies outside the stream
+ */
+static int64_t sc_tok(t_sc_b *b, const t_token *tok) {
+  if (!tok)
+    return 0;
+  if (tok < b->toks || tok > b->toks + b->toks_len)
+    return -1;
+  return b->toks_off + (tok - b->toks) * sizeof(t_token);
+}
+
+static int64_t sc_redirs(t_sc_b *b, t_io_redir **redirs) {
+  size_t n = 0;
+  while (redirs[n])
+    n++;
+
+  int64_t arr = sc_alloc(b, (n + 1) * sizeof(t_io_redir *));
+  if (arr == -1)
+    return -1;
+
+  for (size_t i = 0; i < n; i++) {
+    t_io_redir *src = redirs[i];
+    if (src->hd_body)
+      return -1;
+
+    int64_t r = sc_alloc(b, sizeof(t_io_redir));
+    if (r == -1)
+      return -1;
+    t_io_redir rec = {.io_redir_type = src->io_redir_type,
+                      .filename = NULL,
+                      .hd_body = NULL,
+                      .src_fd = src->src_fd,
+                      .target_fd = src->target_fd,
+                      .hd_fd = -1};
+    memcpy(b->data + r, &rec, sizeof(rec));
+
+    if (src->filename) {
+      int64_t f = sc_bytes(b, src->filename, strlen(src->filename));
+      if (f == -1 || sc_ptr(b, r + offsetof(t_io_redir, filename), f) == -1)
+        return -1;
+    }
+    if (sc_ptr(b, arr + i * sizeof(t_io_redir *), r) == -1)
+      return -1;
+  }
+  return arr;
+}
+
+/**
+ * @brief emits node and its subtrees
+ * @return offset of node, 0 for NULL, -1 on fail
+ */
+static int64_t sc_node(t_sc_b *b, const t_ast_n *node) {
+  if (!node)
+    return 0;
+
+  int64_t slot = sc_alloc(b, sizeof(t_ast_n));
+  if (slot == -1)
+    return -1;
+
+  t_ast_n rec;
+  init_ast_node(&rec);
+  rec.tok_segment_len = node->tok_segment_len;
+  rec.background = node->background;
+  rec.op_type = node->op_type;
+  rec.redir_bool = node->redir_bool;
+  rec.items_len = node->items_len;
+  memcpy(b->data + slot, &rec, sizeof(rec));
+
+  int64_t left = sc_node(b, node->left);
+  int64_t right = sc_node(b, node->right);
+  int64_t sub = sc_node(b, node->sub_ast_root);
+  int64_t tok = sc_tok(b, node->tok_start);
+  int64_t var = sc_tok(b, node->for_var);
+  int64_t items = sc_tok(b, node->for_items);
+  int64_t redir = node->io_redir ? sc_redirs(b, node->io_redir) : 0;
+  if (left == -1 || right == -1 || sub == -1 || tok == -1 || var == -1 ||
+      items == -1 || redir == -1)
+    return -1;
+
+  if (sc_ptr(b, slot + offsetof(t_ast_n, left), left) == -1 ||
+      sc_ptr(b, slot + offsetof(t_ast_n, right), right) == -1 ||
+      sc_ptr(b, slot + offsetof(t_ast_n, sub_ast_root), sub) == -1 ||
+      sc_ptr(b, slot + offsetof(t_ast_n, tok_start), tok) == -1 ||
+      sc_ptr(b, slot + offsetof(t_ast_n, for_var), var) == -1 ||
+      sc_ptr(b, slot + offsetof(t_ast_n, for_items), items) == -1 ||
+      sc_ptr(b, slot + offsetof(t_ast_n, io_redir), redir) == -1)
+    return -1;
+
+  return slot;
+}
+
+/**
+ * @brief emits one parsed unit: text, token stream, AST and relocations
+ * @return 0 success, -1 if the unit cannot be expressed in the image
+ */
+static int sc_unit(t_sc_b *b, const char *text, t_token_stream *ts,
+                   t_ast_n *root, size_t lc) {
+  b->relocs_len = 0;
+
+  b->text_len = strlen(text);
+  int64_t text_off = sc_bytes(b, text, b->text_len);
+  if (text_off == -1)
+    return -1;
+
+  /* keep the empty sentinel tokens past the end the parser peeks at */
+  size_t ntoks = ts->tokens_arr_len + 2;
+  if (ntoks > ts->tokens_arr_cap)
+    ntoks = ts->tokens_arr_cap;
+  b->toks = ts->tokens;
+  b->toks_len = ntoks;
+  int64_t toks_off = sc_alloc(b, ntoks * sizeof(t_token));
+  if (toks_off == -1)
+    return -1;
+  b->toks_off = toks_off;
+
+  for (size_t i = 0; i < ntoks; i++) {
+    t_token rec = ts->tokens[i];
+    rec.start = NULL;
+    uint64_t slot = toks_off + i * sizeof(t_token);
+    memcpy(b->data + slot, &rec, sizeof(rec));
+
+    const char *start = ts->tokens[i].start;
+    if (!start)
+      continue;
+    if (start < text || start > text + b->text_len)
+      return -1;
+    if (sc_ptr(b, slot + offsetof(t_token, start),
+               text_off + (start - text)) == -1)
+      return -1;
+  }
+
+  int64_t root_off = sc_node(b, root);
+  if (root_off <= 0)
+    return -1;
+
+  int64_t relocs_off = sc_alloc(b, b->relocs_len * sizeof(uint64_t));
+  if (relocs_off == -1)
+    return -1;
+  memcpy(b->data + relocs_off, b->relocs, b->relocs_len * sizeof(uint64_t));
+
+  if (b->units_len == b->units_cap) {
+    size_t ncap = b->units_cap ? b->units_cap * BUF_GROWTH_FACTOR : 64;
+    t_sc_unit *nunits = realloc(b->units, ncap * sizeof(t_sc_unit));
+    if (!nunits)
+      return -1;
+    b->units = nunits;
+    b->units_cap = ncap;
+  }
+  b->units[b->units_len++] = (t_sc_unit){.lc = lc,
+                                         .text_off = text_off,
+                                         .root_off = root_off,
+                                         .relocs_off = relocs_off,
+                                         .relocs_len = b->relocs_len};
+  return 0;
+}
+
+/**
+ * @brief checks if a parse error only means the unit continues on later lines
+ * @return true for the errors exec_script keeps accumulating on silently
+ */
+static bool sc_incomplete_err(t_err_code err) {
+  switch ((int)err) {
+  case -1:
+  case ERR_UNBALANCED_PARENS:
+  case ERR_UNBALANCED_BRACES:
+  case ERR_UNBALANCED_TOKEN:
+  case ERR_MISSING_FI:
+  case ERR_MISSING_THEN:
+  case ERR_MISSING_DO:
+  case ERR_MISSING_DONE:
+  case ERR_MISSING_IN:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief lexes and parses every top level unit of script into b
+ * @return 0 success, -1 if the script is not cacheable
+ *
+ * Units are accumulated exactly like exec_script does (comments, trailing
+ * '\' and unbalanced quote continuation) so cached units match what a normal
+ * run would have executed.
+ */
+static int sc_build_units(t_shell *shell, t_script_src *script, t_sc_b *b) {
+  if (shell->aliases.count > 0)
+    return -1;
+
+  const char *line;
+  size_t line_len;
+  t_unit_buf unit = {0};
+  t_err_code last_err = -1;
+  int ret = 0;
+
+  while ((line = script_src_line(script, &line_len)) != NULL) {
+    const char *p = line;
+    while (p < line + line_len && isspace((unsigned char)*p))
+      p++;
+    if ((p == line + line_len || *p == '#') &&
+        last_err != ERR_UNBALANCED_QUOTES)
+      continue;
+
+    long off = unit_buf_append(&unit, line, line_len, &shell->arena);
+    if (off == -1) {
+      ret = -1;
+      break;
+    }
+
+    /* heredoc bodies are read from the script at run time */
+    if (strstr(unit.data + off, "<<")) {
+      ret = -1;
+      break;
+    }
+
+    size_t k = unit.len;
+    if (k >= 2 && unit.data[k - 2] == '\\') {
+      unit.len -= 2;
+      unit.data[unit.len] = '\0';
+      continue;
+    }
+
+    if (!unit_buf_lex(&unit, &shell->arena, &last_err))
+      continue;
+
+    t_region *p_mark;
+    size_t off_mark;
+    arena_get_mark(&shell->arena, &p_mark, &off_mark);
+    t_ast_n *root = build_ast(&shell->ast, &unit.ts, &shell->arena, &last_err);
+
+    if (!root) {
+      arena_rollback(&shell->arena, p_mark, off_mark);
+      if (sc_incomplete_err(last_err))
+        continue;
+      ret = -1;
+      break;
+    }
+
+    if (sc_unit(b, unit.data, &unit.ts, root, script->lc) == -1) {
+      ret = -1;
+      break;
+    }
+    unit = (t_unit_buf){0};
+    arena_reset(&shell->arena);
+  }
+
+  if (unit.data != NULL)
+    ret = -1;
+
+  shell->ast.root = NULL;
+  arena_reset(&shell->arena);
+  return ret;
+}
+
+/**
+ * @typedef struct s_sc_chk t_sc_chk
+ * @brief state of the walk checking the units of an unrelocated image.
+ */
+typedef struct s_sc_chk {
+  const char *base;
+  size_t size;
+  uint8_t *all; ///< bit per pointer slot, set if any unit relocates it
+  uint8_t *rel; ///< bit per pointer slot, set if the unit walked relocates it
+  size_t nodes; ///< nodes left before the walk gives up
+} t_sc_chk;
+
+static bool bit_get(const uint8_t *bits, uint64_t slot) {
+  slot /= sizeof(uintptr_t);
+  return bits[slot / 8] & (1u << (slot % 8));
+}
+
+static void bit_put(uint8_t *bits, uint64_t slot, bool on) {
+  slot /= sizeof(uintptr_t);
+  if (on)
+    bits[slot / 8] |= 1u << (slot % 8);
+  else
+    bits[slot / 8] &= ~(1u << (slot % 8));
+}
+
+/**
+ * @brief checks no relocation lands in the n bytes at off besides the
+ * pointer slots at the offsets in ptrs
+ */
+static bool chk_plain(const t_sc_chk *c, uint64_t off, size_t n,
+                      const size_t *ptrs, size_t nptrs) {
+  for (uint64_t w = off & ~(uint64_t)(sizeof(uintptr_t) - 1); w < off + n;
+       w += sizeof(uintptr_t)) {
+    if (!bit_get(c->all, w))
+      continue;
+    size_t i = 0;
+    while (i < nptrs && off + ptrs[i] != w)
+      i++;
+    if (i == nptrs)
+      return false;
+  }
+  return true;
+}
+
+/** @brief checks a NUL terminated string at off is left alone by relocation */
+static bool chk_str(const t_sc_chk *c, uint64_t off) {
+  const char *nul = memchr(c->base + off, '\0', c->size - off);
+  return nul && chk_plain(c, off, nul - (c->base + off) + 1, NULL, 0);
+}
+
+/**
+ * @brief reads the pointer in slot, which must be NULL or relocated by the
+ * unit to n bytes inside the image
+ * @return false if it is neither, *off is 0 for NULL.
+ */
+static bool chk_ptr(const t_sc_chk *c, uint64_t slot, size_t align, size_t n,
+                    uint64_t *off) {
+  uintptr_t v;
+  memcpy(&v, c->base + slot, sizeof(v));
+  *off = v;
+  if (v == 0)
+    return !bit_get(c->all, slot);
+  return bit_get(c->rel, slot) && v % align == 0 && v < c->size &&
+         n <= c->size - v;
+}
+
+/** @brief checks n tokens, each naming len bytes of the image */
+static bool chk_toks(const t_sc_chk *c, uint64_t slot, size_t n) {
+  static const size_t ptrs[] = {offsetof(t_token, start)};
+  uint64_t off;
+  if (n > c->size / sizeof(t_token) ||
+      !chk_ptr(c, slot, sizeof(uintptr_t), n * sizeof(t_token), &off))
+    return false;
+  if (!off)
+    return n == 0;
+
+  for (size_t i = 0; i < n; i++) {
+    uint64_t tok = off + i * sizeof(t_token);
+    t_token rec;
+    memcpy(&rec, c->base + tok, sizeof(rec));
+    uint64_t start;
+    if ((unsigned)rec.type > TOKEN_NEWLINE ||
+        !chk_plain(c, tok, sizeof(rec), ptrs, 1) ||
+        !chk_ptr(c, tok + offsetof(t_token, start), 1, rec.len, &start) ||
+        (!start && rec.len))
+      return false;
+  }
+  return true;
+}
+
+static bool chk_redirs(const t_sc_chk *c, uint64_t slot) {
+  static const size_t ptrs[] = {offsetof(t_io_redir, filename)};
+  uint64_t arr;
+  if (!chk_ptr(c, slot, sizeof(uintptr_t), sizeof(uintptr_t), &arr))
+    return false;
+
+  for (uint64_t i = arr; arr; i += sizeof(uintptr_t)) {
+    uint64_t off;
+    if (i > c->size - sizeof(uintptr_t) ||
+        !chk_ptr(c, i, sizeof(uintptr_t), sizeof(t_io_redir), &off))
+      return false;
+    if (!off)
+      break;
+
+    t_io_redir rec;
+    memcpy(&rec, c->base + off, sizeof(rec));
+    uint64_t name;
+    if ((unsigned)rec.io_redir_type > IO_FORCE_OW || rec.hd_body ||
+        rec.hd_fd != -1 || rec.hd_fd_body ||
+        !chk_plain(c, off, sizeof(rec), ptrs, 1) ||
+        !chk_ptr(c, off + offsetof(t_io_redir, filename), 1, 1, &name) ||
+        (name && !chk_str(c, name)))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief checks a node and its subtrees the way snapshot.c's get_node checks
+ * a record, since the executor trusts the lengths it finds
+ */
+static bool chk_node(t_sc_chk *c, uint64_t off) {
+  static const size_t ptrs[] = {
+      offsetof(t_ast_n, tok_start), offsetof(t_ast_n, io_redir),
+      offsetof(t_ast_n, left),      offsetof(t_ast_n, right),
+      offsetof(t_ast_n, sub_ast_root), offsetof(t_ast_n, for_var),
+      offsetof(t_ast_n, for_items)};
+  if (c->nodes-- == 0)
+    return false;
+
+  t_ast_n n;
+  memcpy(&n, c->base + off, sizeof(n));
+  bool static_ok = n.static_toks == STATIC_ARGV_UNSET
+                       ? n.static_argc == 0
+                       : n.static_toks <= n.tok_segment_len &&
+                             n.static_argc <= n.static_toks;
+  if ((unsigned)n.op_type > OP_FUN || n.cmd_kind != CMD_UNRESOLVED ||
+      n.cmd_target || !static_ok ||
+      !chk_plain(c, off, sizeof(n), ptrs, sizeof(ptrs) / sizeof(*ptrs)))
+    return false;
+
+  if (!chk_toks(c, off + offsetof(t_ast_n, tok_start), n.tok_segment_len) ||
+      !chk_toks(c, off + offsetof(t_ast_n, for_var), n.for_var ? 1 : 0) ||
+      !chk_toks(c, off + offsetof(t_ast_n, for_items), n.items_len) ||
+      !chk_redirs(c, off + offsetof(t_ast_n, io_redir)))
+    return false;
+
+  const size_t kids[] = {offsetof(t_ast_n, left), offsetof(t_ast_n, right),
+                         offsetof(t_ast_n, sub_ast_root)};
+  for (size_t i = 0; i < sizeof(kids) / sizeof(*kids); i++) {
+    uint64_t kid;
+    if (!chk_ptr(c, off + kids[i], sizeof(uintptr_t), sizeof(t_ast_n), &kid) ||
+        (kid && !chk_node(c, kid)))
+      return false;
+  }
+  return true;
+}
+
+/** @brief walks a unit's AST with its own relocations marked */
+static bool chk_unit(t_sc_chk *c, const t_sc_unit *u) {
+  const uint64_t *relocs = (const uint64_t *)(c->base + u->relocs_off);
+  for (size_t r = 0; r < u->relocs_len; r++)
+    bit_put(c->rel, relocs[r], true);
+
+  // a tree has one incoming pointer per node besides the root
+  c->nodes = u->relocs_len + 1;
+  bool ok = u->root_off % sizeof(uintptr_t) == 0 &&
+            chk_str(c, u->text_off) && chk_node(c, u->root_off);
+
+  for (size_t r = 0; r < u->relocs_len; r++)
+    bit_put(c->rel, relocs[r], false);
+  return ok;
+}
+
+/**
+ * @brief marks every relocation of the image in c->all
+ * @return false if a slot is misaligned, out of bounds, relocated twice or
+ * inside the header, unit table or a relocation list.
+ */
+static bool chk_relocs(t_sc_chk *c, const t_script_cache *sc) {
+  for (size_t i = 0; i < sc->units_len; i++) {
+    const t_sc_unit *u = &sc->units[i];
+    const uint64_t *relocs = (const uint64_t *)(c->base + u->relocs_off);
+    for (size_t r = 0; r < u->relocs_len; r++) {
+      uint64_t slot = relocs[r];
+      if (slot % sizeof(uintptr_t) || slot > c->size - sizeof(uintptr_t) ||
+          bit_get(c->all, slot))
+        return false;
+      bit_put(c->all, slot, true);
+    }
+  }
+
+  if (!chk_plain(c, 0, sizeof(t_sc_hdr), NULL, 0) ||
+      !chk_plain(c, (const char *)sc->units - c->base,
+                 sc->units_len * sizeof(t_sc_unit), NULL, 0))
+    return false;
+  for (size_t i = 0; i < sc->units_len; i++)
+    if (!chk_plain(c, sc->units[i].relocs_off,
+                   sc->units[i].relocs_len * sizeof(uint64_t), NULL, 0))
+      return false;
+  return true;
+}
+
+/**
+ * @brief checks the unit table of an image against its size, then each
+ * unit's relocations and AST
+ * @return 0 if every unit is sound, -1 otherwise
+ */
+static int sc_check_units(t_script_cache *sc) {
+  for (size_t i = 0; i < sc->units_len; i++) {
+    t_sc_unit *u = &sc->units[i];
+    if (u->text_off >= sc->size ||
+        !memchr(sc->base + u->text_off, '\0', sc->size - u->text_off))
+      return -1;
+    if (sc->size < sizeof(t_ast_n) || u->root_off > sc->size - sizeof(t_ast_n))
+      return -1;
+    if (u->relocs_off > sc->size || u->relocs_off % sizeof(uint64_t) ||
+        u->relocs_len > (sc->size - u->relocs_off) / sizeof(uint64_t))
+      return -1;
+  }
+
+  size_t bytes = sc->size / sizeof(uintptr_t) / 8 + 1;
+  t_sc_chk c = {.base = sc->base, .size = sc->size};
+  c.all = calloc(bytes, 1);
+  c.rel = calloc(bytes, 1);
+  int ret = c.all && c.rel && chk_relocs(&c, sc) ? 0 : -1;
+  for (size_t i = 0; ret == 0 && i < sc->units_len; i++)
+    if (!chk_unit(&c, &sc->units[i]))
+      ret = -1;
+  free(c.all);
+  free(c.rel);
+  return ret;
+}
+
+static int sc_attach(t_script_cache *sc, char *base, size_t size) {
+  t_sc_hdr *hdr = (t_sc_hdr *)base;
+  sc->base = base;
+  sc->size = size;
+  if (hdr->units_off > size ||
+      hdr->units_len > (size - hdr->units_off) / sizeof(t_sc_unit))
+    return -1;
+  sc->units = (t_sc_unit *)(base + hdr->units_off);
+  sc->units_len = hdr->units_len;
+  return sc_check_units(sc);
+}
+
+static int sc_load(const char *path, const t_sc_key *key,
+                   const t_sc_key *build, t_script_cache *sc) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(t_sc_hdr)) {
+    close(fd);
+    return -1;
+  }
+
+  size_t size = st.st_size;
+  char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+
+  t_sc_hdr *hdr = (t_sc_hdr *)base;
+  sc->mapped = true;
+  if (hdr->magic != SC_MAGIC || hdr->version != SC_VERSION ||
+      hdr->node_size != sizeof(t_ast_n) || hdr->tok_size != sizeof(t_token) ||
+      hdr->size != size || !key_eq(&hdr->script, key) ||
+      !key_eq(&hdr->build, build) || sc_attach(sc, base, size) == -1) {
+    munmap(base, size);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief writes image atomically to path, failures leave no partial file
+ */
+static void sc_store(const char *path, const char *data, size_t len) {
+  char tmp[PATH_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+    return;
+
+  int fd = mkstemp(tmp);
+  if (fd == -1)
+    return;
+
+  size_t off = 0;
+  while (off < len) {
+    ssize_t w = write(fd, data + off, len - off);
+    if (w == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    off += w;
+  }
+
+  if (close(fd) == -1 || off != len || rename(tmp, path) == -1)
+    unlink(tmp);
+}
+
+int script_cache_get(t_shell *shell, t_script_src *script,
+                     t_script_cache *sc) {
+  struct stat exe;
+  if (!S_ISREG(script->st.st_mode) || stat("/proc/self/exe", &exe) == -1)
+    return -1;
+
+  t_sc_key key, build;
+  key_of_stat(&key, &script->st);
+  key_of_stat(&build, &exe);
+
+  const char *dir = getenv_local_ref(&shell->env, SC_ENV_VAR);
+  char path[PATH_MAX];
+  int n = snprintf(path, sizeof(path), "%s/%llx-%llx.mshc", dir,
+                   (unsigned long long)key.dev, (unsigned long long)key.ino);
+  if (n < 0 || n >= (int)sizeof(path))
+    return -1;
+
+  if (sc_load(path, &key, &build, sc) == 0)
+    return 0;
+
+  t_sc_b b;
+  memset(&b, 0, sizeof(b));
+  int ret = -1;
+  if (sc_alloc(&b, sizeof(t_sc_hdr)) == 0 &&
+      sc_build_units(shell, script, &b) == 0) {
+    int64_t units_off = sc_alloc(&b, b.units_len * sizeof(t_sc_unit));
+    if (units_off != -1) {
+      if (b.units_len)
+        memcpy(b.data + units_off, b.units, b.units_len * sizeof(t_sc_unit));
+      t_sc_hdr hdr = {.magic = SC_MAGIC,
+                      .version = SC_VERSION,
+                      .node_size = sizeof(t_ast_n),
+                      .tok_size = sizeof(t_token),
+                      .script = key,
+                      .build = build,
+                      .units_off = units_off,
+                      .units_len = b.units_len,
+                      .size = b.len};
+      memcpy(b.data, &hdr, sizeof(hdr));
+      sc_store(path, b.data, b.len);
+
+      sc->mapped = false;
+      ret = sc_attach(sc, b.data, b.len);
+    }
+  }
+
+  free(b.relocs);
+  free(b.units);
+  if (ret == -1)
+    free(b.data);
+  script_src_rewind(script);
+  return ret;
+}
+
+const char *script_cache_text(t_script_cache *sc, size_t i) {
+  return sc->base + sc->units[i].text_off;
+}
+
+t_ast_n *script_cache_unit(t_script_cache *sc, size_t i, char **text) {
+  t_sc_unit *u = &sc->units[i];
+  const uint64_t *relocs = (const uint64_t *)(sc->base + u->relocs_off);
+
+  for (size_t r = 0; r < u->relocs_len; r++) {
+    uint64_t slot = relocs[r];
+    if (slot % sizeof(uintptr_t) || slot > sc->size - sizeof(uintptr_t))
+      return NULL;
+
+    uintptr_t v;
+    memcpy(&v, sc->base + slot, sizeof(v));
+    if (v >= sc->size)
+      return NULL;
+    v = (uintptr_t)(sc->base + v);
+    memcpy(sc->base + slot, &v, sizeof(v));
+  }
+
+  *text = sc->base + u->text_off;
+  return (t_ast_n *)(sc->base + u->root_off);
+}
+
+void script_cache_release(t_script_cache *sc) {
+  if (sc->mapped)
+    munmap(sc->base, sc->size);
+  else
+    free(sc->base);
+  sc->base = NULL;
+  sc->units = NULL;
+  sc->units_len = 0;
+}
@@ -0,0 +1,162 @@
+#include "script_src.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @file script_src.c
+ * @brief implementation of the script loader.
+ *
+ * Scripts are read rather than mmap'd: a script that truncates or rewrites
+ * itself while running would fault a mapping with SIGBUS.
+ */
+
+#define SRC_READ_BLOCK 65536
+#define UNIT_BUF_MIN 256
+
+/**
+ * @brief reads the regular file fd to its end into a heap buffer
+ * @return 0 success, -1 fail
+ *
+ * The buffer is sized from fstat, so a script costs a single allocation and
+ * a couple of read calls; a file that grew since is still read to its end.
+ */
+static int read_whole(t_script_src *src, int fd) {
+  size_t cap = SRC_READ_BLOCK;
+  if ((size_t)src->st.st_size >= cap)
+    cap = (size_t)src->st.st_size + 1;
+  char *buf = malloc(cap);
+  if (!buf)
+    return -1;
+
+  size_t len = 0;
+  for (;;) {
+    if (len == cap) {
+      char *nbuf = realloc(buf, cap * 2);
+      if (!nbuf) {
+        free(buf);
+        return -1;
+      }
+      buf = nbuf;
+      cap *= 2;
+    }
+    ssize_t n = read(fd, buf + len, cap - len);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      free(buf);
+      return -1;
+    }
+    if (n == 0)
+      break;
+    len += (size_t)n;
+  }
+
+  src->data = buf;
+  src->len = len;
+  return 0;
+}
+
+int script_src_open(t_script_src *src, const char *path) {
+  memset(src, 0, sizeof(*src));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  if (fstat(fd, &src->st) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  // reading a pipe to its end would wait for the writer to finish
+  if (!S_ISREG(src->st.st_mode)) {
+    src->stream = fdopen(fd, "r");
+    if (!src->stream) {
+      int err = errno;
+      close(fd);
+      errno = err;
+      return -1;
+    }
+    return 0;
+  }
+
+  int ret = read_whole(src, fd);
+  int err = errno;
+  close(fd);
+  errno = err;
+  return ret;
+}
+
+const char *script_src_line(t_script_src *src, size_t *len) {
+  if (src->stream) {
+    ssize_t n = getline(&src->line, &src->line_cap, src->stream);
+    if (n == -1)
+      return NULL;
+    *len = (size_t)n;
+    src->lc++;
+    return src->line;
+  }
+
+  if (src->pos >= src->len)
+    return NULL;
+
+  const char *line = src->data + src->pos;
+  size_t rem = src->len - src->pos;
+  const char *nl = memchr(line, '\n', rem);
+  *len = nl ? (size_t)(nl - line) + 1 : rem;
+
+  src->pos += *len;
+  src->lc++;
+  return line;
+}
+
+void script_src_rewind(t_script_src *src) {
+  src->pos = 0;
+  src->lc = 0;
+}
+
+void script_src_close(t_script_src *src) {
+  if (src->stream)
+    fclose(src->stream);
+  src->stream = NULL;
+  free(src->line);
+  src->line = NULL;
+  free(src->data);
+  src->data = NULL;
+  src->len = 0;
+}
+
+long unit_buf_append(t_unit_buf *ub, const char *s, size_t n, t_arena *a) {
+  if (ub->len + n + 1 > ub->cap) {
+    size_t ncap = ub->cap ? ub->cap : UNIT_BUF_MIN;
+    while (ncap < ub->len + n + 1)
+      ncap *= 2;
+    char *nbuf = arena_realloc(a, ub->data, ncap, ub->data ? ub->len + 1 : 0);
+    if (!nbuf)
+      return -1;
+    if (ub->data && ub->ts.tokens)
+      rebase_token_stream(&ub->ts, ub->data, nbuf);
+    ub->data = nbuf;
+    ub->cap = ncap;
+  }
+
+  long off = (long)ub->len;
+  memcpy(ub->data + ub->len, s, n);
+  ub->len += n;
+  ub->data[ub->len] = '\0';
+  return off;
+}
+
+bool unit_buf_lex(t_unit_buf *ub, t_arena *a, t_err_code *last_err) {
+  if (!ub->ts.tokens) {
+    init_token_stream(&ub->ts, a);
+    init_lex_state(&ub->lex);
+  }
+  *last_err = -1;
+  if (lex_resume(ub->data, &ub->lex, &ub->ts, a, last_err) == -1)
+    return false;
+  return ub->lex.nest <= 0;
+}
@@ -0,0 +1,115 @@
+#include "spawn_cmd.h"
+#include "handle_io_redir.h"
+#include "hashtable.h"
+#include "path_cache.h"
+#include "var_exp.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @file spawn_cmd.c
+ * @brief implementation of the posix_spawn launch path for external commands.
+ */
+
+const char *resolve_cmd_path(t_shell *shell, const char *name) {
+  if (strchr(name, '/'))
+    return name;
+
+  return path_lookup(shell, name);
+}
+
+/**
+ * @brief mirrors init_ch_sigtable and child_join_pgrp as spawn attributes
+ * @return 0 success, posix_spawn error code on fail
+ */
+static int init_spawn_attr(t_shell *shell, t_job *job,
+                           posix_spawnattr_t *attr) {
+  sigset_t dfl;
+  sigemptyset(&dfl);
+  sigaddset(&dfl, SIGINT);
+  sigaddset(&dfl, SIGQUIT);
+  sigaddset(&dfl, SIGTSTP);
+  sigaddset(&dfl, SIGTTOU);
+  sigaddset(&dfl, SIGTTIN);
+  sigaddset(&dfl, SIGCHLD);
+
+  short flags = POSIX_SPAWN_SETSIGDEF;
+  int err = posix_spawnattr_setsigdefault(attr, &dfl);
+  if (err != 0)
+    return err;
+
+  if (shell->job_control_flag && !shell->exec_ctx.is_subshell) {
+    flags |= POSIX_SPAWN_SETPGROUP;
+    err = posix_spawnattr_setpgroup(attr, job->pgid == -1 ? 0 : job->pgid);
+    if (err != 0)
+      return err;
+  }
+
+  return posix_spawnattr_setflags(attr, flags);
+}
+
+/**
+ * @brief replays pipe wiring and node redirections as file actions
+ * @return 0 success, -1 if io cannot be expressed as file actions
+ */
+static int init_spawn_fa(const t_spawn_io *io, posix_spawn_file_actions_t *fa) {
+  if (io->in_fd != -1 &&
+      posix_spawn_file_actions_adddup2(fa, io->in_fd, STDIN_FILENO) != 0)
+    return -1;
+  if (io->out_fd != -1 &&
+      posix_spawn_file_actions_adddup2(fa, io->out_fd, STDOUT_FILENO) != 0)
+    return -1;
+
+  for (int j = 0; j < io->pipes_len; j++) {
+    for (int k = 0; k < 2; k++) {
+      int fd = io->pipes[j][k];
+      if (fd > STDERR_FILENO && posix_spawn_file_actions_addclose(fa, fd) != 0)
+        return -1;
+    }
+  }
+
+  if (io->redir_node && io->redir_node->redir_bool &&
+      redir_file_actions(fa, io->redir_node) == -1)
+    return -1;
+
+  return 0;
+}
+
+pid_t spawn_cmd(t_shell *shell, t_job *job, const char *path, char **argv,
+                const t_spawn_io *io) {
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t fa;
+  pid_t pid = -1;
+
+  int err = posix_spawnattr_init(&attr);
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+  err = posix_spawn_file_actions_init(&fa);
+  if (err != 0) {
+    posix_spawnattr_destroy(&attr);
+    errno = err;
+    return -1;
+  }
+
+  err = init_spawn_attr(shell, job, &attr);
+  if (err == 0 && io && init_spawn_fa(io, &fa) == -1)
+    err = EINVAL;
+
+  if (err == 0) {
+    char **env = get_envp(shell);
+    err = posix_spawn(&pid, path, &fa, &attr, argv, env);
+  }
+
+  posix_spawn_file_actions_destroy(&fa);
+  posix_spawnattr_destroy(&attr);
+
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+  return pid;
+}
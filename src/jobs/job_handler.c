@@ -29,7 +29,7 @@ int add_job(t_shell *shell, t_job *job) {
     return -1;
 
   size_t i;
-  for (i = 0; i < shell->job_table_cap; i++) {
+  for (i = shell->job_free_hint; i < shell->job_table_cap; i++) {
     if (shell->job_table[i] == NULL)
       break;
   }
@@ -44,37 +44,52 @@ int add_job(t_shell *shell, t_job *job) {
 
   shell->job_table[i] = job;
   shell->job_count++;
+  shell->job_free_hint = i + 1;
+  job->slot = i;
   job->job_id = shell->next_job_id++;
 
   return 0;
 }
 
-int del_job(t_shell *shell, int job_id, bool flow) {
-
-  if (!shell || job_id <= 0)
-    return -1;
-
-  size_t i;
-  int found = 0;
-
-  for (i = 0; i < shell->job_table_cap; i++) {
-
-    if (shell->job_table[i] == NULL)
-      continue;
+static void unqueue_done_job(t_shell *shell, t_job *job) {
+  if (!job->done_queued)
+    return;
+  if (job->done_prev)
+    job->done_prev->done_next = job->done_next;
+  else
+    shell->done_jobs = job->done_next;
+  if (job->done_next)
+    job->done_next->done_prev = job->done_prev;
+  job->done_prev = NULL;
+  job->done_next = NULL;
+  job->done_queued = 0;
+}
 
-    if (shell->job_table[i]->job_id == job_id) {
-      found = 1;
-      break;
-    }
-  }
+void mark_job_completed(t_shell *shell, t_job *job) {
+  job->state = S_COMPLETED;
+  if (job->done_queued)
+    return;
+  job->done_prev = NULL;
+  job->done_next = shell->done_jobs;
+  if (shell->done_jobs)
+    shell->done_jobs->done_prev = job;
+  shell->done_jobs = job;
+  job->done_queued = 1;
+}
 
-  if (found == 0) {
+int remove_job(t_shell *shell, t_job *job) {
+  if (!shell || !job || job->slot >= shell->job_table_cap ||
+      shell->job_table[job->slot] != job)
     return -1;
-  }
 
-  cleanup_job_struct(shell->job_table[i]);
-  free(shell->job_table[i]);
+  size_t i = job->slot;
+  unqueue_done_job(shell, job);
+  unindex_job(shell, job);
+  cleanup_job_struct(job);
+  free(job);
   shell->job_table[i] = NULL;
+  if (i < shell->job_free_hint)
+    shell->job_free_hint = i;
 
   shell->job_count--;
   if (is_job_table_empty(shell))
@@ -83,6 +98,14 @@ int del_job(t_shell *shell, int job_id, bool flow) {
   return 0;
 }
 
+int del_job(t_shell *shell, int job_id, bool flow) {
+
+  if (!shell || job_id <= 0)
+    return -1;
+
+  return remove_job(shell, find_job(shell, job_id));
+}
+
 int reset_job_table_cap(t_shell *shell) {
 
   if (!is_job_table_empty(shell)) {
@@ -105,6 +128,7 @@ int reset_job_table_cap(t_shell *shell) {
     shell->job_table[i] = NULL;
 
   shell->job_table_cap = INITIAL_JOB_TABLE_LENGTH;
+  shell->job_free_hint = 0;
 
   return 0;
 }
@@ -138,11 +162,70 @@ int is_job_stopped(t_job *job) {
   return 0;
 }
 
-int add_process_to_job(t_job *job, t_process *process) {
+static size_t pid_bucket(pid_t pid, size_t cap) {
+  return ((size_t)pid * 2654435761u) & (cap - 1);
+}
+
+/**
+ * @brief doubles the pid index once it holds as many processes as buckets
+ * @return 0 success, -1 fail (the index keeps working, just with longer
+ * chains)
+ */
+static int grow_pid_index(t_shell *shell) {
+  size_t ncap = shell->pid_index_cap * BUF_GROWTH_FACTOR;
+  t_process **nidx = (t_process **)calloc(ncap, sizeof(t_process *));
+  if (!nidx)
+    return -1;
+
+  for (size_t i = 0; i < shell->pid_index_cap; i++) {
+    t_process *p = shell->pid_index[i];
+    while (p) {
+      t_process *next = p->hnext;
+      size_t b = pid_bucket(p->pid, ncap);
+      p->hnext = nidx[b];
+      nidx[b] = p;
+      p = next;
+    }
+  }
+
+  free(shell->pid_index);
+  shell->pid_index = nidx;
+  shell->pid_index_cap = ncap;
+  return 0;
+}
+
+static void index_process(t_shell *shell, t_process *process) {
+  if (shell->pid_index_len >= shell->pid_index_cap)
+    grow_pid_index(shell);
+
+  size_t b = pid_bucket(process->pid, shell->pid_index_cap);
+  process->hnext = shell->pid_index[b];
+  shell->pid_index[b] = process;
+  shell->pid_index_len++;
+}
+
+void unindex_job(t_shell *shell, t_job *job) {
+  for (t_process *p = job->processes; p; p = p->next) {
+    size_t b = pid_bucket(p->pid, shell->pid_index_cap);
+    t_process **link = &shell->pid_index[b];
+    while (*link && *link != p)
+      link = &(*link)->hnext;
+    if (*link) {
+      *link = p->hnext;
+      shell->pid_index_len--;
+    }
+    p->hnext = NULL;
+  }
+}
+
+int add_process_to_job(t_shell *shell, t_job *job, t_process *process) {
 
   if (!job)
     return -1;
 
+  process->job = job;
+  index_process(shell, process);
+
   t_process *head = job->processes;
   if (head == NULL) {
 
@@ -165,17 +248,15 @@ int add_process_to_job(t_job *job, t_process *process) {
 
 int mark_job_state(t_shell *shell, int job_id, t_state state) {
 
-  for (size_t i = 0; i < shell->job_table_cap; i++) {
-    if (shell->job_table[i] == NULL)
-      continue;
-
-    if (shell->job_table[i]->job_id == job_id) {
-      shell->job_table[i]->state = state;
-      return 0;
-    }
-  }
+  t_job *job = find_job(shell, job_id);
+  if (!job)
+    return -1;
 
-  return -1;
+  if (state == S_COMPLETED)
+    mark_job_completed(shell, job);
+  else
+    job->state = state;
+  return 0;
 }
 
 int move_job_position(t_shell *shell, int job_id, t_position pos) {
@@ -224,23 +305,16 @@ t_job *find_job(t_shell *shell, int job_id) {
   return NULL;
 }
 
-t_job *find_job_by_pid(t_shell *shell, pid_t pid) {
-
-  for (size_t i = 0; i < shell->job_table_cap; i++) {
-    if (shell->job_table[i] == NULL)
-      continue;
-
-    t_job *in_job = shell->job_table[i];
-    t_process *process = in_job->processes;
-    while (process) {
-      if (process->pid == pid) {
-        return in_job;
-      }
-      process = process->next;
-    }
-  }
+t_process *find_process_by_pid(t_shell *shell, pid_t pid) {
+  t_process *p = shell->pid_index[pid_bucket(pid, shell->pid_index_cap)];
+  while (p && p->pid != pid)
+    p = p->hnext;
+  return p;
+}
 
-  return NULL;
+t_job *find_job_by_pid(t_shell *shell, pid_t pid) {
+  t_process *p = find_process_by_pid(shell, pid);
+  return p ? p->job : NULL;
 }
 
 t_process *find_process_in_job(t_job *job, pid_t pid) {
@@ -15,6 +15,11 @@ int init_job_struct(t_job *job) {
 
   job->last_pid = -1;
 
+  job->slot = 0;
+  job->done_queued = 0;
+  job->done_prev = NULL;
+  job->done_next = NULL;
+
   job->depth = 0;
   job->last_exit_status = -1;
 
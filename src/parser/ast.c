@@ -1,4 +1,5 @@
 #include "ast.h"
+#include <unistd.h>
 
 /**
  * @brief initializes ast node
@@ -28,6 +29,13 @@ int init_ast_node(t_ast_n *ast_node) {
   ast_node->for_items = NULL;
   ast_node->items_len = 0;
 
+  ast_node->static_toks = STATIC_ARGV_UNSET;
+  ast_node->static_argc = 0;
+
+  ast_node->cmd_kind = CMD_UNRESOLVED;
+  ast_node->cmd_target = NULL;
+  ast_node->cmd_gen = 0;
+
   return 0;
 }
 
@@ -68,6 +76,8 @@ static t_io_redir **clone_io_redir(t_io_redir **src) {
     dst[i]->src_fd = src[i]->src_fd;
     dst[i]->target_fd = src[i]->target_fd;
     dst[i]->hd_body = src[i]->hd_body ? strdup(src[i]->hd_body) : NULL;
+    dst[i]->hd_fd = -1;
+    dst[i]->hd_fd_body = NULL;
   }
   dst[n] = NULL;
   return dst;
@@ -173,6 +183,8 @@ static t_ast_n *copy_lpr(const t_ast_n *src, t_copy_ctx *ctx) {
   dst->redir_bool = src->redir_bool;
   dst->tok_segment_len = src->tok_segment_len;
   dst->items_len = src->items_len;
+  dst->static_toks = src->static_toks;
+  dst->static_argc = src->static_argc;
 
   dst->left = copy_lpr(src->left, ctx);
 
@@ -250,6 +262,8 @@ static void free_io_redir(t_io_redir **redir) {
   if (!redir)
     return;
   for (size_t i = 0; redir[i]; i++) {
+    if (redir[i]->hd_fd != -1)
+      close(redir[i]->hd_fd);
     free(redir[i]->filename);
     free(redir[i]->hd_body); // can be null
     free(redir[i]);
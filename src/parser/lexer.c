@@ -1,6 +1,11 @@
 #include "lexer.h"
 #include "arena.h"
 #include "shell.h"
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 int init_token_stream(t_token_stream *token_stream, t_arena *a) {
 
@@ -18,124 +23,219 @@ int init_token_stream(t_token_stream *token_stream, t_arena *a) {
   return 0;
 }
 
+/** @brief flags of g_lex_class */
+#define LEX_STOP 1  ///< ends a run of plain word bytes
+#define LEX_DELIM 2 ///< ends a word before a brace, see is_delim
+#define LEX_OP 4    ///< may start an operator token
+
+/** @brief character classes, so the hot loop tests one table load per byte */
+static const unsigned char g_lex_class[256] = {
+    ['\0'] = LEX_STOP | LEX_DELIM,
+    ['\t'] = LEX_STOP | LEX_DELIM,
+    ['\n'] = LEX_STOP | LEX_DELIM | LEX_OP,
+    [' '] = LEX_STOP | LEX_DELIM,
+    ['"'] = LEX_STOP,
+    ['#'] = LEX_STOP,
+    ['&'] = LEX_STOP | LEX_DELIM | LEX_OP,
+    ['\''] = LEX_STOP,
+    ['('] = LEX_STOP | LEX_OP,
+    [')'] = LEX_STOP | LEX_DELIM | LEX_OP,
+    [';'] = LEX_STOP | LEX_DELIM | LEX_OP,
+    ['<'] = LEX_STOP | LEX_OP,
+    ['>'] = LEX_STOP | LEX_OP,
+    ['\\'] = LEX_STOP,
+    ['{'] = LEX_STOP | LEX_OP,
+    ['|'] = LEX_STOP | LEX_DELIM | LEX_OP,
+    ['}'] = LEX_STOP | LEX_OP,
+};
+
 t_token_type get_token_type(const char *c, size_t *len) {
 
   if (!c || !len)
     return -1;
 
-  // depricate this - handle semantically
-  if (c[0] == '<' && c[1] == '<' && c[2] == '-') {
-    *len = 3;
-    return TOKEN_HEREDOC_STRIP;
-  }
+  *len = 1;
+  if (!(g_lex_class[(unsigned char)c[0]] & LEX_OP))
+    return TOKEN_SIMPLE;
 
-  // lex 2 operators
-  if (c[0] == '|' && c[1] == '|') {
-    *len = 2;
-    return TOKEN_OR;
-  }
-  if (c[0] == '&' && c[1] == '&') {
-    *len = 2;
-    return TOKEN_AND;
-  }
-  if (c[0] == '<' && c[1] == '>') {
-    *len = 2;
-    return TOKEN_READ_WRITE;
-  }
-  if (c[0] == '>' && c[1] == '>') {
-    *len = 2;
-    return TOKEN_APPEND;
-  }
-  if (c[0] == '>' && c[1] == '&') {
-    *len = 2;
-    return TOKEN_DUP_OUT;
-  }
-  if (c[0] == '<' && c[1] == '&') {
-    *len = 2;
-    return TOKEN_DUP_IN;
-  }
-  if (c[0] == '<' && c[1] == '<') {
-    *len = 2;
-    return TOKEN_HEREDOC;
-  }
-  if (c[0] == '>' && c[1] == '|') {
-    *len = 2;
-    return TOKEN_FORCE_OW;
-  }
-
-  // len 1 operators
-  if (c[0] == '|') {
-    *len = 1;
+  switch (c[0]) {
+  case '|':
+    if (c[1] == '|') {
+      *len = 2;
+      return TOKEN_OR;
+    }
     return TOKEN_PIPE;
-  }
-  if (c[0] == '&') {
-    *len = 1;
+  case '&':
+    if (c[1] == '&') {
+      *len = 2;
+      return TOKEN_AND;
+    }
     return TOKEN_BG;
-  }
-  if (c[0] == '>') {
+  case '>':
+    *len = 2;
+    if (c[1] == '>')
+      return TOKEN_APPEND;
+    if (c[1] == '&')
+      return TOKEN_DUP_OUT;
+    if (c[1] == '|')
+      return TOKEN_FORCE_OW;
     *len = 1;
     return TOKEN_TRUNC;
-  }
-  if (c[0] == '<') {
+  case '<':
+    // depricate this - handle semantically
+    if (c[1] == '<' && c[2] == '-') {
+      *len = 3;
+      return TOKEN_HEREDOC_STRIP;
+    }
+    *len = 2;
+    if (c[1] == '>')
+      return TOKEN_READ_WRITE;
+    if (c[1] == '&')
+      return TOKEN_DUP_IN;
+    if (c[1] == '<')
+      return TOKEN_HEREDOC;
     *len = 1;
     return TOKEN_INPUT;
-  }
-  if (c[0] == '(') {
-    *len = 1;
+  case '(':
     return TOKEN_OPEN_PAR;
-  }
-  if (c[0] == ')') {
-    *len = 1;
+  case ')':
     return TOKEN_CLOSE_PAR;
-  }
-  if (c[0] == ';') {
-    *len = 1;
+  case ';':
     return TOKEN_SEQ;
-  }
-  if (c[0] == '\n') {
-    *len = 1;
+  case '\n':
     return TOKEN_NEWLINE;
-  }
-
-  if (c[0] == '{') {
-    *len = 1;
+  case '{':
     return TOKEN_LBRACE;
-  }
-  if (c[0] == '}') {
-    *len = 1;
+  case '}':
     return TOKEN_RBRACE;
   }
-
   return TOKEN_SIMPLE;
 }
 
+/** @brief perfect hash of the reserved words, distinct for all eleven */
+#define RESERVED_HASH(first, last) (((first) * 7 + (last)) & 15)
+
+typedef struct s_reserved {
+  const char *word;
+  size_t len;
+  t_token_type type;
+} t_reserved;
+
+static const t_reserved g_reserved[16] = {
+    [RESERVED_HASH('i', 'f')] = {"if", 2, TOKEN_IF},
+    [RESERVED_HASH('f', 'i')] = {"fi", 2, TOKEN_FI},
+    [RESERVED_HASH('d', 'o')] = {"do", 2, TOKEN_DO},
+    [RESERVED_HASH('i', 'n')] = {"in", 2, TOKEN_IN},
+    [RESERVED_HASH('f', 'r')] = {"for", 3, TOKEN_FOR},
+    [RESERVED_HASH('t', 'n')] = {"then", 4, TOKEN_THEN},
+    [RESERVED_HASH('e', 'e')] = {"else", 4, TOKEN_ELSE},
+    [RESERVED_HASH('e', 'f')] = {"elif", 4, TOKEN_ELIF},
+    [RESERVED_HASH('d', 'e')] = {"done", 4, TOKEN_DONE},
+    [RESERVED_HASH('w', 'e')] = {"while", 5, TOKEN_WHILE},
+    [RESERVED_HASH('u', 'l')] = {"until", 5, TOKEN_UNTIL},
+};
+
 t_token_type check_reserved_word(const char *start, size_t len) {
-  if (len == 2 && strncmp(start, "if", 2) == 0)
-    return TOKEN_IF;
-  if (len == 2 && strncmp(start, "fi", 2) == 0)
-    return TOKEN_FI;
-  if (len == 2 && strncmp(start, "do", 2) == 0)
-    return TOKEN_DO;
-  if (len == 4 && strncmp(start, "then", 4) == 0)
-    return TOKEN_THEN;
-  if (len == 4 && strncmp(start, "else", 4) == 0)
-    return TOKEN_ELSE;
-  if (len == 4 && strncmp(start, "elif", 4) == 0)
-    return TOKEN_ELIF;
-  if (len == 5 && strncmp(start, "while", 5) == 0)
-    return TOKEN_WHILE;
-  if (len == 4 && strncmp(start, "done", 4) == 0)
-    return TOKEN_DONE;
-  if (len == 3 && strncmp(start, "for", 3) == 0)
-    return TOKEN_FOR;
-  if (len == 2 && strncmp(start, "in", 2) == 0)
-    return TOKEN_IN;
-  if (len == 5 && strncmp(start, "until", 5) == 0)
-    return TOKEN_UNTIL;
+  if (len < 2 || len > 5)
+    return TOKEN_SIMPLE;
 
+  const t_reserved *r = &g_reserved[RESERVED_HASH(start[0], start[len - 1])];
+  if (r->len == len && memcmp(start, r->word, len) == 0)
+    return r->type;
   return TOKEN_SIMPLE;
 }
 
+/*
+ * Block scanners. A byte stops a word run when both its low and high nibble
+ * lookups share a bit: each bit stands for one high nibble (0x0, 0x2, 0x3,
+ * 0x5, 0x7) and is set in the low table for the stop bytes in that row. The
+ * nibble tables match the LEX_STOP entries of g_lex_class, NUL aside, which
+ * the scans never reach as they stop at the buffer end. pshufb needs SSSE3,
+ * so builds without it (all but prod's -march=native) use the table loop.
+ */
+#if defined(__AVX2__) || defined(__SSSE3__)
+#define NIB_LO                                                                 \
+  2, 0, 2, 2, 0, 0, 2, 2, 2, 3, 1, 20, 28, 16, 4, 0
+#define NIB_HI 1, 0, 2, 4, 0, 8, 0, 16, 0, 0, 0, 0, 0, 0, 0, 0
+#endif
+
+/** @brief length of the run of bytes at p without LEX_STOP, up to end */
+static size_t word_run(const char *p, const char *end) {
+  const char *s = p;
+
+#if defined(__AVX2__)
+  const __m256i lo = _mm256_setr_epi8(NIB_LO, NIB_LO);
+  const __m256i hi = _mm256_setr_epi8(NIB_HI, NIB_HI);
+  const __m256i nib = _mm256_set1_epi8(0x0f);
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nib));
+    __m256i h = _mm256_shuffle_epi8(
+        hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib));
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_and_si256(l, h),
+                                    _mm256_setzero_si256());
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(hit);
+    if (mask)
+      return p - s + __builtin_ctz(mask);
+    p += 32;
+  }
+#elif defined(__SSSE3__)
+  const __m128i lo = _mm_setr_epi8(NIB_LO);
+  const __m128i hi = _mm_setr_epi8(NIB_HI);
+  const __m128i nib = _mm_set1_epi8(0x0f);
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nib));
+    __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nib));
+    __m128i hit = _mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128());
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(hit) & 0xffff;
+    if (mask)
+      return p - s + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+  while (p < end && !(g_lex_class[(unsigned char)*p] & LEX_STOP))
+    p++;
+  return p - s;
+}
+
+/**
+ * @brief length of the run at p inside double quotes, to a " or \
+ *
+ * Two compares per block, so SSE2 is enough and every x86-64 build gets it.
+ */
+static size_t dquote_run(const char *p, const char *end) {
+  const char *s = p;
+
+#if defined(__AVX2__)
+  const __m256i dq32 = _mm256_set1_epi8('"');
+  const __m256i bs32 = _mm256_set1_epi8('\\');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(
+        _mm256_cmpeq_epi8(v, dq32), _mm256_cmpeq_epi8(v, bs32)));
+    if (mask)
+      return p - s + __builtin_ctz(mask);
+    p += 32;
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i dq = _mm_set1_epi8('"');
+  const __m128i bs = _mm_set1_epi8('\\');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, dq), _mm_cmpeq_epi8(v, bs)));
+    if (mask)
+      return p - s + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+  while (p < end && *p != '"' && *p != '\\')
+    p++;
+  return p - s;
+}
+
 static int check_realloc_toks_arr(t_token_stream *ts, size_t tok_count,
                                   t_arena *a) {
   if (tok_count + 2 < ts->tokens_arr_cap)
@@ -203,23 +303,21 @@ static int expand_alias_token(char **cmd_line_buf, t_hashtable *aliases,
     if (ts->tokens[i].type != TOKEN_SIMPLE || !should_alias(ts, i))
       continue;
 
-    char *name = strndup(ts->tokens[i].start, ts->tokens[i].len);
-    if (name[0] == '\\') {
-      free(name);
+    const t_token *tok = &ts->tokens[i];
+    if (tok->len == 0 || tok->start[0] == '\\')
+      continue;
+    // most words are not aliases, look them up in place before copying
+    t_ht_node *av = ht_find_n(aliases, tok->start, tok->len);
+    t_alias *al = av ? av->value : NULL;
+    if (!al || !al->cmd)
       continue;
-    }
-    char *alias_val = NULL;
-    t_ht_node *av = ht_find(aliases, name);
 
-    if (av) {
-      t_alias *al = av->value;
-      if (al && al->cmd)
-        alias_val = strdup(al->cmd);
-    }
+    char *name = strndup(tok->start, tok->len);
+    char *alias_val = strdup(al->cmd);
 
     if (alias_val && strcmp(name, alias_val) == 0) {
       free(name);
-      name = NULL;
+      free(alias_val);
       continue;
     }
 
@@ -266,33 +364,53 @@ static inline bool is_tok_fun(char *cmd_buf, size_t i, t_token_stream *ts,
           ts->tokens[tc - 1].type == TOKEN_SIMPLE && cmd_buf[i - 1] != ' ');
 }
 static inline bool is_delim(char c) {
-  return (c == ' ' || c == '\t' || c == ';' || c == '\n' || c == '|' ||
-          c == '&' || c == '\0' || c == ')');
+  return g_lex_class[(unsigned char)c] & LEX_DELIM;
 }
 
-/*buffer safe because userinp.c null-terminates buffer. paired with while loop
- * cond cmd_buf[i+1] can be '\0' but never UB*/
-int lex_command_line(char **cmd_line_buf, t_token_stream *token_stream,
-                     t_hashtable *aliases, int depth, t_arena *a, bool hd,
-                     t_err_code *last_err) {
-
-  /* alias depth */
-  if (depth > 10) {
-    fprintf(stderr, "\nmsh: alias depth limit reached.");
-    return -1;
-  }
-
-  bool in_single_quote = false;
-  bool in_double_quote = false;
-  bool tokenized = false;
-  char *tok_start = NULL;
-  size_t word_len = 0;
+/**
+ * @brief runs the lexer over cmd_buf from st->pos to the terminating NUL
+ * @return 0 success, -1 unbalanced quotes
+ *
+ * All loop state lives in st so a partial run can stop at the end of the
+ * buffer and pick up again once more text has been appended. With partial
+ * set an open quote leaves its word pending instead of flushing it.
+ */
+static int lex_run(char *cmd_buf, t_lex_state *st, t_token_stream *token_stream,
+                   t_arena *a, bool hd, bool partial) {
+
+  bool in_single_quote = st->in_single_quote;
+  bool in_double_quote = st->in_double_quote;
+  bool tokenized = st->tokenized;
+  char *tok_start = tokenized ? cmd_buf + st->tok_start : NULL;
+  size_t word_len = st->word_len;
   size_t op_len = 0;
-  int i = 0;
-  size_t token_count = 0;
-  char *cmd_buf = *cmd_line_buf;
+  size_t i = st->pos;
+  size_t token_count = token_stream->tokens_arr_len;
+  // the buffer only grows between runs, so its end is fixed for this one
+  const char *end = cmd_buf + i + strlen(cmd_buf + i);
   while (cmd_buf[i] != '\0') {
 
+    // skip whole runs that cannot end the word or change quote state
+    size_t run = 0;
+    if (in_single_quote) {
+      const char *q = memchr(cmd_buf + i, '\'', end - (cmd_buf + i));
+      run = (q ? q : end) - (cmd_buf + i);
+    } else if (in_double_quote) {
+      run = dquote_run(cmd_buf + i, end);
+    } else if (!(g_lex_class[(unsigned char)cmd_buf[i]] & LEX_STOP)) {
+      if (!tokenized) {
+        tok_start = &cmd_buf[i];
+        tokenized = true;
+      }
+      run = word_run(cmd_buf + i, end);
+    }
+    if (run) {
+      if (tokenized)
+        word_len += run;
+      i += run;
+      continue;
+    }
+
     if (!in_single_quote && !in_double_quote && cmd_buf[i] == '#') {
       while (cmd_buf[i] != '\0' && cmd_buf[i] != '\n')
         i++;
@@ -327,19 +445,8 @@ int lex_command_line(char **cmd_line_buf, t_token_stream *token_stream,
         tokenized = true;
       }
     } else if (!in_single_quote && !in_double_quote) {
-      char seq[4];
-      if (cmd_buf[i + 1] != '\0') {
-        seq[0] = cmd_buf[i];
-        seq[1] = cmd_buf[i + 1];
-        seq[2] = cmd_buf[i + 2];
-        seq[3] = '\0';
-      } else {
-        seq[0] = cmd_buf[i];
-        seq[1] = cmd_buf[i + 1];
-        seq[2] = '\0';
-        seq[3] = '\0';
-      }
-      t_token_type type = get_token_type(seq, &op_len);
+      // reads past cmd_buf[i + 1] only when it is an operator byte
+      t_token_type type = get_token_type(&cmd_buf[i], &op_len);
 
       if (type == TOKEN_LBRACE) {
         if (i > 0 && (!is_delim(cmd_buf[i - 1]) || !is_delim(cmd_buf[i + 1]))) {
@@ -430,15 +537,108 @@ int lex_command_line(char **cmd_line_buf, t_token_stream *token_stream,
     i++;
   }
 
+  if (partial && (in_single_quote || in_double_quote)) {
+    st->in_single_quote = in_single_quote;
+    st->in_double_quote = in_double_quote;
+    st->tokenized = tokenized;
+    st->tok_start = tokenized ? (size_t)(tok_start - cmd_buf) : 0;
+    st->word_len = word_len;
+    st->pos = i;
+    token_stream->tokens_arr_len = token_count;
+    return -1;
+  }
+
   flush_word(token_stream, &tok_start, &word_len, &tokenized, &token_count,
              in_single_quote || in_double_quote, cmd_buf[i]);
 
-  if (in_single_quote || in_double_quote) {
+  st->in_single_quote = false;
+  st->in_double_quote = false;
+  st->tokenized = false;
+  st->word_len = 0;
+  st->pos = i;
+
+  if (in_single_quote || in_double_quote)
+    return -1;
+
+  token_stream->tokens_arr_len = token_count;
+  return 0;
+}
+
+void init_lex_state(t_lex_state *st) {
+  st->pos = 0;
+  st->in_single_quote = false;
+  st->in_double_quote = false;
+  st->tokenized = false;
+  st->tok_start = 0;
+  st->word_len = 0;
+  st->nest = 0;
+}
+
+/**
+ * @brief adds the compound nesting of tokens [from, len) to st->nest
+ *
+ * Counts openers and closers the way next_terminator_index does, so a
+ * positive nest means build_ast would report a missing terminator.
+ */
+static void count_nest(t_lex_state *st, t_token_stream *ts, size_t from) {
+  for (size_t i = from; i < ts->tokens_arr_len; i++) {
+    switch (ts->tokens[i].type) {
+    case TOKEN_IF:
+    case TOKEN_WHILE:
+    case TOKEN_UNTIL:
+    case TOKEN_FOR:
+    case TOKEN_OPEN_PAR:
+    case TOKEN_LBRACE:
+      st->nest++;
+      break;
+    case TOKEN_FI:
+    case TOKEN_DONE:
+    case TOKEN_CLOSE_PAR:
+    case TOKEN_RBRACE:
+      st->nest--;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+int lex_resume(char *cmd_buf, t_lex_state *st, t_token_stream *token_stream,
+               t_arena *a, t_err_code *last_err) {
+  size_t from = token_stream->tokens_arr_len;
+  int ret = lex_run(cmd_buf, st, token_stream, a, false, true);
+  count_nest(st, token_stream, from);
+  if (ret == -1) {
     *last_err = ERR_UNBALANCED_QUOTES;
     return -1;
   }
+  return 0;
+}
 
-  token_stream->tokens_arr_len = token_count;
+void rebase_token_stream(t_token_stream *ts, const char *obuf, char *nbuf) {
+  for (size_t i = 0; i < ts->tokens_arr_len; i++)
+    ts->tokens[i].start = nbuf + (ts->tokens[i].start - obuf);
+}
+
+/*buffer safe because userinp.c null-terminates buffer. paired with while loop
+ * cond cmd_buf[i+1] can be '\0' but never UB*/
+int lex_command_line(char **cmd_line_buf, t_token_stream *token_stream,
+                     t_hashtable *aliases, int depth, t_arena *a, bool hd,
+                     t_err_code *last_err) {
+
+  /* alias depth */
+  if (depth > 10) {
+    fprintf(stderr, "\nmsh: alias depth limit reached.");
+    return -1;
+  }
+
+  t_lex_state st;
+  init_lex_state(&st);
+  token_stream->tokens_arr_len = 0;
+  if (lex_run(*cmd_line_buf, &st, token_stream, a, hd, false) == -1) {
+    *last_err = ERR_UNBALANCED_QUOTES;
+    return -1;
+  }
 
   if (hd) {
     return 0;
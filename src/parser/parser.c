@@ -174,6 +174,8 @@ static int scan_redirections(t_ast_n *node, t_token_stream *token_stream,
       node->io_redir[count_redir]->io_redir_type = pending;
 
       node->io_redir[count_redir]->hd_body = NULL;
+      node->io_redir[count_redir]->hd_fd = -1;
+      node->io_redir[count_redir]->hd_fd_body = NULL;
 
       node->io_redir[count_redir]->src_fd = pending_src;
       node->io_redir[count_redir]->target_fd = pending_targ;
@@ -221,6 +223,8 @@ static int scan_redirections(t_ast_n *node, t_token_stream *token_stream,
           (t_io_redir *)arena_alloc(a, sizeof(t_io_redir));
 
       node->io_redir[count_redir]->filename = NULL;
+      node->io_redir[count_redir]->hd_body = NULL;
+      node->io_redir[count_redir]->hd_fd = -1;
       node->io_redir[count_redir]->io_redir_type = IO_DUP_IN;
       node->io_redir[count_redir]->src_fd = pending_src;
       node->io_redir[count_redir]->target_fd = pending_targ;
@@ -234,6 +238,8 @@ static int scan_redirections(t_ast_n *node, t_token_stream *token_stream,
       node->io_redir[count_redir] =
           (t_io_redir *)arena_alloc(a, sizeof(t_io_redir));
       node->io_redir[count_redir]->filename = NULL;
+      node->io_redir[count_redir]->hd_body = NULL;
+      node->io_redir[count_redir]->hd_fd = -1;
       node->io_redir[count_redir]->io_redir_type = IO_DUP_OUT;
       node->io_redir[count_redir]->src_fd = pending_src;
       node->io_redir[count_redir]->target_fd = pending_targ;
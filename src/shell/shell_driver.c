@@ -18,6 +18,7 @@ void cleanup_global_shell_ptr(void) {
 
 static int add_hist_entry(t_shell *shell, const char *line) {
   t_dll *hist = &shell->history;
+  history_load(shell);
 
   if (!push_front_dll(line, hist)) {
     perror("push_front_dll");
@@ -3,12 +3,28 @@
 #include "builtins.h"
 #include "executor.h"
 #include "shell.h"
+#include "snapshot.h"
 #include "var_exp.h"
 #include <sys/sysmacros.h>
+#include <time.h>
 #include <unistd.h>
 
 extern char **environ;
 
+#define STARTUP_MAX_PHASES 16
+
+/**
+ * @brief phase timestamps of init_shell_state, only taken when
+ * MSH_STARTUP_TIMES is set
+ */
+static struct {
+  bool on;
+  size_t len;
+  struct timespec start;
+  const char *names[STARTUP_MAX_PHASES];
+  struct timespec ends[STARTUP_MAX_PHASES];
+} g_startup;
+
 /**
  * @file shell_init.c
  *
@@ -16,15 +32,33 @@ extern char **environ;
  *
  */
 
-t_ht_node *insert_builtin(t_hashtable *ht, const char *name,
-                          t_builtin_func fn) {
-  t_builtin *b = malloc(sizeof(*b));
-  if (!b) {
-    perror("malloc");
-    exit(12);
+static double ts_us(const struct timespec *a, const struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+/** @brief records the end of the startup phase name */
+static void startup_phase(const char *name) {
+  if (!g_startup.on || g_startup.len == STARTUP_MAX_PHASES)
+    return;
+  g_startup.names[g_startup.len] = name;
+  clock_gettime(CLOCK_MONOTONIC, &g_startup.ends[g_startup.len++]);
+}
+
+/** @brief prints the length of each phase and their total to stderr */
+static void startup_report(void) {
+  if (!g_startup.on)
+    return;
+  const struct timespec *prev = &g_startup.start;
+  for (size_t i = 0; i < g_startup.len; i++) {
+    fprintf(stderr, "msh: startup %-10s %8.1f us\n", g_startup.names[i],
+            ts_us(prev, &g_startup.ends[i]));
+    prev = &g_startup.ends[i];
   }
+  fprintf(stderr, "msh: startup %-10s %8.1f us\n", "total",
+          ts_us(&g_startup.start, prev));
+}
 
-  b->fn = fn;
+t_ht_node *insert_builtin(t_hashtable *ht, const char *name, t_builtin *b) {
   return ht_insert(ht, name, b, NULL);
 }
 
@@ -37,7 +71,10 @@ static void load_rc(t_shell *shell) {
   snprintf(rc_path, sizeof(rc_path), "%s/.mshrc", home);
 
   if (access(rc_path, F_OK) == 0) {
-    exec_script(shell, rc_path);
+    if (snapshot_load(shell, rc_path) == -1) {
+      exec_script(shell, rc_path);
+      snapshot_store(shell);
+    }
   } else if (errno == ENOENT) {
     char a;
     fprintf(stderr, "\nmsh: no rc file found at ~/.mshrc:\n");
@@ -105,18 +142,37 @@ static void load_rc(t_shell *shell) {
   printf("\033[J");
 }
 
-static void load_history(t_shell *shell) {
+static int history_path(t_shell *shell, char *path) {
   const char *home = getenv_local_ref(&shell->env, "HOME");
   if (!home)
+    return -1;
+  snprintf(path, PATH_MAX, "%s/.msh_history", home);
+  return 0;
+}
+
+/**
+ * @brief reports a missing history file at startup, the file itself is read
+ * by history_load once the first prompt is up
+ */
+static void probe_history(t_shell *shell) {
+  char path[PATH_MAX];
+  if (history_path(shell, path) == -1 || access(path, F_OK) == 0)
+    return;
+  fprintf(stderr, "msh: ~/.msh_history not found: file created\n");
+  shell->history_loaded = true;
+}
+
+void history_load(t_shell *shell) {
+  if (shell->history_loaded)
     return;
+  shell->history_loaded = true;
 
   char path[PATH_MAX];
-  snprintf(path, PATH_MAX, "%s/.msh_history", home);
+  if (history_path(shell, path) == -1)
+    return;
   FILE *fp = fopen(path, "r");
-  if (!fp) {
-    fprintf(stderr, "msh: ~/.msh_history not found: file created\n");
+  if (!fp)
     return;
-  }
 
   char *line = NULL;
   size_t len = 0;
@@ -139,56 +195,57 @@ static void load_history(t_shell *shell) {
  */
 typedef struct s_builtin_def {
   const char *name;
-  int (*fn)(t_ast_n *, t_shell *, char **);
+  t_builtin b; ///< table value, static so startup allocates no entries
 } t_builtin_def;
 
 static int push_built_ins(t_shell *shell) {
 
-  static const t_builtin_def builtins[] = {{"exit", exit_builtin},
-                                           {"cd", cd_builtin},
-                                           {"alias", alias_builtin},
-                                           {"unalias", unalias_builtin},
-                                           {"fg", fg_builtin},
-                                           {"bg", bg_builtin},
-                                           {"jobs", jobs_builtin},
-                                           {"kill", kill_builtin},
-                                           {"export", export_builtin},
-                                           {"unset", unset_builtin},
-                                           {"clear", clear_builtin},
-                                           {"env", env_builtin},
-                                           {"history", history_builtin},
-                                           {"v", v_builtin},
-                                           {"[", test_builtin},
-                                           {"true", true_builtin},
-                                           {"false", false_builtin},
-                                           {"echo", echo_builtin},
-                                           {"exec", exec_builtin},
-                                           {"source", source_builtin},
-                                           {".", source_builtin},
-                                           {"read", read_builtin},
-                                           {"pwd", pwd_builtin},
-                                           {"builtin", builtin_builtin},
-                                           {"rehash", rehash_builtin},
-                                           {":", nop_builtin},
-                                           {"set", set_builtin},
-                                           {"local", local_builtin},
-                                           {"break", break_builtin},
-                                           {"continue", continue_builtin},
-                                           {"return", return_builtin},
-                                           {"type", type_builtin},
-                                           {"shopt", shopt_builtin},
-                                           {"eval", eval_builtin},
-                                           {"readonly", readonly_builtin},
-                                           {"command", command_builtin},
-                                           {"hash", hash_builtin},
-                                           {"times", times_builtin},
-                                           {"wait", wait_builtin},
-                                           {"trap", trap_builtin},
-                                           {"shift", shift_builtin},
-                                           {"printf", printf_builtin}};
+  static t_builtin_def builtins[] = {{"exit", {exit_builtin}},
+                                     {"cd", {cd_builtin}},
+                                     {"alias", {alias_builtin}},
+                                     {"unalias", {unalias_builtin}},
+                                     {"fg", {fg_builtin}},
+                                     {"bg", {bg_builtin}},
+                                     {"jobs", {jobs_builtin}},
+                                     {"kill", {kill_builtin}},
+                                     {"export", {export_builtin}},
+                                     {"unset", {unset_builtin}},
+                                     {"clear", {clear_builtin}},
+                                     {"env", {env_builtin}},
+                                     {"history", {history_builtin}},
+                                     {"v", {v_builtin}},
+                                     {"[", {test_builtin}},
+                                     {"test", {test_builtin}},
+                                     {"true", {true_builtin}},
+                                     {"false", {false_builtin}},
+                                     {"echo", {echo_builtin}},
+                                     {"exec", {exec_builtin}},
+                                     {"source", {source_builtin}},
+                                     {".", {source_builtin}},
+                                     {"read", {read_builtin}},
+                                     {"pwd", {pwd_builtin}},
+                                     {"builtin", {builtin_builtin}},
+                                     {"rehash", {rehash_builtin}},
+                                     {":", {nop_builtin}},
+                                     {"set", {set_builtin}},
+                                     {"local", {local_builtin}},
+                                     {"break", {break_builtin}},
+                                     {"continue", {continue_builtin}},
+                                     {"return", {return_builtin}},
+                                     {"type", {type_builtin}},
+                                     {"shopt", {shopt_builtin}},
+                                     {"eval", {eval_builtin}},
+                                     {"readonly", {readonly_builtin}},
+                                     {"command", {command_builtin}},
+                                     {"hash", {hash_builtin}},
+                                     {"times", {times_builtin}},
+                                     {"wait", {wait_builtin}},
+                                     {"trap", {trap_builtin}},
+                                     {"shift", {shift_builtin}},
+                                     {"printf", {printf_builtin}}};
 
   for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
-    if (!insert_builtin(&shell->builtins, builtins[i].name, builtins[i].fn))
+    if (!insert_builtin(&shell->builtins, builtins[i].name, &builtins[i].b))
       return -1;
   }
 
@@ -408,68 +465,82 @@ int get_shell_prompt(t_shell *shell) {
 
   return 0;
 }
-static void hash_directory(t_hashtable *bins, char *dir_path) {
-  DIR *dir = opendir(dir_path);
-  struct dirent *entry;
-  char full_path[4096];
-
-  if (!dir)
-    return;
-
-  while ((entry = readdir(dir)) != NULL) {
-    if (entry->d_name[0] == '.')
-      continue;
-    snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
-    if (access(full_path, X_OK) == 0) {
-      ht_insert(bins, entry->d_name, strdup(full_path), free);
-    }
-  }
-  closedir(dir);
+/** @brief empty bins table, PATH is only parsed by the first lookup */
+void init_bins(t_shell *shell) {
+  ht_init(&shell->bins);
+  memset(&shell->path_cache, 0, sizeof(shell->path_cache));
 }
-void refresh_path_bins(t_shell *shell) {
-  if (!shell->path)
-    return;
-
-  ht_flush(&shell->bins, free);
 
-  char *path_copy = arena_alloc(&shell->arena, shell->path_len + 1);
-  memcpy(path_copy, shell->path, shell->path_len);
-  path_copy[shell->path_len] = '\0';
-
-  char *dir = strtok(path_copy, ":");
+/**
+ * @brief adds an inherited variable
+ * @return its entry, NULL on alloc fail.
+ *
+ * Name and value are copied straight out of environ; only a name that
+ * appears twice goes through add_to_env.
+ */
+static t_env_entry *import_var(t_shell *shell, const char *name,
+                               size_t name_len, const char *val) {
+  t_ht_node *n = ht_find_n(&shell->env, name, name_len);
+  if (n) {
+    if (add_to_env(shell, n->key, val, false, 0) == -1)
+      return NULL;
+    return n->value;
+  }
 
-  while (dir) {
-    hash_directory(&shell->bins, dir);
-    dir = strtok(NULL, ":");
+  size_t val_len = strlen(val);
+  t_env_entry *entry = malloc(sizeof(*entry));
+  char *key = malloc(name_len + 1);
+  char *v = malloc(val_len + 1);
+  if (!entry || !key || !v) {
+    free(entry);
+    free(key);
+    free(v);
+    return NULL;
+  }
+  memcpy(key, name, name_len);
+  key[name_len] = '\0';
+  memcpy(v, val, val_len + 1);
+
+  entry->name = key;
+  entry->val = v;
+  entry->val_len = val_len;
+  entry->val_cap = val_len + 1;
+  entry->flags = 0;
+  entry->local_depth = 0;
+  entry->envp_idx = -1;
+
+  char *end;
+  long long res = strtoll(v, &end, 10);
+  if (*v != '\0' && *end == '\0') {
+    entry->vint = res;
+    entry->flags |= ENV_HAS_VINT;
   }
-}
 
-void init_bins(t_shell *shell) {
-  ht_init(&shell->bins);
-  refresh_path_bins(shell);
+  if (!ht_insert(&shell->env, key, entry, free_env_entry)) {
+    free_env_entry(entry);
+    return NULL;
+  }
+  return entry;
 }
 
 int init_env(t_shell *shell) {
 
   ht_init(&shell->env);
 
+  shell->envp.vec = NULL;
+  shell->envp.owners = NULL;
+  shell->envp.len = 0;
+  shell->envp.cap = 0;
+  shell->envp.pending = true;
+
   for (size_t i = 0; environ[i]; i++) {
-    char *entry = strdup(environ[i]);
-    if (!entry) {
-      perror("strdup");
+    const char *eq = strchr(environ[i], '=');
+    if (!eq)
+      continue;
+    t_env_entry *a = import_var(shell, environ[i], eq - environ[i], eq + 1);
+    if (!a)
       return -1;
-    }
-    char *eq = strchr(entry, '=');
-    if (eq) {
-      *eq = '\0';
-      if (add_to_env(shell, entry, eq + 1, false, 0) == -1)
-        return -1;
-      t_ht_node *hh = ht_find(&shell->env, entry);
-      t_env_entry *a = (t_env_entry *)hh->value;
-      a->flags |= ENV_EXPORTED;
-    }
-
-    free(entry);
+    a->flags |= ENV_EXPORTED;
   }
 
   return 0;
@@ -486,15 +557,25 @@ int init_env(t_shell *shell) {
  */
 int init_shell_state(t_shell *shell, bool script) {
 
+  g_startup.on = getenv("MSH_STARTUP_TIMES") != NULL;
+  if (g_startup.on)
+    clock_gettime(CLOCK_MONOTONIC, &g_startup.start);
+
   for (size_t i = 0; i < NSIG; i++) {
     shell->traps[i] = NULL;
     sigs[i] = 0;
   }
 
   shell->exflag = 0;
+  shell->cmd_gen = 1;
 
   arena_init(&shell->arena);
-  get_term_size(&shell->rows, &shell->cols);
+  // the window size is only read by line editing and the prompt
+  shell->rows = 0;
+  shell->cols = 0;
+  if (!script)
+    get_term_size(&shell->rows, &shell->cols);
+  startup_phase("term");
 
   shell->prompt = NULL;
 
@@ -504,10 +585,13 @@ int init_shell_state(t_shell *shell, bool script) {
   shell->next_job_id = 1;
   shell->job_control_flag = 1;
 
-  if (init_pa_sigtable(&(shell->shell_sigtable)) == -1) {
+  // scripts and -c get child dispositions from main, and their signal event
+  // pipe is opened by the first wait that needs it
+  if (!script && init_pa_sigtable(&(shell->shell_sigtable)) == -1) {
     fprintf(stderr, "msh: failed sigaction: job control disabled\n");
     shell->job_control_flag = 0;
   }
+  startup_phase("sigtable");
 
   shell->fg_job = NULL;
   shell->last_exit_status = 0;
@@ -560,14 +644,32 @@ int init_shell_state(t_shell *shell, bool script) {
 
   shell->job_table_cap = INITIAL_JOB_TABLE_LENGTH;
   shell->job_count = 0;
+  shell->job_free_hint = 0;
+  shell->done_jobs = NULL;
+
+  shell->pid_index =
+      (t_process **)calloc(INITIAL_PID_INDEX_LENGTH, sizeof(t_process *));
+  if (shell->pid_index == NULL) {
+    perror("pid index fail");
+    return -1;
+  }
+  shell->pid_index_cap = INITIAL_PID_INDEX_LENGTH;
+  shell->pid_index_len = 0;
+  startup_phase("jobs");
 
   init_ast(&(shell->ast));
 
   ht_init(&(shell->builtins));
   ht_init(&(shell->aliases));
   ht_init(&(shell->functions));
+  ht_init(&(shell->arith_cache));
+  shell->stat_cache.len = 0;
+  shell->stat_cache.next = 0;
+  shell->ifs_cache.valid = false;
 
   init_dll(&(shell->history));
+  // a script has no history to read, see history_load
+  shell->history_loaded = script;
 
   if (shell->is_interactive)
     init_s_term_ctrl(shell);
@@ -578,12 +680,16 @@ int init_shell_state(t_shell *shell, bool script) {
     perror("failure to initialize");
     return -1;
   }
+  startup_phase("builtins");
 
   if (init_env(shell) == -1) {
     return -1;
   }
+  startup_phase("env");
 
-  get_shell_prompt(shell);
+  if (shell->is_interactive)
+    get_shell_prompt(shell);
+  startup_phase("prompt");
 
   shell->path = getenv_local_ref(&shell->env, "PATH");
   if (shell->path) {
@@ -607,10 +713,15 @@ int init_shell_state(t_shell *shell, bool script) {
   shell->exec_ctx.pids_len = 0;
   shell->exec_ctx.pids_cap = 0;
 
+  shell->script_src = NULL;
+  shell->snap_rec = NULL;
+  shell->shopts.test_statcache = true;
+  shell->shopts.globstar = false;
   if (shell->is_interactive) {
     load_rc(shell);
-    load_history(shell);
-    shell->script_fstream = NULL;
+    startup_phase("rc");
+    probe_history(shell);
+    startup_phase("history");
   }
 
   shell->pending_hds = NULL;
@@ -629,6 +740,8 @@ int init_shell_state(t_shell *shell, bool script) {
   }
 
   arena_reset(&shell->arena);
+  startup_phase("rest");
+  startup_report();
 
   return 0;
 }
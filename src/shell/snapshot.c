@@ -0,0 +1,805 @@
+#include "snapshot.h"
+#include "alias.h"
+#include "path_cache.h"
+#include "var_exp.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @file snapshot.c
+ * @brief implementation of the warm-start snapshot of ~/.mshrc.
+ *
+ * Layout: header, shopts, then variable, alias and function records. Every
+ * string is a uint64_t length, its bytes and a NUL, so the loader borrows
+ * them straight from the mapping. Functions are written node by node in
+ * preorder; the loader rebuilds each one in the arena with its tokens
+ * pointing into the mapping and hands it to clone_heap_ast, which lays it
+ * out exactly like a function defined by running the rc.
+ */
+
+#define SNAP_MAGIC 0x5348534dU // "MSHS"
+#define SNAP_VERSION 1
+#define SNAP_DEF_CAP 4096
+#define SNAP_VAR_FLAGS (ENV_EXPORTED | ENV_READONLY)
+
+typedef struct s_snap_hdr {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t shopt_size;
+  uint32_t pad;
+  t_snap_key key;
+  uint64_t size;
+} t_snap_hdr;
+
+typedef struct s_snap_node {
+  uint64_t tok_segment_len;
+  uint64_t toks; ///< tokens stored, 0 if tok_start was NULL
+  uint64_t items_len;
+  uint64_t items; ///< for_items stored
+  uint64_t static_toks;
+  uint64_t static_argc;
+  uint32_t op_type;
+  int32_t background;
+  uint32_t redirs;
+  uint8_t redir_bool;
+  uint8_t has_var;
+  uint8_t pad[2];
+} t_snap_node;
+
+typedef struct s_snap_tok {
+  uint32_t type;
+  uint8_t delim;
+  uint8_t pad[3];
+} t_snap_tok;
+
+typedef struct s_snap_redir {
+  uint32_t type;
+  int32_t src_fd;
+  int32_t target_fd;
+  uint8_t has_file;
+  uint8_t has_body;
+  uint8_t pad[2];
+} t_snap_redir;
+
+/**
+ * @typedef struct s_snap_var t_snap_var
+ * @brief a variable as it was before the rc ran.
+ */
+typedef struct s_snap_var {
+  unsigned char flags;
+  char val[];
+} t_snap_var;
+
+/** @brief snapshot under construction, err is sticky */
+typedef struct s_snap_b {
+  char *data;
+  size_t len;
+  size_t cap;
+  bool err;
+} t_snap_b;
+
+/** @brief cursor over a mapped snapshot, err is sticky */
+typedef struct s_snap_rd {
+  const char *p;
+  const char *end;
+  bool err;
+} t_snap_rd;
+
+typedef struct s_snap_def {
+  const char *name;
+  const char *val; ///< NULL to unset, alias text for aliases
+  uint8_t flags;
+  t_ast_n *body; ///< functions only
+} t_snap_def;
+
+/**
+ * @brief parameters whose value differs between shells started from the
+ * same environment; they are left out of the key, an rc expanding one is not
+ * recorded.
+ */
+static const char *const g_volatile[] = {
+    "PWD",        "OLDPWD",         "SHLVL",      "_",         "RANDOM",
+    "SECONDS",    "LINENO",         "COLUMNS",    "LINES",     "TMUX_PANE",
+    "WINDOWID",   "TERM_SESSION_ID", "SSH_CLIENT", "SSH_CONNECTION",
+    "SSH_TTY",    "MSH_SNAPSHOT"};
+
+static bool is_volatile(const char *name, size_t len) {
+  for (size_t i = 0; i < sizeof(g_volatile) / sizeof(*g_volatile); i++)
+    if (strlen(g_volatile[i]) == len && memcmp(g_volatile[i], name, len) == 0)
+      return true;
+  return false;
+}
+
+static void file_of_stat(t_snap_file *f, const struct stat *st) {
+  memset(f, 0, sizeof(*f));
+  f->dev = st->st_dev;
+  f->ino = st->st_ino;
+  f->size = st->st_size;
+  f->mtime_sec = st->st_mtim.tv_sec;
+  f->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static uint64_t fnv1a(uint64_t h, const void *p, size_t len) {
+  const unsigned char *s = p;
+  for (size_t i = 0; i < len; i++) {
+    h ^= s[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/** @brief splitmix64 finalizer, spreads an entry hash before it is summed */
+static uint64_t mix(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+/**
+ * @brief hashes the non-volatile variables, independent of table order
+ */
+static uint64_t env_hash(t_shell *shell) {
+  uint64_t sum = 0;
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(&shell->env, &it))) {
+    t_env_entry *e = n->value;
+    const char *val = env_val(e);
+    if (!val || e->flags & ENV_LOCAL || is_volatile(n->key, n->key_len))
+      continue;
+    unsigned char flags = e->flags & SNAP_VAR_FLAGS;
+    uint64_t h = fnv1a(0xcbf29ce484222325ULL, n->key, n->key_len + 1);
+    h = fnv1a(h, val, strlen(val) + 1);
+    sum += mix(fnv1a(h, &flags, 1));
+  }
+  return sum;
+}
+
+static int make_key(t_shell *shell, const char *rc_path, t_snap_key *key) {
+  struct stat rc, exe;
+  if (stat(rc_path, &rc) == -1 || !S_ISREG(rc.st_mode) ||
+      stat("/proc/self/exe", &exe) == -1)
+    return -1;
+  memset(key, 0, sizeof(*key));
+  file_of_stat(&key->rc, &rc);
+  file_of_stat(&key->build, &exe);
+  key->env = env_hash(shell);
+  return 0;
+}
+
+/* ---------------------------------------------------------------- purity */
+
+/**
+ * @brief checks the parameter expanded after a '$'
+ * @return false for special parameters, $( and volatile names.
+ */
+static bool param_pure(const char *p, size_t n) {
+  if (!n)
+    return true;
+  if (*p == '(' || strchr("$!#@*-0123456789", *p))
+    return false;
+  if (*p == '{') {
+    p++;
+    n--;
+    // ${#NAME}, ${!NAME} and ${N} are not plain names
+    if (!n || strchr("#!@*$?-0123456789", *p))
+      return false;
+  }
+  size_t len = 0;
+  while (len < n && (p[len] == '_' || (p[len] >= 'a' && p[len] <= 'z') ||
+                     (p[len] >= 'A' && p[len] <= 'Z') ||
+                     (p[len] >= '0' && p[len] <= '9')))
+    len++;
+  return !is_volatile(p, len);
+}
+
+/**
+ * @brief checks a word for command substitution, unquoted globs and
+ * volatile expansions
+ */
+static bool word_pure(const t_token *tok) {
+  const char *s = tok->start;
+  char q = 0;
+  for (size_t i = 0; i < tok->len; i++) {
+    char c = s[i];
+    if (q == '\'') {
+      q = c == '\'' ? 0 : q;
+      continue;
+    }
+    if (c == '\\') {
+      i++;
+    } else if (c == '\'' && !q) {
+      q = c;
+    } else if (c == '"') {
+      q = q ? 0 : c;
+    } else if (c == '`') {
+      return false;
+    } else if (c == '$') {
+      if (!param_pure(s + i + 1, tok->len - i - 1))
+        return false;
+    } else if (!q && (c == '*' || c == '?' || c == '[')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool tok_is(const t_token *tok, const char *s) {
+  return strlen(s) == tok->len && memcmp(tok->start, s, tok->len) == 0;
+}
+
+static bool cmd_pure(t_shell *shell, const t_ast_n *node) {
+  const t_token *t = node->tok_start;
+  size_t n = t ? node->tok_segment_len : 0;
+  for (size_t i = 0; i < n; i++)
+    if (t[i].type != TOKEN_SIMPLE || !word_pure(&t[i]))
+      return false;
+  if (n == 0)
+    return true;
+  if (ht_find_n(&shell->functions, t->start, t->len))
+    return false;
+  if (n == 1 && memchr(t->start, '=', t->len))
+    return true;
+
+  if (tok_is(t, "true") || tok_is(t, "false") || tok_is(t, ":"))
+    return true;
+  if (tok_is(t, "shopt"))
+    return n > 2 && (tok_is(&t[1], "-s") || tok_is(&t[1], "-u"));
+
+  // the forms below would print rather than declare without operands
+  bool alias = tok_is(t, "alias");
+  if (!alias && !tok_is(t, "export") && !tok_is(t, "readonly") &&
+      !tok_is(t, "unset") && !tok_is(t, "unalias"))
+    return false;
+  if (n < 2)
+    return false;
+  for (size_t i = 1; i < n; i++) {
+    if (t[i].len && t[i].start[0] == '-')
+      return false;
+    if (alias && !memchr(t[i].start, '=', t[i].len))
+      return false;
+  }
+  return true;
+}
+
+static bool node_pure(t_shell *shell, const t_ast_n *node) {
+  if (!node)
+    return true;
+  if (node->background || node->redir_bool || node->io_redir)
+    return false;
+
+  switch (node->op_type) {
+  case OP_FUN:
+    return true;
+  case OP_SIMPLE:
+    return cmd_pure(shell, node);
+  case OP_PIPE:
+  case OP_SUBSHELL:
+    return false;
+  default:
+    break;
+  }
+
+  if (node->op_type == OP_FOR && node->for_items)
+    for (size_t i = 0; i < node->items_len; i++)
+      if (!word_pure(&node->for_items[i]))
+        return false;
+  return node_pure(shell, node->left) && node_pure(shell, node->right) &&
+         node_pure(shell, node->sub_ast_root);
+}
+
+void snapshot_check(t_shell *shell, const t_ast_n *root) {
+  t_snap_rec *rec = shell->snap_rec;
+  if (rec && !rec->tainted && !node_pure(shell, root))
+    rec->tainted = true;
+}
+
+/* ---------------------------------------------------------------- writer */
+
+static void put(t_snap_b *b, const void *p, size_t n) {
+  if (b->err)
+    return;
+  if (b->len + n > b->cap) {
+    size_t ncap = b->cap ? b->cap : SNAP_DEF_CAP;
+    while (b->len + n > ncap)
+      ncap *= BUF_GROWTH_FACTOR;
+    char *ndata = realloc(b->data, ncap);
+    if (!ndata) {
+      b->err = true;
+      return;
+    }
+    b->data = ndata;
+    b->cap = ncap;
+  }
+  memcpy(b->data + b->len, p, n);
+  b->len += n;
+}
+
+static void put_str(t_snap_b *b, const char *s, size_t len) {
+  uint64_t n = len;
+  put(b, &n, sizeof(n));
+  put(b, s, len);
+  put(b, "", 1);
+}
+
+static void put_toks(t_snap_b *b, const t_token *toks, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    t_snap_tok rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = toks[i].type;
+    rec.delim = toks[i].trailing_delim;
+    put(b, &rec, sizeof(rec));
+    put_str(b, toks[i].start, toks[i].len);
+  }
+}
+
+static void put_node(t_snap_b *b, const t_ast_n *node) {
+  uint8_t present = node != NULL;
+  put(b, &present, 1);
+  if (!node)
+    return;
+
+  bool is_for = node->op_type == OP_FOR;
+  t_snap_node rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.tok_segment_len = node->tok_segment_len;
+  rec.toks = node->tok_start ? node->tok_segment_len : 0;
+  rec.items_len = node->items_len;
+  rec.items = is_for && node->for_items ? node->items_len : 0;
+  rec.static_toks = node->static_toks;
+  rec.static_argc = node->static_argc;
+  rec.op_type = node->op_type;
+  rec.background = node->background;
+  rec.redir_bool = node->redir_bool;
+  rec.has_var = is_for && node->for_var;
+  while (node->io_redir && node->io_redir[rec.redirs])
+    rec.redirs++;
+  put(b, &rec, sizeof(rec));
+
+  put_toks(b, node->tok_start, rec.toks);
+  if (rec.has_var)
+    put_toks(b, node->for_var, 1);
+  put_toks(b, node->for_items, rec.items);
+
+  for (uint32_t i = 0; i < rec.redirs; i++) {
+    const t_io_redir *r = node->io_redir[i];
+    t_snap_redir rr;
+    memset(&rr, 0, sizeof(rr));
+    rr.type = r->io_redir_type;
+    rr.src_fd = r->src_fd;
+    rr.target_fd = r->target_fd;
+    rr.has_file = r->filename != NULL;
+    rr.has_body = r->hd_body != NULL;
+    put(b, &rr, sizeof(rr));
+    if (r->filename)
+      put_str(b, r->filename, strlen(r->filename));
+    if (r->hd_body)
+      put_str(b, r->hd_body, strlen(r->hd_body));
+  }
+
+  put_node(b, node->left);
+  put_node(b, node->right);
+  put_node(b, node->sub_ast_root);
+}
+
+/** @brief variables the rc set, changed the flags of, or unset */
+static void put_vars(t_shell *shell, t_snap_b *b) {
+  t_hashtable *pre = &shell->snap_rec->pre;
+  size_t count_off = b->len;
+  uint32_t count = 0;
+  put(b, &count, sizeof(count));
+
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(&shell->env, &it))) {
+    t_env_entry *e = n->value;
+    const char *val = env_val(e);
+    if (!val || e->flags & ENV_LOCAL)
+      continue;
+    uint8_t flags = e->flags & SNAP_VAR_FLAGS;
+    t_ht_node *p = ht_find_n(pre, n->key, n->key_len);
+    t_snap_var *was = p ? p->value : NULL;
+    if (was && was->flags == flags && strcmp(was->val, val) == 0)
+      continue;
+    uint8_t set = 1;
+    put(b, &set, 1);
+    put(b, &flags, 1);
+    put_str(b, n->key, n->key_len);
+    put_str(b, val, strlen(val));
+    count++;
+  }
+
+  it = 0;
+  while ((n = ht_next(pre, &it))) {
+    t_ht_node *now = ht_find_n(&shell->env, n->key, n->key_len);
+    if (now && env_val(now->value))
+      continue;
+    uint8_t unset[2] = {0, 0};
+    put(b, unset, sizeof(unset));
+    put_str(b, n->key, n->key_len);
+    count++;
+  }
+
+  if (!b->err)
+    memcpy(b->data + count_off, &count, sizeof(count));
+}
+
+static void put_aliases(t_shell *shell, t_snap_b *b) {
+  uint32_t count = shell->aliases.count;
+  put(b, &count, sizeof(count));
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(&shell->aliases, &it))) {
+    t_alias *a = n->value;
+    put_str(b, n->key, n->key_len);
+    put_str(b, a->cmd, strlen(a->cmd));
+  }
+}
+
+static void put_functions(t_shell *shell, t_snap_b *b) {
+  uint32_t count = shell->functions.count;
+  put(b, &count, sizeof(count));
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(&shell->functions, &it))) {
+    put_str(b, n->key, n->key_len);
+    put_node(b, n->value);
+  }
+}
+
+/**
+ * @brief writes data atomically to path, failures leave no partial file
+ */
+static void snap_write(const char *path, const char *data, size_t len) {
+  char tmp[PATH_MAX];
+  if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+    return;
+
+  int fd = mkstemp(tmp);
+  if (fd == -1)
+    return;
+
+  size_t off = 0;
+  while (off < len) {
+    ssize_t w = write(fd, data + off, len - off);
+    if (w == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    off += w;
+  }
+
+  if (close(fd) == -1 || off != len || rename(tmp, path) == -1)
+    unlink(tmp);
+}
+
+static void free_rec(t_snap_rec *rec) {
+  ht_flush(&rec->pre, free);
+  free(rec->pre.slots);
+  free(rec->path);
+  free(rec);
+}
+
+void snapshot_store(t_shell *shell) {
+  t_snap_rec *rec = shell->snap_rec;
+  if (!rec)
+    return;
+
+  if (!rec->tainted) {
+    t_snap_b b = {0};
+    t_snap_hdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    put(&b, &hdr, sizeof(hdr));
+    put(&b, &shell->shopts, sizeof(shell->shopts));
+    put_vars(shell, &b);
+    put_aliases(shell, &b);
+    put_functions(shell, &b);
+
+    if (!b.err) {
+      hdr.magic = SNAP_MAGIC;
+      hdr.version = SNAP_VERSION;
+      hdr.shopt_size = sizeof(t_shopt);
+      hdr.key = rec->key;
+      hdr.size = b.len;
+      memcpy(b.data, &hdr, sizeof(hdr));
+      snap_write(rec->path, b.data, b.len);
+    }
+    free(b.data);
+  }
+
+  shell->snap_rec = NULL;
+  free_rec(rec);
+}
+
+/* ---------------------------------------------------------------- loader */
+
+static void get(t_snap_rd *r, void *dst, size_t n) {
+  if (r->err || (size_t)(r->end - r->p) < n) {
+    r->err = true;
+    memset(dst, 0, n);
+    return;
+  }
+  memcpy(dst, r->p, n);
+  r->p += n;
+}
+
+/** @brief borrows a string from the mapping, NULL once err is set */
+static const char *get_str(t_snap_rd *r, size_t *len) {
+  uint64_t n;
+  get(r, &n, sizeof(n));
+  if (r->err || n >= (uint64_t)(r->end - r->p) || r->p[n] != '\0') {
+    r->err = true;
+    return NULL;
+  }
+  const char *s = r->p;
+  r->p += n + 1;
+  if (len)
+    *len = n;
+  return s;
+}
+
+/** @brief checks n records of at least size bytes can follow */
+static bool fits(t_snap_rd *r, uint64_t n, size_t size) {
+  if (r->err || n > (uint64_t)(r->end - r->p) / size)
+    r->err = true;
+  return !r->err;
+}
+
+static t_token *get_toks(t_snap_rd *r, uint64_t n, t_arena *a) {
+  if (!n || !fits(r, n, sizeof(t_snap_tok) + sizeof(uint64_t) + 1))
+    return NULL;
+  t_token *toks = arena_alloc(a, n * sizeof(t_token));
+  for (uint64_t i = 0; i < n; i++) {
+    t_snap_tok rec;
+    get(r, &rec, sizeof(rec));
+    size_t len = 0;
+    toks[i].start = (char *)get_str(r, &len);
+    toks[i].len = len;
+    toks[i].type = rec.type;
+    toks[i].trailing_delim = rec.delim;
+    if (rec.type > TOKEN_NEWLINE)
+      r->err = true;
+  }
+  return r->err ? NULL : toks;
+}
+
+static t_io_redir **get_redirs(t_snap_rd *r, uint32_t n, t_arena *a) {
+  if (!fits(r, n, sizeof(t_snap_redir)))
+    return NULL;
+  t_io_redir **arr = arena_alloc(a, (n + 1) * sizeof(t_io_redir *));
+  for (uint32_t i = 0; i < n; i++) {
+    t_snap_redir rec;
+    get(r, &rec, sizeof(rec));
+    t_io_redir *io = arena_alloc(a, sizeof(t_io_redir));
+    io->io_redir_type = rec.type;
+    io->src_fd = rec.src_fd;
+    io->target_fd = rec.target_fd;
+    io->filename = rec.has_file ? (char *)get_str(r, NULL) : NULL;
+    io->hd_body = rec.has_body ? (char *)get_str(r, NULL) : NULL;
+    io->hd_fd = -1;
+    io->hd_fd_body = NULL;
+    if (rec.type > IO_FORCE_OW)
+      r->err = true;
+    arr[i] = io;
+  }
+  arr[n] = NULL;
+  return arr;
+}
+
+/**
+ * @brief checks the lengths of a node record agree with the tokens stored,
+ * the executor trusts tok_segment_len, items_len and the static prefix
+ */
+static bool node_rec_valid(const t_snap_node *rec) {
+  if (rec->op_type > OP_FUN)
+    return false;
+  if (rec->toks && rec->toks != rec->tok_segment_len)
+    return false;
+  if (rec->items && rec->items != rec->items_len)
+    return false;
+  if (rec->static_toks == STATIC_ARGV_UNSET)
+    return rec->static_argc == 0;
+  return rec->static_toks <= rec->tok_segment_len &&
+         rec->static_argc <= rec->static_toks;
+}
+
+/** @brief rebuilds a node and its subtrees in the arena */
+static t_ast_n *get_node(t_snap_rd *r, t_arena *a) {
+  uint8_t present;
+  get(r, &present, 1);
+  if (r->err || !present)
+    return NULL;
+
+  t_snap_node rec;
+  get(r, &rec, sizeof(rec));
+  if (r->err || !node_rec_valid(&rec)) {
+    r->err = true;
+    return NULL;
+  }
+
+  t_ast_n *node = arena_alloc(a, sizeof(t_ast_n));
+  init_ast_node(node);
+  node->op_type = rec.op_type;
+  node->background = rec.background;
+  node->redir_bool = rec.redir_bool;
+  node->tok_segment_len = rec.tok_segment_len;
+  node->items_len = rec.items_len;
+  node->static_toks = rec.static_toks;
+  node->static_argc = rec.static_argc;
+
+  node->tok_start = get_toks(r, rec.toks, a);
+  if (rec.has_var)
+    node->for_var = get_toks(r, 1, a);
+  node->for_items = get_toks(r, rec.items, a);
+  if (rec.redirs)
+    node->io_redir = get_redirs(r, rec.redirs, a);
+
+  node->left = get_node(r, a);
+  node->right = get_node(r, a);
+  node->sub_ast_root = get_node(r, a);
+  return r->err ? NULL : node;
+}
+
+/**
+ * @brief reads n records into an arena array
+ * @return array, NULL if the records do not parse.
+ */
+static t_snap_def *get_defs(t_snap_rd *r, uint32_t *n, int kind,
+                            t_arena *a) {
+  get(r, n, sizeof(*n));
+  if (!fits(r, *n, 2 * sizeof(uint64_t)))
+    return NULL;
+  t_snap_def *defs = arena_alloc(a, (*n + 1) * sizeof(t_snap_def));
+  for (uint32_t i = 0; i < *n && !r->err; i++) {
+    t_snap_def *d = &defs[i];
+    memset(d, 0, sizeof(*d));
+    if (kind == 0) {
+      uint8_t set;
+      get(r, &set, 1);
+      get(r, &d->flags, 1);
+      d->name = get_str(r, NULL);
+      d->val = set ? get_str(r, NULL) : NULL;
+    } else {
+      d->name = get_str(r, NULL);
+      if (kind == 1)
+        d->val = get_str(r, NULL);
+      else if ((d->body = get_node(r, a)) == NULL)
+        r->err = true;
+    }
+  }
+  return r->err ? NULL : defs;
+}
+
+static void apply_vars(t_shell *shell, t_snap_def *vars, uint32_t n) {
+  bool path = false;
+  for (uint32_t i = 0; i < n; i++) {
+    t_snap_def *d = &vars[i];
+    path |= strcmp(d->name, "PATH") == 0;
+    if (!d->val) {
+      remove_from_env(shell, d->name);
+      continue;
+    }
+    if (add_to_env(shell, d->name, d->val, false, 0) == -1)
+      continue;
+    t_env_entry *e = ht_find(&shell->env, d->name)->value;
+    e->flags = (e->flags & ~SNAP_VAR_FLAGS) | d->flags;
+    envp_sync(shell, e);
+  }
+
+  if (path) {
+    shell->path = getenv_local_ref(&shell->env, "PATH");
+    shell->path_len = shell->path ? strlen(shell->path) : 0;
+    path_cache_reset(shell);
+  }
+}
+
+static void apply_functions(t_shell *shell, t_snap_def *funs, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    t_ast_n *clone = clone_heap_ast(funs[i].body);
+    if (!clone) {
+      perror("clone");
+      continue;
+    }
+    if (!ht_insert(&shell->functions, funs[i].name, clone, free_heap_ast))
+      free_heap_ast(clone);
+  }
+  shell->cmd_gen++;
+}
+
+/**
+ * @brief validates and applies the mapped snapshot, nothing is applied
+ * unless every record parses
+ */
+static int apply(t_shell *shell, const char *base, size_t size,
+                 const t_snap_key *key) {
+  t_snap_hdr hdr;
+  if (size < sizeof(hdr) + sizeof(t_shopt))
+    return -1;
+  memcpy(&hdr, base, sizeof(hdr));
+  if (hdr.magic != SNAP_MAGIC || hdr.version != SNAP_VERSION ||
+      hdr.shopt_size != sizeof(t_shopt) || hdr.size != size ||
+      memcmp(&hdr.key, key, sizeof(*key)) != 0)
+    return -1;
+
+  t_snap_rd r = {.p = base + sizeof(hdr), .end = base + size, .err = false};
+  t_shopt shopts;
+  get(&r, &shopts, sizeof(shopts));
+  uint32_t nv, na, nf;
+  t_snap_def *vars = get_defs(&r, &nv, 0, &shell->arena);
+  t_snap_def *aliases = get_defs(&r, &na, 1, &shell->arena);
+  t_snap_def *funs = get_defs(&r, &nf, 2, &shell->arena);
+  if (r.err || r.p != r.end || !vars || !aliases || !funs)
+    return -1;
+
+  apply_vars(shell, vars, nv);
+  for (uint32_t i = 0; i < na; i++)
+    insert_alias(&shell->aliases, aliases[i].name, aliases[i].val);
+  apply_functions(shell, funs, nf);
+  shell->shopts = shopts;
+  return 0;
+}
+
+static void record(t_shell *shell, const char *path, const t_snap_key *key) {
+  t_snap_rec *rec = calloc(1, sizeof(*rec));
+  if (!rec)
+    return;
+  rec->path = strdup(path);
+  rec->key = *key;
+  ht_init(&rec->pre);
+  if (!rec->path) {
+    free_rec(rec);
+    return;
+  }
+
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(&shell->env, &it))) {
+    t_env_entry *e = n->value;
+    const char *val = env_val(e);
+    if (!val || e->flags & ENV_LOCAL)
+      continue;
+    size_t len = strlen(val);
+    t_snap_var *v = malloc(sizeof(*v) + len + 1);
+    if (!v || !ht_insert(&rec->pre, n->key, v, free)) {
+      free(v);
+      free_rec(rec);
+      return;
+    }
+    v->flags = e->flags & SNAP_VAR_FLAGS;
+    memcpy(v->val, val, len + 1);
+  }
+  shell->snap_rec = rec;
+}
+
+int snapshot_load(t_shell *shell, const char *rc_path) {
+  const char *path = getenv_local_ref(&shell->env, SNAP_ENV_VAR);
+  t_snap_key key;
+  if (!path || !*path || make_key(shell, rc_path, &key) == -1)
+    return -1;
+
+  int ret = -1;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd != -1 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    size_t size = st.st_size;
+    char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base != MAP_FAILED) {
+      ret = apply(shell, base, size, &key);
+      munmap(base, size);
+    }
+  }
+  if (fd != -1)
+    close(fd);
+
+  if (ret == -1)
+    record(shell, path, &key);
+  return ret;
+}
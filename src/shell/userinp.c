@@ -1,5 +1,7 @@
 #include "userinp.h"
 #include "executor.h"
+#include "shell_init.h"
+#include "sig_events.h"
 #include "var_exp.h"
 #include <fcntl.h>
 #include <stdbool.h>
@@ -690,6 +692,11 @@ char *read_user_inp(t_shell *shell) {
   bool tab = false;
   while (1) {
     redraw_cmd(shell, cmd, cmd_len, cmd_idx, &suggestion_node);
+    if (!shell->history_loaded) {
+      // read while the first prompt is already on screen
+      history_load(shell);
+      ptr = shell->history.head;
+    }
 
     if (handle_realloc_buf(&cmd, &cmd_cap, &cmd_len, &shell->arena) == -1)
       return NULL;
@@ -701,9 +708,16 @@ char *read_user_inp(t_shell *shell) {
       continue;
     }
 
+    /* one wakeup per event: a keypress, or a signal (finished job, resize,
+     * trap) reported by the event pipe even while no read is in progress */
     char c = '\0';
-    while (read(STDIN_FILENO, &c, 1) < 0) {
-      if (errno == EINTR) {
+    while (1) {
+      int ev = sigs[SIGCHLD] ? SIG_EV_SIGNAL
+                             : sig_events_wait(STDIN_FILENO, -1);
+      if (ev == -1)
+        return NULL;
+
+      if (ev & SIG_EV_SIGNAL) {
         if (check_trap(shell) != 256)
           last_rows_drawn = 0;
 
@@ -723,9 +737,12 @@ char *read_user_inp(t_shell *shell) {
           break;
         }
         continue;
-      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-        continue;
-      } else {
+      }
+
+      ssize_t rd = read(STDIN_FILENO, &c, 1);
+      if (rd >= 0)
+        break;
+      if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
         perror("read");
         return NULL;
       }
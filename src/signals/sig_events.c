@@ -0,0 +1,141 @@
+#include "sig_events.h"
+#include "sigtable_init.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @file sig_events.c
+ * @brief implementation of the self-pipe signal event source.
+ */
+
+static volatile sig_atomic_t ev_pid = 0;
+static int ev_rfd = -1;
+static int ev_wfd = -1;
+
+/**
+ * @brief moves fd to SIG_EVENTS_FD_MIN or above, non-blocking, close-on-exec
+ * @return new fd, -1 on fail (fd is closed either way on fail)
+ */
+static int park_fd(int fd) {
+  int nfd = fcntl(fd, F_DUPFD_CLOEXEC, SIG_EVENTS_FD_MIN);
+  close(fd);
+  if (nfd == -1)
+    return -1;
+  int fl = fcntl(nfd, F_GETFL);
+  if (fl == -1 || fcntl(nfd, F_SETFL, fl | O_NONBLOCK) == -1) {
+    close(nfd);
+    return -1;
+  }
+  return nfd;
+}
+
+int sig_events_init(void) {
+  int p[2];
+  if (pipe(p) == -1) {
+    perror("msh: sig events");
+    return -1;
+  }
+  int rfd = park_fd(p[0]);
+  int wfd = park_fd(p[1]);
+  if (rfd == -1 || wfd == -1) {
+    perror("msh: sig events");
+    if (rfd != -1)
+      close(rfd);
+    if (wfd != -1)
+      close(wfd);
+    return -1;
+  }
+
+  /* the handler only writes when ev_pid matches, so swap the fds while it
+   * cannot */
+  ev_pid = 0;
+  if (ev_rfd != -1)
+    close(ev_rfd);
+  if (ev_wfd != -1)
+    close(ev_wfd);
+  ev_rfd = rfd;
+  ev_wfd = wfd;
+  ev_pid = getpid();
+  return 0;
+}
+
+void sig_events_notify(int sig) {
+  if (ev_pid == 0 || ev_pid != getpid())
+    return;
+  int saved_errno = errno;
+  unsigned char b = (unsigned char)sig;
+  // a full pipe already guarantees a wakeup
+  (void)!write(ev_wfd, &b, 1);
+  errno = saved_errno;
+}
+
+int sig_events_catch(int sig, struct sigaction *old) {
+  // a forked subshell needs its own pipe before its children can exit
+  if (ev_pid != getpid() && sig_events_init() == -1)
+    return -1;
+  if (sigaction(sig, NULL, old) == -1) {
+    perror("sigaction");
+    return -1;
+  }
+  if (!(old->sa_flags & SA_SIGINFO) && old->sa_handler == sig_handler)
+    return 0;
+
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  sigemptyset(&act.sa_mask);
+  act.sa_handler = sig_handler;
+  act.sa_flags = sig == SIGCHLD ? SA_NOCLDSTOP : 0;
+  if (sigaction(sig, &act, NULL) == -1) {
+    perror("sigaction");
+    return -1;
+  }
+  return 1;
+}
+
+/** @brief empties the pipe, events are level triggered via sigs[] */
+static void drain_events(void) {
+  unsigned char buf[64];
+  while (read(ev_rfd, buf, sizeof(buf)) > 0)
+    ;
+}
+
+int sig_events_wait(int in_fd, int timeout_ms) {
+  if (ev_pid != getpid() && sig_events_init() == -1)
+    return -1;
+
+  sigset_t chld, old;
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  sigprocmask(SIG_UNBLOCK, &chld, &old);
+
+  struct pollfd fds[2] = {{.fd = ev_rfd, .events = POLLIN},
+                          {.fd = in_fd, .events = POLLIN}};
+  int ret = poll(fds, in_fd == -1 ? 1 : 2, timeout_ms);
+  int saved_errno = errno;
+  sigprocmask(SIG_SETMASK, &old, NULL);
+
+  if (ret == -1) {
+    // the handler ran, so its byte is in the pipe
+    if (saved_errno == EINTR) {
+      drain_events();
+      return SIG_EV_SIGNAL;
+    }
+    errno = saved_errno;
+    perror("msh: poll");
+    return -1;
+  }
+
+  int ev = 0;
+  if (fds[0].revents & POLLIN) {
+    drain_events();
+    ev |= SIG_EV_SIGNAL;
+  }
+  if (in_fd != -1 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+    ev |= SIG_EV_INPUT;
+  return ev;
+}
@@ -1,4 +1,5 @@
 #include "sigtable_init.h"
+#include "sig_events.h"
 #include "sigstruct.h"
 
 #include <errno.h>
@@ -13,9 +14,15 @@
 
 volatile sig_atomic_t sigs[NSIG];
 
-void sig_handler(int sig) { sigs[sig] = 1; }
+void sig_handler(int sig) {
+  sigs[sig] = 1;
+  sig_events_notify(sig);
+}
 
 int init_pa_sigtable(t_shell_sigtable *sigtable) {
+  // a failed init is retried by the first sig_events_wait
+  sig_events_init();
+
   INIT_SIG(sigtable, SIGINT, SIG_IGN, 0, SIGINT);
   INIT_SIG(sigtable, SIGQUIT, SIG_IGN, 0, SIGQUIT);
   INIT_SIG(sigtable, SIGTSTP, SIG_IGN, 0, SIGTSTP);
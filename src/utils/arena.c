@@ -107,3 +107,19 @@ void arena_free(t_arena *a) {
     r = n;
   }
 }
+
+void arena_adopt(t_arena *a, t_arena *src) {
+  if (!src->head)
+    return;
+
+  t_region *tail = src->head;
+  while (tail->next)
+    tail = tail->next;
+
+  if (!a->head)
+    a->head = src->head;
+  else
+    a->curr->next = src->head;
+  a->curr = tail;
+  arena_init(src);
+}
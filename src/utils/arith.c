@@ -0,0 +1,546 @@
+#include "arith.h"
+#include "hashtable.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @file arith.c
+ * @brief implementation of arithmetic expansion: interpreter, compiler and
+ * the postfix evaluator.
+ */
+
+/* Forward declerations */
+static long long parse_arith_primary(const char **p, t_err_type *err,
+                                     t_shell *shell);
+static long long parse_arith_unary(const char **p, t_err_type *err,
+                                   t_shell *shell);
+static long long parse_arith_muldiv(const char **p, t_err_type *err,
+                                    t_shell *shell);
+static long long parse_arith_addsub(const char **p, t_err_type *err,
+                                    t_shell *shell);
+static long long parse_arith_exprsh(const char **p, t_err_type *err,
+                                    t_shell *shell);
+static long long parse_arith_number(const char **p, t_err_type *err,
+                                    t_shell *shell);
+
+static bool is_valid_var_char(char c, bool first_char) {
+  if (first_char)
+    return isalpha(c) || c == '_';
+  return isalnum(c) || c == '_';
+}
+
+static void skip_spaces(const char **p) {
+  while (**p && (**p == ' ' || **p == '\t'))
+    (*p)++;
+}
+
+static long long parse_arith_pow(const char **p, t_err_type *err,
+                                 t_shell *shell) {
+
+  long long left = parse_arith_unary(p, err, shell);
+  if (*err != err_none)
+    return 0;
+
+  skip_spaces(p);
+
+  if ((*p)[0] == '*' && (*p)[1] == '*') {
+    (*p) += 2;
+
+    long long right = parse_arith_pow(p, err, shell);
+    if (*err != err_none)
+      return 0;
+
+    if (right < 0) {
+      return 0;
+    }
+
+    long long res = 1;
+    for (long long i = 0; i < right; i++) {
+      res *= left;
+    }
+    return res;
+  }
+
+  return left;
+}
+
+static long long parse_arith_primary(const char **p, t_err_type *err,
+                                     t_shell *shell) {
+  skip_spaces(p);
+
+  if (**p == '(') {
+    (*p)++;
+    long long val = parse_arith_exprsh(p, err, shell);
+    skip_spaces(p);
+    if (**p != ')') {
+      *err = err_syntax;
+      return 0;
+    }
+    (*p)++;
+    return val;
+  }
+
+  if (isdigit(**p)) {
+    return parse_arith_number(p, err, shell);
+  }
+
+  if (is_valid_var_char(**p, true)) {
+    const char *start = *p;
+    while (is_valid_var_char(**p, false)) {
+      (*p)++;
+    }
+
+    int len = *p - start;
+    char var_name[256];
+    if (len >= 256) {
+      *err = err_fatal;
+      return 0;
+    }
+
+    memcpy(var_name, start, len);
+    var_name[len] = '\0';
+
+    t_ht_node *node = ht_find(&shell->env, var_name);
+    if (node) {
+      t_env_entry *entry = (t_env_entry *)node->value;
+      if (entry->flags & ENV_HAS_VINT) {
+        return entry->vint;
+      }
+      if (entry->val) {
+        return strtoll(entry->val, NULL, 10);
+      }
+    }
+    return 0;
+  }
+
+  *err = err_syntax;
+  return 0;
+}
+static long long parse_arith_unary(const char **p, t_err_type *err,
+                                   t_shell *shell) {
+  skip_spaces(p);
+  if (**p == '+') {
+    (*p)++;
+    return parse_arith_unary(p, err, shell);
+  }
+  if (**p == '-') {
+    (*p)++;
+    return -parse_arith_unary(p, err, shell);
+  }
+  return parse_arith_primary(p, err, shell);
+}
+static long long parse_arith_muldiv(const char **p, t_err_type *err,
+                                    t_shell *shell) {
+
+  long long left = parse_arith_pow(p, err, shell);
+  if (*err != err_none)
+    return 0;
+
+  skip_spaces(p);
+  while (**p == '*' || **p == '/' || **p == '%') {
+    char op = **p;
+    (*p)++;
+
+    long long right = parse_arith_primary(p, err, shell);
+    if (*err != err_none)
+      return 0;
+
+    if (op == '*') {
+      left *= right;
+    } else {
+      if (right == 0) {
+        *err = err_div_zero;
+        return 0;
+      }
+      if (op == '/')
+        left /= right;
+      else
+        left %= right;
+    }
+    skip_spaces(p);
+  }
+  return left;
+}
+static long long parse_arith_addsub(const char **p, t_err_type *err,
+                                    t_shell *shell) {
+
+  long long left = parse_arith_muldiv(p, err, shell);
+  if (*err != err_none)
+    return 0;
+
+  skip_spaces(p);
+  while (**p == '+' || **p == '-') {
+    char op = **p;
+    (*p)++;
+    long long right = parse_arith_muldiv(p, err, shell);
+
+    if (op == '+')
+      left += right;
+    else
+      left -= right;
+
+    skip_spaces(p);
+  }
+  return left;
+}
+static long long parse_arith_exprsh(const char **p, t_err_type *err,
+                                    t_shell *shell) {
+
+  if (!p || !*p || !**p)
+    return 0;
+
+  long long result = parse_arith_addsub(p, err, shell);
+
+  skip_spaces(p);
+  if (**p != '\0' && **p != ')' && *err == err_none) {
+    *err = err_syntax;
+  }
+
+  return result;
+}
+static long long parse_arith_number(const char **p, t_err_type *err,
+                                    t_shell *shell) {
+
+  char *endptr;
+  long long val = strtoll(*p, &endptr, 10);
+
+  if (*p == endptr) {
+    *err = err_syntax;
+    return 0;
+  }
+
+  *p = endptr;
+  return val;
+}
+
+long long arith_interp(t_shell *shell, const char *expr, t_err_type *err) {
+  *err = err_none;
+  return parse_arith_exprsh(&expr, err, shell);
+}
+
+typedef enum e_arith_op {
+  AOP_CONST, ///< push arg
+  AOP_VAR,   ///< push variable, names + arg
+  AOP_PARAM, ///< push $name / ${name}, names + arg
+  AOP_NEG,
+  AOP_ADD,
+  AOP_SUB,
+  AOP_MUL,
+  AOP_DIV,
+  AOP_MOD,
+  AOP_POW
+} t_arith_op;
+
+typedef struct s_arith_ins {
+  t_arith_op op;
+  long long arg;
+} t_arith_ins;
+
+struct s_arith_prog {
+  bool interp; ///< not compilable, always interpreted
+  size_t len;
+  const char *names;
+  t_arith_ins code[];
+};
+
+/**
+ * @typedef struct s_arith_cc t_arith_cc
+ * @brief compiler state, one parse_arith_* mirror per grammar rule.
+ */
+typedef struct s_arith_cc {
+  const char *p;
+  t_arith_ins *code;
+  size_t len;
+  size_t cap;
+  char *names;
+  size_t names_len;
+  size_t names_cap;
+  int depth;
+  int max_depth;
+  bool ok;
+} t_arith_cc;
+
+static void cc_emit(t_arith_cc *cc, t_arith_op op, long long arg) {
+  if (!cc->ok)
+    return;
+  if (cc->len == cc->cap) {
+    size_t ncap = cc->cap ? cc->cap * 2 : 16;
+    t_arith_ins *n = realloc(cc->code, ncap * sizeof(*n));
+    if (!n) {
+      cc->ok = false;
+      return;
+    }
+    cc->code = n;
+    cc->cap = ncap;
+  }
+  cc->code[cc->len++] = (t_arith_ins){.op = op, .arg = arg};
+
+  if (op <= AOP_PARAM)
+    cc->depth++;
+  else if (op != AOP_NEG)
+    cc->depth--;
+  if (cc->depth > cc->max_depth)
+    cc->max_depth = cc->depth;
+}
+
+/** @brief stores a NUL terminated name, returns its offset or -1 */
+static long long cc_name(t_arith_cc *cc, const char *name, size_t len) {
+  if (cc->names_len + len + 1 > cc->names_cap) {
+    size_t ncap = (cc->names_cap ? cc->names_cap * 2 : 64) + len + 1;
+    char *n = realloc(cc->names, ncap);
+    if (!n) {
+      cc->ok = false;
+      return -1;
+    }
+    cc->names = n;
+    cc->names_cap = ncap;
+  }
+  long long off = (long long)cc->names_len;
+  memcpy(cc->names + cc->names_len, name, len);
+  cc->names[cc->names_len + len] = '\0';
+  cc->names_len += len + 1;
+  return off;
+}
+
+static void cc_exprsh(t_arith_cc *cc);
+static void cc_unary(t_arith_cc *cc);
+
+static void cc_primary(t_arith_cc *cc) {
+  skip_spaces(&cc->p);
+
+  if (*cc->p == '(') {
+    cc->p++;
+    cc_exprsh(cc);
+    skip_spaces(&cc->p);
+    if (*cc->p != ')') {
+      cc->ok = false;
+      return;
+    }
+    cc->p++;
+    return;
+  }
+
+  if (isdigit(*cc->p)) {
+    char *endptr;
+    long long val = strtoll(cc->p, &endptr, 10);
+    cc->p = endptr;
+    cc_emit(cc, AOP_CONST, val);
+    return;
+  }
+
+  t_arith_op op = AOP_VAR;
+  bool braced = false;
+  if (*cc->p == '$') {
+    // spliced in as digits by expansion, so it parses like a number here
+    op = AOP_PARAM;
+    cc->p++;
+    if (*cc->p == '{') {
+      braced = true;
+      cc->p++;
+    }
+  }
+
+  if (!is_valid_var_char(*cc->p, true)) {
+    cc->ok = false;
+    return;
+  }
+  const char *start = cc->p;
+  while (is_valid_var_char(*cc->p, false))
+    cc->p++;
+  size_t len = cc->p - start;
+  if (len >= 256 || (braced && *cc->p++ != '}')) {
+    cc->ok = false;
+    return;
+  }
+  cc_emit(cc, op, cc_name(cc, start, len));
+}
+
+static void cc_unary(t_arith_cc *cc) {
+  skip_spaces(&cc->p);
+  if (*cc->p == '+') {
+    cc->p++;
+    cc_unary(cc);
+    return;
+  }
+  if (*cc->p == '-') {
+    cc->p++;
+    cc_unary(cc);
+    cc_emit(cc, AOP_NEG, 0);
+    return;
+  }
+  cc_primary(cc);
+}
+
+static void cc_pow(t_arith_cc *cc) {
+  cc_unary(cc);
+  if (!cc->ok)
+    return;
+  skip_spaces(&cc->p);
+  if (cc->p[0] == '*' && cc->p[1] == '*') {
+    cc->p += 2;
+    cc_pow(cc);
+    cc_emit(cc, AOP_POW, 0);
+  }
+}
+
+static void cc_muldiv(t_arith_cc *cc) {
+  cc_pow(cc);
+  skip_spaces(&cc->p);
+  while (cc->ok && (*cc->p == '*' || *cc->p == '/' || *cc->p == '%')) {
+    char op = *cc->p++;
+    // the interpreter takes a bare primary on the right, so must we
+    cc_primary(cc);
+    cc_emit(cc, op == '*' ? AOP_MUL : op == '/' ? AOP_DIV : AOP_MOD, 0);
+    skip_spaces(&cc->p);
+  }
+}
+
+static void cc_addsub(t_arith_cc *cc) {
+  cc_muldiv(cc);
+  skip_spaces(&cc->p);
+  while (cc->ok && (*cc->p == '+' || *cc->p == '-')) {
+    char op = *cc->p++;
+    cc_muldiv(cc);
+    cc_emit(cc, op == '+' ? AOP_ADD : AOP_SUB, 0);
+    skip_spaces(&cc->p);
+  }
+}
+
+static void cc_exprsh(t_arith_cc *cc) {
+  if (!*cc->p) {
+    cc_emit(cc, AOP_CONST, 0);
+    return;
+  }
+  cc_addsub(cc);
+  skip_spaces(&cc->p);
+  if (*cc->p != '\0' && *cc->p != ')')
+    cc->ok = false;
+}
+
+/** @brief compiles expr into one heap block, an interp marker if it can't */
+static t_arith_prog *build_prog(const char *expr) {
+  t_arith_cc cc = {.p = expr, .ok = true};
+  cc_exprsh(&cc);
+  if (cc.max_depth > ARITH_STACK_MAX)
+    cc.ok = false;
+
+  size_t len = cc.ok ? cc.len : 0;
+  size_t names_len = cc.ok ? cc.names_len : 0;
+  t_arith_prog *prog =
+      malloc(sizeof(*prog) + len * sizeof(t_arith_ins) + names_len);
+  if (prog) {
+    prog->interp = !cc.ok;
+    prog->len = len;
+    char *names = (char *)(prog->code + len);
+    if (len)
+      memcpy(prog->code, cc.code, len * sizeof(t_arith_ins));
+    if (names_len)
+      memcpy(names, cc.names, names_len);
+    prog->names = names;
+  }
+  free(cc.code);
+  free(cc.names);
+  return prog;
+}
+
+const t_arith_prog *arith_compile(t_shell *shell, const char *expr) {
+  t_ht_node *node = ht_find(&shell->arith_cache, expr);
+  if (node)
+    return node->value;
+
+  t_arith_prog *prog = build_prog(expr);
+  if (!prog)
+    return NULL;
+  if (shell->arith_cache.count >= ARITH_CACHE_MAX)
+    ht_flush(&shell->arith_cache, free);
+  if (!ht_insert(&shell->arith_cache, expr, prog, free)) {
+    free(prog);
+    return NULL;
+  }
+  return prog;
+}
+
+static long long arith_pow(long long base, long long exp) {
+  if (exp < 0)
+    return 0;
+  // wraps like the interpreter's repeated multiplication, in log time
+  unsigned long long res = 1, b = (unsigned long long)base;
+  while (exp) {
+    if (exp & 1)
+      res *= b;
+    b *= b;
+    exp >>= 1;
+  }
+  return (long long)res;
+}
+
+bool arith_run(t_shell *shell, const t_arith_prog *prog, long long *res,
+               t_err_type *err) {
+  if (prog->interp)
+    return false;
+
+  long long st[ARITH_STACK_MAX];
+  size_t sp = 0;
+  *err = err_none;
+
+  for (size_t i = 0; i < prog->len; i++) {
+    const t_arith_ins *in = &prog->code[i];
+    switch (in->op) {
+    case AOP_CONST:
+      st[sp++] = in->arg;
+      break;
+    case AOP_VAR:
+    case AOP_PARAM: {
+      t_ht_node *node = ht_find(&shell->env, prog->names + in->arg);
+      t_env_entry *entry = node ? node->value : NULL;
+      if (in->op == AOP_PARAM &&
+          (!entry || !(entry->flags & ENV_HAS_VINT) ||
+           ((entry->flags & ENV_INT_ONLY) ? entry->vint < 0
+                                          : !isdigit(*entry->val))))
+        return false;
+      long long v = 0;
+      if (entry && (entry->flags & ENV_HAS_VINT))
+        v = entry->vint;
+      else if (entry && entry->val)
+        v = strtoll(entry->val, NULL, 10);
+      st[sp++] = v;
+      break;
+    }
+    case AOP_NEG:
+      st[sp - 1] = -st[sp - 1];
+      break;
+    case AOP_POW:
+      sp--;
+      st[sp - 1] = arith_pow(st[sp - 1], st[sp]);
+      break;
+    case AOP_ADD:
+      sp--;
+      st[sp - 1] += st[sp];
+      break;
+    case AOP_SUB:
+      sp--;
+      st[sp - 1] -= st[sp];
+      break;
+    case AOP_MUL:
+      sp--;
+      st[sp - 1] *= st[sp];
+      break;
+    case AOP_DIV:
+    case AOP_MOD:
+      sp--;
+      if (st[sp] == 0) {
+        *err = err_div_zero;
+        return true;
+      }
+      if (in->op == AOP_DIV)
+        st[sp - 1] /= st[sp];
+      else
+        st[sp - 1] %= st[sp];
+      break;
+    }
+  }
+
+  *res = st[0];
+  return true;
+}
@@ -0,0 +1,922 @@
+#include "glob_exp.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define GLOB_DENTS_BUF (64 * 1024)
+#define GLOB_MAX_THREADS 8
+
+typedef enum e_glob_op_kind {
+  GOP_CHAR,
+  GOP_ANY,
+  GOP_STAR,
+  GOP_SET,
+} t_glob_op_kind;
+
+typedef struct s_glob_op {
+  unsigned char kind;
+  unsigned char ch;
+  uint64_t *set; ///< 256 bit membership for GOP_SET, negation applied
+} t_glob_op;
+
+/**
+ * @typedef struct s_glob_seg t_glob_seg
+ * @brief one path component of a compiled pattern.
+ */
+typedef struct s_glob_seg {
+  t_glob_op *ops;
+  size_t len;
+  bool literal; ///< no wildcard, lit holds the unescaped text
+  char *lit;
+  size_t lit_len;
+  bool dot_ok;    ///< starts with a literal '.', so may match dot files
+  size_t min_len; ///< ops other than GOP_STAR
+  bool has_star;
+  size_t tail;   ///< GOP_CHAR ops after the last star, checked first
+  bool globstar; ///< `**` with globstar on, ops unused
+} t_glob_seg;
+
+typedef struct s_glob_walk {
+  t_glob_ctx *g;
+  t_glob_seg *segs;
+  size_t nsegs;
+  char ***argv;
+  size_t *argc;
+  size_t *cap;
+  long found;
+  bool failed;
+  bool quoted; ///< a match holds a quote or backslash, see quote_matches
+} t_glob_walk;
+
+void glob_ctx_init(t_glob_ctx *g, t_arena *a) {
+  ht_init(&g->dirs);
+  g->a = a;
+  g->globstar = false;
+  g->threads = 0;
+}
+
+void glob_ctx_free(t_glob_ctx *g) {
+  ht_flush(&g->dirs, NULL);
+  free(g->dirs.slots);
+  ht_init(&g->dirs);
+}
+
+static uint64_t name_key(const char *s, size_t len) {
+  uint64_t k = 0;
+  for (size_t i = 0; i < 8; i++)
+    k = (k << 8) | (i < len ? (unsigned char)s[i] : 0);
+  return k;
+}
+
+static int cmp_ent(const void *a, const void *b) {
+  const t_glob_ent *x = a, *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  if (x->len <= 8 || y->len <= 8)
+    return (x->len > y->len) - (x->len < y->len);
+  return strcmp(x->name + 8, y->name + 8);
+}
+
+static bool push_ent(t_arena *a, t_glob_dir *d, size_t *cap,
+                     const char *name, unsigned char type) {
+  if (d->len == *cap) {
+    size_t ncap = *cap ? *cap * 2 : 64;
+    d->ents = arena_realloc(a, d->ents, ncap * sizeof(t_glob_ent),
+                            *cap * sizeof(t_glob_ent));
+    if (!d->ents)
+      return false;
+    *cap = ncap;
+  }
+  size_t len = strlen(name);
+  char *copy = arena_alloc(a, len + 1);
+  if (!copy)
+    return false;
+  memcpy(copy, name, len + 1);
+
+  t_glob_ent *e = &d->ents[d->len++];
+  e->name = copy;
+  e->len = (uint32_t)len;
+  e->key = name_key(copy, len);
+  e->type = type;
+  e->plain = !strpbrk(copy, "'\"\\");
+  return true;
+}
+
+#ifdef __linux__
+typedef struct s_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+} t_dirent64;
+
+/** @brief reads path with getdents64 into d, big buffers, no DIR stream */
+static bool read_dir(t_arena *a, const char *path, t_glob_dir *d) {
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1)
+    return true;
+
+  char *buf = malloc(GLOB_DENTS_BUF);
+  if (!buf) {
+    close(fd);
+    return false;
+  }
+  size_t cap = 0;
+  bool ok = true;
+  long n;
+  while (ok && (n = syscall(SYS_getdents64, fd, buf, GLOB_DENTS_BUF)) > 0) {
+    for (long off = 0; off < n;) {
+      t_dirent64 *de = (t_dirent64 *)(buf + off);
+      off += de->d_reclen;
+      if (!push_ent(a, d, &cap, de->d_name, de->d_type)) {
+        ok = false;
+        break;
+      }
+    }
+  }
+  free(buf);
+  close(fd);
+  return ok;
+}
+#else
+static bool read_dir(t_arena *a, const char *path, t_glob_dir *d) {
+  DIR *dir = opendir(path);
+  if (!dir)
+    return true;
+
+  size_t cap = 0;
+  bool ok = true;
+  struct dirent *de;
+  while (ok && (de = readdir(dir)))
+    ok = push_ent(a, d, &cap, de->d_name, de->d_type);
+  closedir(dir);
+  return ok;
+}
+#endif
+
+/** @brief the sorted listing of path, read on the first request only */
+static t_glob_dir *get_dir(t_glob_ctx *g, const char *path) {
+  t_ht_node *n = ht_find(&g->dirs, path);
+  if (n)
+    return n->value;
+
+  t_glob_dir *d = arena_alloc(g->a, sizeof(*d));
+  if (!d)
+    return NULL;
+  d->ents = NULL;
+  d->len = 0;
+  if (!read_dir(g->a, path, d))
+    return NULL;
+  if (d->len > 1)
+    qsort(d->ents, d->len, sizeof(t_glob_ent), cmp_ent);
+  if (!ht_insert(&g->dirs, path, d, NULL))
+    return NULL;
+  return d;
+}
+
+typedef int (*t_ctype_fn)(int);
+
+/** @brief the ctype test for a [:name:] class, NULL if there is none */
+static t_ctype_fn class_fn(const char *name, size_t len) {
+  static const struct {
+    const char *name;
+    t_ctype_fn fn;
+  } classes[] = {{"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+                 {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+                 {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+                 {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit}};
+  for (size_t i = 0; i < sizeof(classes) / sizeof(*classes); i++) {
+    if (strlen(classes[i].name) == len &&
+        memcmp(classes[i].name, name, len) == 0)
+      return classes[i].fn;
+  }
+  return NULL;
+}
+
+#define SET_ADD(set, c) ((set)[(unsigned char)(c) >> 6] |= 1ull << ((c) & 63))
+#define SET_HAS(set, c) ((set)[(unsigned char)(c) >> 6] >> ((c) & 63) & 1)
+
+/**
+ * @brief compiles the bracket expression at p[0] == '['
+ * @return length consumed, 0 if it is not a valid bracket and '[' is literal
+ */
+static size_t compile_set(t_arena *a, const char *p, size_t len,
+                          uint64_t **out) {
+  size_t i = 1;
+  bool neg = false;
+  if (i < len && (p[i] == '!' || p[i] == '^')) {
+    neg = true;
+    i++;
+  }
+
+  uint64_t *set = arena_alloc(a, 4 * sizeof(uint64_t));
+  if (!set)
+    return 0;
+  memset(set, 0, 4 * sizeof(uint64_t));
+
+  for (bool first = true;; first = false) {
+    if (i >= len)
+      return 0;
+    unsigned char c = p[i];
+    if (c == ']' && !first)
+      break;
+
+    if (c == '[' && i + 1 < len && p[i + 1] == ':') {
+      const char *end = NULL;
+      for (size_t j = i + 2; j + 1 < len; j++) {
+        if (p[j] == ':' && p[j + 1] == ']') {
+          end = p + j;
+          break;
+        }
+      }
+      t_ctype_fn fn = end ? class_fn(p + i + 2, end - (p + i + 2)) : NULL;
+      if (!fn)
+        return 0;
+      for (int ch = 1; ch < 256; ch++) {
+        if (fn(ch))
+          SET_ADD(set, ch);
+      }
+      i = end - p + 2;
+      continue;
+    }
+
+    if (c == '\\' && i + 1 < len)
+      c = p[++i];
+    i++;
+
+    if (i + 1 < len && p[i] == '-' && p[i + 1] != ']') {
+      unsigned char hi = p[i + 1];
+      i += 2;
+      if (hi == '\\' && i < len)
+        hi = p[i++];
+      for (unsigned int ch = c; ch <= hi; ch++)
+        SET_ADD(set, ch);
+      continue;
+    }
+    SET_ADD(set, c);
+  }
+
+  if (neg) {
+    for (int w = 0; w < 4; w++)
+      set[w] = ~set[w];
+  }
+  set[0] &= ~1ull; // names never hold NUL or '/'
+  set['/' >> 6] &= ~(1ull << ('/' & 63));
+  *out = set;
+  return i + 1;
+}
+
+/** @brief compiles the path component p[0..len) */
+static bool compile_seg(t_arena *a, const char *p, size_t len,
+                        t_glob_seg *seg) {
+  memset(seg, 0, sizeof(*seg));
+  seg->ops = arena_alloc(a, (len + 1) * sizeof(t_glob_op));
+  seg->lit = arena_alloc(a, len + 1);
+  if (!seg->ops || !seg->lit)
+    return false;
+
+  seg->literal = true;
+  for (size_t i = 0; i < len;) {
+    t_glob_op op = {GOP_CHAR, (unsigned char)p[i], NULL};
+    if (p[i] == '\\' && i + 1 < len) {
+      op.ch = p[i + 1];
+      i += 2;
+    } else if (p[i] == '*') {
+      op.kind = GOP_STAR;
+      i++;
+      if (seg->len && seg->ops[seg->len - 1].kind == GOP_STAR)
+        continue;
+    } else if (p[i] == '?') {
+      op.kind = GOP_ANY;
+      i++;
+    } else if (p[i] == '[') {
+      size_t used = compile_set(a, p + i, len - i, &op.set);
+      if (used) {
+        op.kind = GOP_SET;
+        i += used;
+      } else {
+        i++;
+      }
+    } else {
+      i++;
+    }
+
+    if (op.kind == GOP_CHAR)
+      seg->lit[seg->lit_len++] = op.ch;
+    else
+      seg->literal = false;
+    seg->ops[seg->len++] = op;
+  }
+  seg->lit[seg->lit_len] = '\0';
+
+  seg->dot_ok =
+      seg->len && seg->ops[0].kind == GOP_CHAR && seg->ops[0].ch == '.';
+  for (size_t i = 0; i < seg->len; i++) {
+    if (seg->ops[i].kind == GOP_STAR)
+      seg->has_star = true;
+    else
+      seg->min_len++;
+  }
+  while (seg->tail < seg->len &&
+         seg->ops[seg->len - 1 - seg->tail].kind == GOP_CHAR)
+    seg->tail++;
+  return true;
+}
+
+static inline bool op_match(const t_glob_op *op, unsigned char c) {
+  switch (op->kind) {
+  case GOP_CHAR:
+    return op->ch == c;
+  case GOP_ANY:
+    return true;
+  case GOP_SET:
+    return SET_HAS(op->set, c);
+  }
+  return false;
+}
+
+/** @brief matches one name, star backtracking without recursion */
+static bool seg_match(const t_glob_seg *seg, const t_glob_ent *e) {
+  const unsigned char *s = (const unsigned char *)e->name;
+  size_t len = e->len;
+
+  if (s[0] == '.' && !seg->dot_ok)
+    return false;
+  if (len < seg->min_len || (!seg->has_star && len != seg->min_len))
+    return false;
+  // literal tail first, it rejects most names of a `*.ext` pattern
+  for (size_t i = 1; i <= seg->tail; i++) {
+    if (seg->ops[seg->len - i].ch != s[len - i])
+      return false;
+  }
+
+  size_t p = 0, i = 0;
+  size_t star_p = (size_t)-1, star_i = 0;
+  while (i < len) {
+    if (p < seg->len && seg->ops[p].kind == GOP_STAR) {
+      star_p = p++;
+      star_i = i;
+    } else if (p < seg->len && op_match(&seg->ops[p], s[i])) {
+      p++;
+      i++;
+    } else if (star_p != (size_t)-1) {
+      p = star_p + 1;
+      i = ++star_i;
+    } else {
+      return false;
+    }
+  }
+  while (p < seg->len && seg->ops[p].kind == GOP_STAR)
+    p++;
+  return p == seg->len;
+}
+
+/** @brief prefix joined with name, a '/' between them when sep is set */
+static char *join(t_arena *a, const char *prefix, size_t plen, bool sep,
+                  const char *name, size_t nlen) {
+  char *s = arena_alloc(a, plen + sep + nlen + 1);
+  if (!s)
+    return NULL;
+  memcpy(s, prefix, plen);
+  if (sep)
+    s[plen] = '/';
+  memcpy(s + plen + sep, name, nlen);
+  s[plen + sep + nlen] = '\0';
+  return s;
+}
+
+/** @brief appends path, plain when it is known to hold no quote or '\\' */
+static void add_match(t_glob_walk *w, char *path, bool plain) {
+  if (*w->argc + 1 >= *w->cap) {
+    size_t ncap = *w->cap * 2;
+    *w->argv = arena_realloc(w->g->a, *w->argv, ncap * sizeof(char *),
+                             *w->cap * sizeof(char *));
+    if (!*w->argv) {
+      w->failed = true;
+      return;
+    }
+    *w->cap = ncap;
+  }
+  (*w->argv)[(*w->argc)++] = path;
+  w->found++;
+  if (!plain && strpbrk(path, "'\"\\"))
+    w->quoted = true;
+}
+
+static bool ent_is_dir(const t_glob_ent *e, const char *path) {
+  if (e->type == DT_DIR)
+    return true;
+  if (e->type != DT_LNK && e->type != DT_UNKNOWN)
+    return false;
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void walk_globstar(t_glob_walk *w, size_t idx, const char *prefix,
+                          size_t plen, bool sep);
+
+/** @brief matches segs[idx..] under prefix, adding every full match */
+static void walk(t_glob_walk *w, size_t idx, const char *prefix, size_t plen,
+                 bool sep) {
+  t_glob_seg *seg = &w->segs[idx];
+  bool last = idx + 1 == w->nsegs;
+
+  if (seg->globstar) {
+    walk_globstar(w, idx, prefix, plen, sep);
+    return;
+  }
+
+  if (seg->literal) {
+    char *path = join(w->g->a, prefix, plen, sep, seg->lit, seg->lit_len);
+    if (!path) {
+      w->failed = true;
+      return;
+    }
+    struct stat st;
+    if (!last)
+      walk(w, idx + 1, path, plen + sep + seg->lit_len, true);
+    else if (lstat(path, &st) == 0)
+      add_match(w, path, false);
+    return;
+  }
+
+  t_glob_dir *d = get_dir(w->g, plen ? prefix : ".");
+  if (!d) {
+    w->failed = true;
+    return;
+  }
+  for (size_t i = 0; i < d->len && !w->failed; i++) {
+    const t_glob_ent *e = &d->ents[i];
+    if (!seg_match(seg, e))
+      continue;
+    // names in the working directory go into argv as they are
+    char *path = plen == 0 && last && e->plain
+                     ? (char *)e->name
+                     : join(w->g->a, prefix, plen, sep, e->name, e->len);
+    if (!path) {
+      w->failed = true;
+      return;
+    }
+    if (last)
+      add_match(w, path, plen == 0 && e->plain);
+    else if (ent_is_dir(e, path))
+      walk(w, idx + 1, path, plen + sep + e->len, true);
+  }
+}
+
+/**
+ * @typedef struct s_gs_task t_gs_task
+ * @brief a directory left to list, its path built the way walk builds it.
+ */
+typedef struct s_gs_task {
+  const char *path;
+  size_t len;
+  bool sep;
+  bool leaf; ///< symlink to a directory, matched but not walked into
+} t_gs_task;
+
+typedef struct s_gs_rec {
+  t_gs_task at;
+  t_glob_dir *dir;
+} t_gs_rec;
+
+/**
+ * @typedef struct s_gs_worker t_gs_worker
+ * @brief one `**` walker with its own deque, arena and listings.
+ *
+ * The owner pops its newest task, going depth first, while idle walkers
+ * steal the oldest one, usually the largest subtree still queued.
+ */
+typedef struct s_gs_worker {
+  struct s_gs_pool *pool;
+  pthread_mutex_t lock; ///< guards the deque
+  t_gs_task *tasks;
+  size_t head; ///< oldest task, stolen first
+  size_t len;
+  size_t cap;
+  t_arena a;
+  t_gs_rec *recs;
+  size_t nrecs;
+  size_t recs_cap;
+} t_gs_worker;
+
+typedef struct s_gs_pool {
+  t_glob_ctx *g; ///< its table is only read while the walkers run
+  t_gs_worker w[GLOB_MAX_THREADS];
+  size_t n;
+  atomic_size_t pending; ///< tasks queued or being listed
+  atomic_bool failed;
+  pthread_mutex_t idle_lock; ///< with wake, parks walkers that found no task
+  pthread_cond_t wake;
+  atomic_size_t idle;  ///< walkers parked on wake
+  atomic_ulong pushes; ///< tasks queued so far, parked walkers wait for it
+} t_gs_pool;
+
+static bool gs_push(t_gs_worker *w, t_gs_task t) {
+  bool ok = true;
+  pthread_mutex_lock(&w->lock);
+  if (w->len == w->cap && w->head) {
+    memmove(w->tasks, w->tasks + w->head, (w->len - w->head) * sizeof(t));
+    w->len -= w->head;
+    w->head = 0;
+  }
+  if (w->len == w->cap) {
+    size_t ncap = w->cap ? w->cap * 2 : 64;
+    t_gs_task *n = realloc(w->tasks, ncap * sizeof(t));
+    if (n) {
+      w->tasks = n;
+      w->cap = ncap;
+    } else {
+      ok = false;
+    }
+  }
+  if (ok) {
+    atomic_fetch_add(&w->pool->pending, 1);
+    w->tasks[w->len++] = t;
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  t_gs_pool *p = w->pool;
+  if (ok) {
+    atomic_fetch_add(&p->pushes, 1);
+    if (atomic_load(&p->idle)) {
+      pthread_mutex_lock(&p->idle_lock);
+      pthread_cond_signal(&p->wake);
+      pthread_mutex_unlock(&p->idle_lock);
+    }
+  }
+  return ok;
+}
+
+/** @brief takes w's newest task when own is set, its oldest otherwise */
+static bool gs_take(t_gs_worker *w, bool own, t_gs_task *t) {
+  pthread_mutex_lock(&w->lock);
+  bool ok = w->head < w->len;
+  if (ok)
+    *t = own ? w->tasks[--w->len] : w->tasks[w->head++];
+  if (w->head == w->len)
+    w->head = w->len = 0;
+  pthread_mutex_unlock(&w->lock);
+  return ok;
+}
+
+/** @brief lists t's directory and queues the subdirectories `**` enters */
+static bool gs_list(t_gs_worker *w, const t_gs_task *t) {
+  const char *key = t->len ? t->path : ".";
+  t_ht_node *n = ht_find(&w->pool->g->dirs, key);
+  t_glob_dir *d = n ? n->value : arena_alloc(&w->a, sizeof(*d));
+  if (!d)
+    return false;
+  if (!n) {
+    d->ents = NULL;
+    d->len = 0;
+    if (!read_dir(&w->a, key, d))
+      return false;
+    if (d->len > 1)
+      qsort(d->ents, d->len, sizeof(t_glob_ent), cmp_ent);
+  }
+
+  if (w->nrecs == w->recs_cap) {
+    size_t ncap = w->recs_cap ? w->recs_cap * 2 : 64;
+    t_gs_rec *recs = realloc(w->recs, ncap * sizeof(*recs));
+    if (!recs)
+      return false;
+    w->recs = recs;
+    w->recs_cap = ncap;
+  }
+  w->recs[w->nrecs++] = (t_gs_rec){*t, d};
+  if (t->leaf)
+    return true;
+
+  for (size_t i = 0; i < d->len; i++) {
+    t_glob_ent *e = &d->ents[i];
+    if (e->name[0] == '.' ||
+        (e->type != DT_DIR && e->type != DT_LNK && e->type != DT_UNKNOWN))
+      continue;
+    char *path = join(&w->a, t->path, t->len, t->sep, e->name, e->len);
+    if (!path)
+      return false;
+    struct stat st;
+    if (e->type == DT_UNKNOWN) {
+      if (lstat(path, &st) == -1)
+        continue;
+      e->type = IFTODT(st.st_mode);
+    }
+    bool leaf = e->type == DT_LNK;
+    if (leaf && (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)))
+      continue;
+    if ((e->type == DT_DIR || leaf) &&
+        !gs_push(w, (t_gs_task){path, t->len + t->sep + e->len, true, leaf}))
+      return false;
+  }
+  return true;
+}
+
+static void *gs_run(void *arg) {
+  t_gs_worker *w = arg;
+  t_gs_pool *p = w->pool;
+  size_t self = w - p->w;
+
+  for (;;) {
+    unsigned long seen = atomic_load(&p->pushes);
+    t_gs_task t;
+    bool got = gs_take(w, true, &t);
+    for (size_t i = 1; !got && i < p->n; i++)
+      got = gs_take(&p->w[(self + i) % p->n], false, &t);
+    if (got) {
+      if (!atomic_load(&p->failed) && !gs_list(w, &t))
+        atomic_store(&p->failed, true);
+      if (atomic_fetch_sub(&p->pending, 1) == 1) {
+        pthread_mutex_lock(&p->idle_lock);
+        pthread_cond_broadcast(&p->wake);
+        pthread_mutex_unlock(&p->idle_lock);
+      }
+      continue;
+    }
+
+    // a push after seen was read may have been missed by the scan above
+    pthread_mutex_lock(&p->idle_lock);
+    atomic_fetch_add(&p->idle, 1);
+    while (atomic_load(&p->pending) && atomic_load(&p->pushes) == seen)
+      pthread_cond_wait(&p->wake, &p->idle_lock);
+    atomic_fetch_sub(&p->idle, 1);
+    bool done = atomic_load(&p->pending) == 0;
+    pthread_mutex_unlock(&p->idle_lock);
+    if (done)
+      break;
+  }
+  return NULL;
+}
+
+static size_t gs_threads(const t_glob_ctx *g) {
+  long n = g->threads ? (long)g->threads : sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1)
+    return 1;
+  return n > GLOB_MAX_THREADS ? GLOB_MAX_THREADS : (size_t)n;
+}
+
+/**
+ * @brief lists every directory `**` reaches from prefix into p->w[].recs
+ *
+ * The caller lists prefix itself and only starts helper threads when that
+ * leaves more than one subdirectory to walk. Helpers run with signals
+ * blocked, so handlers keep running on the shell's thread.
+ */
+static bool gs_walk(t_glob_ctx *g, t_gs_pool *p, const char *prefix,
+                    size_t plen, bool sep) {
+  memset(p, 0, sizeof(*p));
+  p->g = g;
+  p->n = gs_threads(g);
+  atomic_init(&p->pending, 0);
+  atomic_init(&p->failed, false);
+  atomic_init(&p->idle, 0);
+  atomic_init(&p->pushes, 0);
+  pthread_mutex_init(&p->idle_lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  for (size_t i = 0; i < p->n; i++) {
+    p->w[i].pool = p;
+    pthread_mutex_init(&p->w[i].lock, NULL);
+    arena_init(&p->w[i].a);
+  }
+
+  t_gs_worker *w0 = &p->w[0];
+  if (!gs_list(w0, &(t_gs_task){prefix, plen, sep, false}))
+    return false;
+
+  pthread_t tids[GLOB_MAX_THREADS];
+  size_t spawned = 0;
+  if (p->n > 1 && w0->len > 1) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    while (spawned + 1 < p->n &&
+           pthread_create(&tids[spawned], NULL, gs_run, &p->w[spawned + 1]) ==
+               0)
+      spawned++;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+  }
+  gs_run(w0);
+  for (size_t i = 0; i < spawned; i++)
+    pthread_join(tids[i], NULL);
+
+  for (size_t i = 0; i < p->n; i++)
+    arena_adopt(g->a, &p->w[i].a);
+  return !atomic_load(&p->failed);
+}
+
+static void gs_free(t_gs_pool *p) {
+  pthread_mutex_destroy(&p->idle_lock);
+  pthread_cond_destroy(&p->wake);
+  for (size_t i = 0; i < p->n; i++) {
+    pthread_mutex_destroy(&p->w[i].lock);
+    free(p->w[i].tasks);
+    free(p->w[i].recs);
+    arena_free(&p->w[i].a);
+  }
+}
+
+/**
+ * @brief matches a `**` component: segs[idx + 1..] under every directory
+ * the tree walk found, or, as the last component, everything below prefix
+ */
+static void walk_globstar(t_glob_walk *w, size_t idx, const char *prefix,
+                          size_t plen, bool sep) {
+  bool last = idx + 1 == w->nsegs;
+  t_gs_pool p;
+  if (!gs_walk(w->g, &p, prefix, plen, sep)) {
+    w->failed = true;
+    gs_free(&p);
+    return;
+  }
+
+  // `dir/**` names dir/ itself too
+  if (last && plen && p.w[0].recs[0].dir->len) {
+    char *path = join(w->g->a, prefix, plen, sep, "", 0);
+    if (path)
+      add_match(w, path, false);
+    else
+      w->failed = true;
+  }
+
+  for (size_t t = 0; t < p.n && !w->failed; t++) {
+    for (size_t r = 0; r < p.w[t].nrecs && !w->failed; r++) {
+      const t_gs_rec *rec = &p.w[t].recs[r];
+      // later components and patterns read these listings from the cache
+      const char *key = rec->at.len ? rec->at.path : ".";
+      if (!ht_find(&w->g->dirs, key) &&
+          !ht_insert(&w->g->dirs, key, rec->dir, NULL)) {
+        w->failed = true;
+        break;
+      }
+      if (!last) {
+        walk(w, idx + 1, rec->at.path, rec->at.len, rec->at.sep);
+        continue;
+      }
+      if (rec->at.leaf)
+        continue;
+      for (size_t i = 0; i < rec->dir->len && !w->failed; i++) {
+        const t_glob_ent *e = &rec->dir->ents[i];
+        if (e->name[0] == '.')
+          continue;
+        char *path = join(w->g->a, rec->at.path, rec->at.len, rec->at.sep,
+                          e->name, e->len);
+        if (path)
+          add_match(w, path, false);
+        else
+          w->failed = true;
+      }
+    }
+  }
+  gs_free(&p);
+}
+
+typedef struct s_glob_sort {
+  uint64_t key;
+  const char *s;
+} t_glob_sort;
+
+static int cmp_sort(const void *a, const void *b) {
+  const t_glob_sort *x = a, *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return strcmp(x->s, y->s);
+}
+
+/** @brief sorts v[0..n) like strcmp, comparing precomputed keys first */
+static bool sort_paths(t_arena *a, char **v, size_t n) {
+  t_glob_sort *tmp = arena_alloc(a, n * sizeof(*tmp));
+  if (!tmp)
+    return false;
+  for (size_t i = 0; i < n; i++) {
+    tmp[i].key = name_key(v[i], strnlen(v[i], 8));
+    tmp[i].s = v[i];
+  }
+  qsort(tmp, n, sizeof(*tmp), cmp_sort);
+  for (size_t i = 0; i < n; i++)
+    v[i] = (char *)tmp[i].s;
+  return true;
+}
+
+/** @brief the home directory ~user (or ~) names, NULL if unknown */
+static const char *tilde_home(const char *user, size_t len) {
+  if (len == 0) {
+    const char *home = getenv("HOME");
+    if (home)
+      return home;
+    struct passwd *pw = getpwuid(getuid());
+    return pw ? pw->pw_dir : NULL;
+  }
+  char name[256];
+  if (len >= sizeof(name))
+    return NULL;
+  memcpy(name, user, len);
+  name[len] = '\0';
+  struct passwd *pw = getpwnam(name);
+  return pw ? pw->pw_dir : NULL;
+}
+
+/**
+ * @brief backslash escapes the quotes and backslashes of n matches, so the
+ * strip_quotes pass over argv gives the file names back
+ */
+static bool quote_matches(t_arena *a, char **v, long n) {
+  for (long i = 0; i < n; i++) {
+    if (!strpbrk(v[i], "'\"\\"))
+      continue;
+    size_t len = strlen(v[i]);
+    char *q = arena_alloc(a, 2 * len + 1);
+    if (!q)
+      return false;
+    size_t k = 0;
+    for (const char *c = v[i]; *c; c++) {
+      if (*c == '\'' || *c == '"' || *c == '\\')
+        q[k++] = '\\';
+      q[k++] = *c;
+    }
+    q[k] = '\0';
+    v[i] = q;
+  }
+  return true;
+}
+
+long glob_expand(t_glob_ctx *g, const char *pattern, char ***argv,
+                 size_t *argc, size_t *cap) {
+  const char *pat = pattern;
+  if (pat[0] == '~') {
+    size_t ulen = strcspn(pat + 1, "/");
+    const char *home = tilde_home(pat + 1, ulen);
+    if (home) {
+      const char *rest = pat + 1 + ulen;
+      size_t hl = strlen(home);
+      char *p = arena_alloc(g->a, hl + strlen(rest) + 1);
+      if (!p)
+        return -1;
+      memcpy(p, home, hl);
+      strcpy(p + hl, rest);
+      pat = p;
+    }
+  }
+
+  // leading slashes are the root prefix, the rest splits into components
+  size_t root = strspn(pat, "/");
+  size_t nsegs = 1;
+  for (const char *s = pat + root; *s; s++)
+    nsegs += *s == '/';
+  t_glob_seg *segs = arena_alloc(g->a, nsegs * sizeof(t_glob_seg));
+  if (!segs)
+    return -1;
+
+  const char *s = pat + root;
+  size_t wild = 0, last_wild = 0;
+  bool deep = false;
+  size_t n = 0;
+  for (size_t i = 0; i < nsegs; i++) {
+    const char *c = s;
+    size_t len = strcspn(c, "/");
+    s += len + (s[len] == '/');
+    bool star2 = g->globstar && len == 2 && c[0] == '*' && c[1] == '*';
+    if (star2 && n && segs[n - 1].globstar)
+      continue; // `**/**` walks the same tree as `**`
+    if (!compile_seg(g->a, c, len, &segs[n]))
+      return -1;
+    segs[n].globstar = star2;
+    deep |= star2;
+    if (!segs[n].literal) {
+      wild++;
+      last_wild = n;
+    }
+    n++;
+  }
+  nsegs = n;
+
+  char *rootp = arena_alloc(g->a, root + 1);
+  if (!rootp)
+    return -1;
+  memcpy(rootp, pat, root);
+  rootp[root] = '\0';
+
+  t_glob_walk w = {g, segs, nsegs, argv, argc, cap, 0, false, false};
+  size_t first = *argc;
+  walk(&w, 0, rootp, root, false);
+  if (w.failed)
+    return -1;
+  // sorted listings give sorted output unless a component follows a match
+  if (w.found > 1 && (deep || wild > 1 || last_wild + 1 < nsegs) &&
+      !sort_paths(g->a, *argv + first, w.found))
+    return -1;
+  if (w.quoted && !quote_matches(g->a, *argv + first, w.found))
+    return -1;
+  return w.found;
+}
@@ -0,0 +1,43 @@
+#include "memfd.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @file memfd.c
+ * @brief implementation of anonymous in-memory files.
+ */
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+static int tmp_fd_open(const char *name) {
+  const char *dir = getenv("TMPDIR");
+  if (!dir || !*dir)
+    dir = "/tmp";
+
+  char path[4096];
+  int n = snprintf(path, sizeof(path), "%s/msh-%s.XXXXXX", dir, name);
+  if (n < 0 || n >= (int)sizeof(path))
+    return -1;
+
+  int fd = mkstemp(path);
+  if (fd == -1)
+    return -1;
+  unlink(path);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return fd;
+}
+
+int mem_fd_open(const char *name) {
+#ifdef SYS_memfd_create
+  int fd = (int)syscall(SYS_memfd_create, name, MFD_CLOEXEC);
+  if (fd != -1 || errno != ENOSYS)
+    return fd;
+#endif
+  return tmp_fd_open(name);
+}
@@ -1,9 +1,22 @@
 #include "var_exp.h"
+#include "arith.h"
 #include "builtins.h"
+#include "cmd_subst.h"
+#include "glob_exp.h"
 #include "hashtable.h"
 #include "lexer.h"
 #include "shell.h"
 #include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+#define ENVP_DEFSIZE 32
+
+extern char **environ;
 
 static const t_exp_map g_jump_table[] = {
     {"?", expand_exit_status}, // $?
@@ -18,19 +31,6 @@ static const t_exp_map g_jump_table[] = {
 };
 
 /* Forward declerations */
-static long long parse_arith_primary(const char **p, t_err_type *err,
-                                     t_shell *shell);
-static long long parse_arith_unary(const char **p, t_err_type *err,
-                                   t_shell *shell);
-static long long parse_arith_muldiv(const char **p, t_err_type *err,
-                                    t_shell *shell);
-static long long parse_arith_addsub(const char **p, t_err_type *err,
-                                    t_shell *shell);
-static long long parse_arith_exprsh(const char **p, t_err_type *err,
-                                    t_shell *shell);
-static long long parse_arith_number(const char **p, t_err_type *err,
-                                    t_shell *shell);
-
 static char *expand_recursive(t_shell *shell, char *str, t_arena *a, int depth);
 
 char *getenv_local(t_hashtable *env, const char *var_name, t_arena *a) {
@@ -39,83 +39,192 @@ char *getenv_local(t_hashtable *env, const char *var_name, t_arena *a) {
     return NULL;
 
   t_env_entry *entry = (t_env_entry *)node->value;
-  if (!entry || !entry->val)
+  const char *val = entry ? env_val(entry) : NULL;
+  if (!val)
     return NULL;
 
-  size_t len = strlen(entry->val);
+  size_t len = strlen(val);
   char *copy = arena_alloc(a, len + 1);
   if (copy) {
-    memcpy(copy, entry->val, len + 1);
+    memcpy(copy, val, len + 1);
   }
   return copy;
 }
 
+const char *getenv_local_ref_n(t_hashtable *env, const char *name,
+                               size_t name_len, size_t *val_len) {
+  t_ht_node *node = ht_find_n(env, name, name_len);
+  t_env_entry *entry = node ? (t_env_entry *)node->value : NULL;
+  const char *val = entry ? env_val(entry) : NULL;
+  if (val && val_len)
+    *val_len = entry->val_len;
+  return val;
+}
+
 const char *getenv_local_ref(t_hashtable *env, const char *var_name) {
   t_ht_node *node = ht_find(env, var_name);
   if (!node)
     return NULL;
 
   t_env_entry *entry = (t_env_entry *)node->value;
-  if (!entry || !entry->val)
-    return NULL;
+  return entry ? env_val(entry) : NULL;
+}
 
+char *env_val(t_env_entry *entry) {
+  if (!(entry->flags & ENV_INT_ONLY))
+    return entry->val;
+
+  if (entry->val_cap < ENV_INT_VAL_CAP) {
+    char *n = realloc(entry->val, ENV_INT_VAL_CAP);
+    if (!n)
+      return NULL;
+    entry->val = n;
+    entry->val_cap = ENV_INT_VAL_CAP;
+  }
+  entry->val_len =
+      (size_t)snprintf(entry->val, entry->val_cap, "%lld", entry->vint);
+  entry->flags &= ~ENV_INT_ONLY;
   return entry->val;
 }
 
-char **flatten_env(t_hashtable *env, t_arena *a) {
-  char **envp = (char **)arena_alloc(a, sizeof(char *) * (env->count + 1));
-  size_t env_idx = 0;
+static int envp_reserve(t_envp *envp) {
+  if (envp->vec && envp->len + 1 < envp->cap)
+    return 0;
 
-  for (int i = 0; i < HT_DEFSIZE; i++) {
-    t_ht_node *node = env->buckets[i];
+  size_t ncap = envp->cap ? envp->cap * 2 : ENVP_DEFSIZE;
+  char **nvec = realloc(envp->vec, sizeof(char *) * ncap);
+  if (!nvec)
+    return -1;
+  envp->vec = nvec;
 
-    while (node) {
-      t_env_entry *entry = (t_env_entry *)node->value;
+  t_env_entry **nown = realloc(envp->owners, sizeof(t_env_entry *) * ncap);
+  if (!nown)
+    return -1;
+  envp->owners = nown;
 
-      if (entry && entry->val && (entry->flags & ENV_EXPORTED)) {
-        size_t k_len = strlen(node->key);
-        size_t v_len = strlen(entry->val);
-        size_t total_len = k_len + v_len + 2;
+  envp->cap = ncap;
+  envp->vec[envp->len] = NULL;
+  return 0;
+}
 
-        char *str = (char *)arena_alloc(a, total_len);
-        if (str) {
-          memcpy(str, node->key, k_len);
-          str[k_len] = '=';
-          memcpy(str + k_len + 1, entry->val, v_len);
-          str[total_len - 1] = '\0';
+/**
+ * @brief removes entry from envp, moving the last slot into its place
+ */
+static void envp_drop(t_shell *shell, t_env_entry *entry) {
+  t_envp *envp = &shell->envp;
+  if (entry->envp_idx < 0)
+    return;
 
-          envp[env_idx++] = str;
-        }
-      }
-      node = node->next;
-    }
+  size_t idx = entry->envp_idx;
+  size_t last = --envp->len;
+
+  free(envp->vec[idx]);
+  envp->vec[idx] = envp->vec[last];
+  envp->owners[idx] = envp->owners[last];
+  envp->owners[idx]->envp_idx = idx;
+  envp->vec[last] = NULL;
+
+  entry->envp_idx = -1;
+}
+
+int envp_sync(t_shell *shell, t_env_entry *entry) {
+  if (shell->envp.pending)
+    return 0;
+
+  const char *val = env_val(entry);
+  if (!val || !(entry->flags & ENV_EXPORTED)) {
+    envp_drop(shell, entry);
+    return 0;
+  }
+
+  size_t k_len = strlen(entry->name);
+  size_t v_len = strlen(val);
+  char *str = malloc(k_len + v_len + 2);
+  if (!str) {
+    perror("envp malloc");
+    return -1;
+  }
+  memcpy(str, entry->name, k_len);
+  str[k_len] = '=';
+  memcpy(str + k_len + 1, val, v_len + 1);
+
+  t_envp *envp = &shell->envp;
+  if (entry->envp_idx >= 0) {
+    free(envp->vec[entry->envp_idx]);
+    envp->vec[entry->envp_idx] = str;
+    return 0;
+  }
+
+  if (envp_reserve(envp) == -1) {
+    perror("envp realloc");
+    free(str);
+    return -1;
   }
-  envp[env_idx] = NULL;
+  entry->envp_idx = envp->len;
+  envp->owners[envp->len] = entry;
+  envp->vec[envp->len++] = str;
+  envp->vec[envp->len] = NULL;
+  return 0;
+}
+
+/**
+ * @brief builds envp from the env table, inherited variables first in their
+ * original order, then those exported since
+ */
+static void envp_build(t_shell *shell) {
+  shell->envp.pending = false;
+  for (size_t i = 0; environ[i]; i++) {
+    const char *eq = strchr(environ[i], '=');
+    t_ht_node *n =
+        eq ? ht_find_n(&shell->env, environ[i], eq - environ[i]) : NULL;
+    t_env_entry *entry = n ? n->value : NULL;
+    if (entry && entry->envp_idx < 0)
+      envp_sync(shell, entry);
+  }
+
+  size_t it = 0;
+  t_ht_node *n;
+  while ((n = ht_next(&shell->env, &it))) {
+    t_env_entry *entry = n->value;
+    if (entry->envp_idx < 0)
+      envp_sync(shell, entry);
+  }
+}
 
-  return envp;
+char **get_envp(t_shell *shell) {
+  if (shell->envp.pending)
+    envp_build(shell);
+  if (!shell->envp.vec && envp_reserve(&shell->envp) == -1) {
+    static char *empty[] = {NULL};
+    return empty;
+  }
+  return shell->envp.vec;
 }
 
-void remove_from_env(t_hashtable *env, const char *var_name) {
-  ht_delete(env, var_name, free_env_entry);
+void remove_from_env(t_shell *shell, const char *var_name) {
+  t_ht_node *node = ht_find(&shell->env, var_name);
+  if (!node)
+    return;
+  envp_drop(shell, (t_env_entry *)node->value);
+  ht_delete(&shell->env, var_name, free_env_entry);
 }
 
 void print_env(t_hashtable *env, bool exported_only, bool local_only) {
   if (!env)
     return;
 
-  for (size_t i = 0; i < HT_DEFSIZE; i++) {
-    t_ht_node *node = env->buckets[i];
-    while (node) {
-      t_env_entry *entry = (t_env_entry *)node->value;
-      if (entry && entry->val) {
-        if (entry->flags & ENV_READONLY)
-          printf("readonly\t");
-        if (exported_only && entry->flags & ENV_EXPORTED)
-          printf("%s=%s\n", node->key, entry->val);
-        if (local_only && !(entry->flags & ENV_EXPORTED))
-          printf("%s=%s\n", node->key, entry->val);
-      }
-      node = node->next;
+  size_t it = 0;
+  t_ht_node *node;
+  while ((node = ht_next(env, &it))) {
+    t_env_entry *entry = (t_env_entry *)node->value;
+    const char *val = entry ? env_val(entry) : NULL;
+    if (val) {
+      if (entry->flags & ENV_READONLY)
+        printf("readonly\t");
+      if (exported_only && entry->flags & ENV_EXPORTED)
+        printf("%s=%s\n", node->key, val);
+      if (local_only && !(entry->flags & ENV_EXPORTED))
+        printf("%s=%s\n", node->key, val);
     }
   }
 }
@@ -133,18 +242,33 @@ int add_to_env(t_shell *shell, const char *var, const char *val, bool local,
       fprintf(stderr, "readonly variable: %s\n", entry->name);
       return -1;
     }
-    free(entry->val);
   } else {
     entry = malloc(sizeof(*entry));
     if (!entry)
       return -1;
 
     entry->name = strdup(var);
+    entry->val = NULL;
+    entry->val_len = 0;
+    entry->val_cap = 0;
     entry->flags = 0;
+    entry->envp_idx = -1;
     ht_insert(&shell->env, var, entry, free_env_entry);
   }
 
-  entry->val = strdup(val);
+  // reassignments reuse the value buffer when the new value fits
+  size_t val_len = strlen(val);
+  if (val_len + 1 > entry->val_cap) {
+    char *n = malloc(val_len + 1);
+    if (!n)
+      return -1;
+    free(entry->val);
+    entry->val = n;
+    entry->val_cap = val_len + 1;
+  }
+  memmove(entry->val, val, val_len + 1);
+  entry->val_len = val_len;
+  entry->flags &= ~ENV_INT_ONLY;
 
   char *endptr;
   long long res = strtoll(entry->val, &endptr, 10);
@@ -162,20 +286,48 @@ int add_to_env(t_shell *shell, const char *var, const char *val, bool local,
 
   entry->local_depth = depth;
 
+  if (entry->envp_idx >= 0)
+    envp_sync(shell, entry);
+
   return 0;
 }
 
-static char *get_ifs(t_shell *shell, t_arena *a) {
+int add_to_env_int(t_shell *shell, const char *var, long long v, bool local,
+                   size_t depth) {
+  t_ht_node *node = ht_find(&shell->env, var);
+  t_env_entry *entry = node ? node->value : NULL;
 
-  char *ifs = getenv_local(&shell->env, "IFS", a);
-  if (!ifs) {
-    char ifs_def[] = {' ', '\t', '\n', '\0'};
-    ifs = (char *)arena_alloc(a, sizeof(ifs_def));
-    memcpy(ifs, ifs_def, sizeof(ifs_def));
-    return ifs;
+  if (entry) {
+    if (entry->flags & ENV_READONLY) {
+      fprintf(stderr, "readonly variable: %s\n", entry->name);
+      return -1;
+    }
+  } else {
+    entry = malloc(sizeof(*entry));
+    if (!entry)
+      return -1;
+
+    entry->name = strdup(var);
+    entry->val = NULL;
+    entry->val_len = 0;
+    entry->val_cap = 0;
+    entry->flags = 0;
+    entry->envp_idx = -1;
+    ht_insert(&shell->env, var, entry, free_env_entry);
   }
-  return ifs;
+
+  entry->vint = v;
+  entry->flags |= ENV_HAS_VINT | ENV_INT_ONLY;
+  if (local)
+    entry->flags |= ENV_LOCAL;
+  entry->local_depth = depth;
+
+  if (entry->envp_idx >= 0)
+    envp_sync(shell, entry);
+
+  return 0;
 }
+
 static int is_ifs_whitespace(char c) {
   return c == ' ' || c == '\t' || c == '\n';
 }
@@ -202,189 +354,6 @@ static t_exp_handler find_handler(const char *c) {
   return expand_var;
 }
 
-static void skip_spaces(const char **p) {
-  while (**p && (**p == ' ' || **p == '\t'))
-    (*p)++;
-}
-
-static long long parse_arith_pow(const char **p, t_err_type *err,
-                                 t_shell *shell) {
-
-  long long left = parse_arith_unary(p, err, shell);
-  if (*err != err_none)
-    return 0;
-
-  skip_spaces(p);
-
-  if ((*p)[0] == '*' && (*p)[1] == '*') {
-    (*p) += 2;
-
-    long long right = parse_arith_pow(p, err, shell);
-    if (*err != err_none)
-      return 0;
-
-    if (right < 0) {
-      return 0;
-    }
-
-    long long res = 1;
-    for (long long i = 0; i < right; i++) {
-      res *= left;
-    }
-    return res;
-  }
-
-  return left;
-}
-
-static long long parse_arith_primary(const char **p, t_err_type *err,
-                                     t_shell *shell) {
-  skip_spaces(p);
-
-  if (**p == '(') {
-    (*p)++;
-    long long val = parse_arith_exprsh(p, err, shell);
-    skip_spaces(p);
-    if (**p != ')') {
-      *err = err_syntax;
-      return 0;
-    }
-    (*p)++;
-    return val;
-  }
-
-  if (isdigit(**p)) {
-    return parse_arith_number(p, err, shell);
-  }
-
-  if (is_valid_var_char(**p, true)) {
-    const char *start = *p;
-    while (is_valid_var_char(**p, false)) {
-      (*p)++;
-    }
-
-    int len = *p - start;
-    char var_name[256];
-    if (len >= 256) {
-      *err = err_fatal;
-      return 0;
-    }
-
-    memcpy(var_name, start, len);
-    var_name[len] = '\0';
-
-    t_ht_node *node = ht_find(&shell->env, var_name);
-    if (node) {
-      t_env_entry *entry = (t_env_entry *)node->value;
-      if (entry->flags & ENV_HAS_VINT) {
-        return entry->vint;
-      }
-      if (entry->val) {
-        return strtoll(entry->val, NULL, 10);
-      }
-    }
-    return 0;
-  }
-
-  *err = err_syntax;
-  return 0;
-}
-static long long parse_arith_unary(const char **p, t_err_type *err,
-                                   t_shell *shell) {
-  skip_spaces(p);
-  if (**p == '+') {
-    (*p)++;
-    return parse_arith_unary(p, err, shell);
-  }
-  if (**p == '-') {
-    (*p)++;
-    return -parse_arith_unary(p, err, shell);
-  }
-  return parse_arith_primary(p, err, shell);
-}
-static long long parse_arith_muldiv(const char **p, t_err_type *err,
-                                    t_shell *shell) {
-
-  long long left = parse_arith_pow(p, err, shell);
-  if (*err != err_none)
-    return 0;
-
-  skip_spaces(p);
-  while (**p == '*' || **p == '/' || **p == '%') {
-    char op = **p;
-    (*p)++;
-
-    long long right = parse_arith_primary(p, err, shell);
-    if (*err != err_none)
-      return 0;
-
-    if (op == '*') {
-      left *= right;
-    } else {
-      if (right == 0) {
-        *err = err_div_zero;
-        return 0;
-      }
-      if (op == '/')
-        left /= right;
-      else
-        left %= right;
-    }
-    skip_spaces(p);
-  }
-  return left;
-}
-static long long parse_arith_addsub(const char **p, t_err_type *err,
-                                    t_shell *shell) {
-
-  long long left = parse_arith_muldiv(p, err, shell);
-  if (*err != err_none)
-    return 0;
-
-  skip_spaces(p);
-  while (**p == '+' || **p == '-') {
-    char op = **p;
-    (*p)++;
-    long long right = parse_arith_muldiv(p, err, shell);
-
-    if (op == '+')
-      left += right;
-    else
-      left -= right;
-
-    skip_spaces(p);
-  }
-  return left;
-}
-static long long parse_arith_exprsh(const char **p, t_err_type *err,
-                                    t_shell *shell) {
-
-  if (!p || !*p || !**p)
-    return 0;
-
-  long long result = parse_arith_addsub(p, err, shell);
-
-  skip_spaces(p);
-  if (**p != '\0' && **p != ')' && *err == err_none) {
-    *err = err_syntax;
-  }
-
-  return result;
-}
-static long long parse_arith_number(const char **p, t_err_type *err,
-                                    t_shell *shell) {
-
-  char *endptr;
-  long long val = strtoll(*p, &endptr, 10);
-
-  if (*p == endptr) {
-    *err = err_syntax;
-    return 0;
-  }
-
-  *p = endptr;
-  return val;
-}
 static size_t skip_alnum_us(const char **p) {
 
   size_t len = 0;
@@ -497,14 +466,12 @@ static size_t redir_skip_len(t_token *t, t_token *next, t_token *next2) {
   return 0;
 }
 
-static void append_to_buf(char **buf, size_t *buf_cap, size_t *k,
-                          const char *str, t_arena *a) {
-  if (!str)
-    return;
-  size_t len = strlen(str);
-
-  while (*k + len + 1 >= *buf_cap) {
-    size_t n = *buf_cap * BUF_GROWTH_FACTOR;
+static void append_n_to_buf(char **buf, size_t *buf_cap, size_t *k,
+                            const char *str, size_t len, t_arena *a) {
+  if (*k + len + 1 >= *buf_cap) {
+    size_t n = *buf_cap;
+    while (*k + len + 1 >= n)
+      n *= BUF_GROWTH_FACTOR;
     *buf = arena_realloc(a, *buf, n, *buf_cap);
     *buf_cap = n;
   }
@@ -514,6 +481,12 @@ static void append_to_buf(char **buf, size_t *buf_cap, size_t *k,
   (*buf)[*k] = '\0';
 }
 
+static void append_to_buf(char **buf, size_t *buf_cap, size_t *k,
+                          const char *str, t_arena *a) {
+  if (str)
+    append_n_to_buf(buf, buf_cap, k, str, strlen(str), a);
+}
+
 t_err_type expand_args(t_shell *shell, char **buf, size_t *cap, const char **p,
                        size_t *k, t_arena *a) {
   char *val = NULL;
@@ -551,34 +524,39 @@ int expand_glob_from(t_shell *shell, char ***argv, int start, t_arena *a) {
     return -1;
 
   for (int i = 0; i < start; i++) {
+    if (argc + 1 >= cap) {
+      cap *= 2;
+      newv = arena_realloc(a, newv, cap * sizeof(char *),
+                           (cap / 2) * sizeof(char *));
+    }
     newv[argc++] = old[i];
   }
 
+  // one listing per directory for all the patterns of the command
+  t_glob_ctx g;
+  glob_ctx_init(&g, a);
+  g.globstar = shell->shopts.globstar;
   for (int i = start; old[i]; i++) {
     char *arg = old[i];
 
     if (strpbrk(arg, "*?[]")) {
-      glob_t g;
-      if (glob(arg, GLOB_NOCHECK | GLOB_TILDE, NULL, &g) == 0) {
-        for (size_t j = 0; j < g.gl_pathc; j++) {
-          if (argc + 1 >= cap) {
-            cap *= 2;
-            newv = arena_realloc(a, newv, cap * sizeof(char *),
-                                 (cap / 2) * sizeof(char *));
-          }
-
-          size_t len = strlen(g.gl_pathv[j]);
-          char *p = arena_alloc(a, len + 1);
-          memcpy(p, g.gl_pathv[j], len + 1);
-          newv[argc++] = p;
-        }
-        globfree(&g);
-        continue;
+      long n = glob_expand(&g, arg, &newv, &argc, &cap);
+      if (n == -1) {
+        glob_ctx_free(&g);
+        return -1;
       }
+      if (n > 0)
+        continue;
     }
 
+    if (argc + 1 >= cap) {
+      cap *= 2;
+      newv = arena_realloc(a, newv, cap * sizeof(char *),
+                           (cap / 2) * sizeof(char *));
+    }
     newv[argc++] = arg;
   }
+  glob_ctx_free(&g);
 
   newv[argc] = NULL;
   *argv = newv;
@@ -615,19 +593,22 @@ t_err_type expand_arith(t_shell *shell, char **buf, size_t *buf_cap,
 
   *p += len + 2;
 
-  const char *eval_ptr;
-  if (strchr(w, '$')) {
-    static int depth = 0;
-    eval_ptr = expand_recursive(shell, w, a, ++depth);
-    depth--;
-  } else {
-    eval_ptr = w;
-  }
-  if (!eval_ptr)
-    return err_fatal;
-
   t_err_type err = err_none;
-  long long result = parse_arith_exprsh(&eval_ptr, &err, shell);
+  long long result = 0;
+  const t_arith_prog *prog = arith_compile(shell, w);
+  if (!prog || !arith_run(shell, prog, &result, &err)) {
+    const char *eval_ptr;
+    if (strchr(w, '$')) {
+      static int depth = 0;
+      eval_ptr = expand_recursive(shell, w, a, ++depth);
+      depth--;
+    } else {
+      eval_ptr = w;
+    }
+    if (!eval_ptr)
+      return err_fatal;
+    result = arith_interp(shell, eval_ptr, &err);
+  }
   if (err != err_none)
     return err;
 
@@ -670,14 +651,11 @@ t_err_type expand_var(t_shell *shell, char **buf, size_t *buf_cap,
   }
 
   if (len > 0) {
-    char *var_name = arena_alloc(a, len + 1);
-    strncpy(var_name, start, len);
-    var_name[len] = '\0';
-
-    char *val = getenv_local(&shell->env, var_name, a);
-    if (val) {
-      append_to_buf(buf, buf_cap, k, val, a);
-    }
+    // looked up from the source slice, value borrowed from the entry
+    size_t val_len;
+    const char *val = getenv_local_ref_n(&shell->env, start, len, &val_len);
+    if (val)
+      append_n_to_buf(buf, buf_cap, k, val, val_len, a);
     *p += len;
   } else {
     append_to_buf(buf, buf_cap, k, "$", a);
@@ -790,10 +768,23 @@ t_err_type expand_subshell(t_shell *shell, char **buf, size_t *buf_cap,
   strncpy(cmd_line, start, cmd_len);
   cmd_line[cmd_len] = '\0';
   *p += cmd_len + 1;
+
+  size_t start_k = *k;
+  if (subst_in_process(shell, cmd_line, a, buf, buf_cap, k) == 0) {
+    while (*k > start_k && (*buf)[*k - 1] == '\n')
+      (*k)--;
+    (*buf)[*k] = '\0';
+    return err_none;
+  }
+
+  // the substitution may touch files a later test would see cached
+  stat_cache_clear(&shell->stat_cache);
+
   int fds[2];
   if (pipe(fds) == -1)
     return err_syntax;
 
+  get_envp(shell);
   pid_t pid = fork();
   if (pid < 0)
     return err_fatal;
@@ -814,7 +805,6 @@ t_err_type expand_subshell(t_shell *shell, char **buf, size_t *buf_cap,
   }
 
   close(fds[1]);
-  size_t start_k = *k;
 
   while (1) {
     if (*k + 4096 >= *buf_cap) {
@@ -870,13 +860,10 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
            is_valid_var_char(start[var_len], var_len == 0))
       var_len++;
 
-    char *var_name = arena_alloc(a, var_len + 1);
-    strncpy(var_name, start, var_len);
-    var_name[var_len] = '\0';
-
-    char *val = getenv_local(&shell->env, var_name, a);
+    size_t val_len = 0;
+    getenv_local_ref_n(&shell->env, start, var_len, &val_len);
     char len_str[20];
-    snprintf(len_str, sizeof(len_str), "%zu", val ? strlen(val) : 0);
+    snprintf(len_str, sizeof(len_str), "%zu", val_len);
     append_to_buf(buf, buf_cap, k, len_str, a);
     *p = end + 1;
     return err_none;
@@ -887,10 +874,9 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
     var_name_len++;
 
   char *var_name = arena_alloc(a, var_name_len + 1);
-  strncpy(var_name, start, var_name_len);
+  memcpy(var_name, start, var_name_len);
   var_name[var_name_len] = '\0';
 
-  char *val = getenv_local(&shell->env, var_name, a);
   const char *arg = start + var_name_len;
 
   if (op == PARAM_OP_MINUS || op == PARAM_OP_EQUAL || op == PARAM_OP_PLUS ||
@@ -902,7 +888,7 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
 
   size_t arg_len = end - arg;
   char *word_raw = arena_alloc(a, arg_len + 1);
-  strncpy(word_raw, arg, arg_len);
+  memcpy(word_raw, arg, arg_len);
   word_raw[arg_len] = '\0';
 
   static int depth = 0;
@@ -913,10 +899,16 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
     return err_depth;
   }
 
+  /* borrowed, so only looked up once word has expanded: a nested ${v:=w}
+   * may reassign the variable and move its buffer */
+  size_t val_len = 0;
+  const char *val =
+      getenv_local_ref_n(&shell->env, start, var_name_len, &val_len);
+
   switch (op) {
   case PARAM_OP_NONE:
     if (val)
-      append_to_buf(buf, buf_cap, k, val, a);
+      append_n_to_buf(buf, buf_cap, k, val, val_len, a);
     break;
 
   case PARAM_OP_MINUS:
@@ -925,7 +917,7 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
 
   case PARAM_OP_EQUAL:
     if (val && *val) {
-      append_to_buf(buf, buf_cap, k, val, a);
+      append_n_to_buf(buf, buf_cap, k, val, val_len, a);
     } else {
       add_to_env(shell, var_name, word, false, 0);
       append_to_buf(buf, buf_cap, k, word, a);
@@ -939,7 +931,7 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
 
   case PARAM_OP_QUESTION:
     if (val && *val)
-      append_to_buf(buf, buf_cap, k, val, a);
+      append_n_to_buf(buf, buf_cap, k, val, val_len, a);
     else {
       fprintf(stderr, "msh: %s: %s\n", var_name,
               *word ? word : "parameter not set");
@@ -960,12 +952,7 @@ t_err_type expand_braces(t_shell *shell, char **buf, size_t *buf_cap,
         append_to_buf(buf, buf_cap, k, val + offset, a);
       } else {
         size_t keep_len = get_trailing_pattern_len(val, word, longest);
-        if (keep_len > 0) {
-          char save = val[keep_len];
-          ((char *)val)[keep_len] = '\0';
-          append_to_buf(buf, buf_cap, k, val, a);
-          ((char *)val)[keep_len] = save;
-        }
+        append_n_to_buf(buf, buf_cap, k, val, keep_len, a);
       }
     }
     break;
@@ -1021,6 +1008,39 @@ t_err_type expand_tilde(t_shell *shell, char **buf, size_t *buf_cap,
   return err_none;
 }
 
+/** @brief bytes the expansion loops act on, everything else is copied */
+static const bool g_exp_special[256] = {
+    ['$'] = true, ['\\'] = true, ['\''] = true, ['"'] = true};
+
+/**
+ * @brief finds the end of the literal run starting at p
+ * @return first special byte in [p, end), end if none.
+ *
+ * Words are mostly literal text, heredoc bodies almost entirely, so runs
+ * are found 16 bytes at a time and copied with one memcpy.
+ */
+static const char *scan_literal(const char *p, const char *end) {
+#ifdef __SSE2__
+  const __m128i dollar = _mm_set1_epi8('$');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i squote = _mm_set1_epi8('\'');
+  const __m128i dquote = _mm_set1_epi8('"');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, dollar), _mm_cmpeq_epi8(v, bslash)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, squote), _mm_cmpeq_epi8(v, dquote)));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+  while (p < end && !g_exp_special[(unsigned char)*p])
+    p++;
+  return p;
+}
+
 static size_t mov_tok(t_token **t, const char *p, t_token *start,
                       size_t segment_len) {
   size_t moved = 0;
@@ -1035,6 +1055,7 @@ static size_t mov_tok(t_token **t, const char *p, t_token *start,
 t_err_type expand_into_buf(t_shell *shell, const char *src, t_arena *a,
                            char **buf, size_t *buf_cap) {
   const char *p = src;
+  const char *end = src + strlen(src);
   size_t k = 0;
 
   bool sq = false;
@@ -1043,7 +1064,14 @@ t_err_type expand_into_buf(t_shell *shell, const char *src, t_arena *a,
   if (*p == '~')
     expand_tilde(shell, buf, buf_cap, &p, &k, a);
 
-  while (*p) {
+  while (p < end) {
+    const char *lit = scan_literal(p, end);
+    if (lit > p) {
+      append_n_to_buf(buf, buf_cap, &k, p, lit - p, a);
+      p = lit;
+      continue;
+    }
+
     if (*p == '\'' && !dq)
       sq = !sq;
     else if (*p == '"' && !sq)
@@ -1060,8 +1088,7 @@ t_err_type expand_into_buf(t_shell *shell, const char *src, t_arena *a,
       continue;
     }
 
-    char c[2] = {*p, '\0'};
-    append_to_buf(buf, buf_cap, &k, c, a);
+    append_n_to_buf(buf, buf_cap, &k, p, 1, a);
     p++;
   }
 
@@ -1092,12 +1119,17 @@ t_err_type make_buf(t_shell *shell, t_token *start, size_t segment_len,
     const char *end = t->start + t->len;
 
     while (p < end) {
+      const char *lit = scan_literal(p, end);
+      if (lit > p) {
+        append_n_to_buf(buf, buf_cap, &k, p, lit - p, a);
+        p = lit;
+        continue;
+      }
 
       if (*p == '\\' && !sq && *(p + 1) &&
           (!dq || *(p + 1) == '"' || *(p + 1) == '\\' || *(p + 1) == '$' ||
            *(p + 1) == '`')) {
-        char esc[2] = {*(p + 1), '\0'};
-        append_to_buf(buf, buf_cap, &k, esc, a);
+        append_n_to_buf(buf, buf_cap, &k, p + 1, 1, a);
         p += 2;
         continue;
       }
@@ -1120,13 +1152,12 @@ t_err_type make_buf(t_shell *shell, t_token *start, size_t segment_len,
         continue;
       }
 
-      char c[2] = {*p, '\0'};
-      append_to_buf(buf, buf_cap, &k, c, a);
+      append_n_to_buf(buf, buf_cap, &k, p, 1, a);
       p++;
     }
 
     if (t->trailing_delim) {
-      append_to_buf(buf, buf_cap, &k, " ", a);
+      append_n_to_buf(buf, buf_cap, &k, " ", 1, a);
     }
 
     t++;
@@ -1164,65 +1195,211 @@ static char *expand_recursive(t_shell *shell, char *str, t_arena *a,
   return buf;
 }
 
+#define IFS_SEP 1   ///< byte of IFS
+#define IFS_WS 2    ///< IFS whitespace, runs of it make one delimiter
+#define IFS_QUOTE 4 ///< quote the splitter tracks
+
+/**
+ * @brief fills the nibble tables from c->cls: high nibble rows with the same
+ * set of low nibbles share a bit, which fits when there are at most 8 rows
+ */
+static void ifs_build_nibbles(t_ifs_cache *c) {
+  unsigned short rows[16] = {0};
+  for (int b = 0; b < 256; b++) {
+    if (c->cls[b] & (IFS_SEP | IFS_QUOTE))
+      rows[b >> 4] |= 1u << (b & 15);
+  }
+
+  unsigned short masks[8];
+  int nmasks = 0;
+  memset(c->nib_lo, 0, sizeof(c->nib_lo));
+  memset(c->nib_hi, 0, sizeof(c->nib_hi));
+  c->nib_ok = false;
+  for (int h = 0; h < 16; h++) {
+    if (!rows[h])
+      continue;
+    int bit = 0;
+    while (bit < nmasks && masks[bit] != rows[h])
+      bit++;
+    if (bit == nmasks) {
+      if (nmasks == 8)
+        return;
+      masks[nmasks++] = rows[h];
+      for (int l = 0; l < 16; l++) {
+        if (rows[h] & (1u << l))
+          c->nib_lo[l] |= 1u << bit;
+      }
+    }
+    c->nib_hi[h] = 1u << bit;
+  }
+  c->nib_ok = true;
+}
+
+/** @brief the byte classes of the current IFS, rebuilt when it changed */
+static const t_ifs_cache *ifs_tables(t_shell *shell) {
+  t_ifs_cache *c = &shell->ifs_cache;
+  size_t len = 0;
+  const char *ifs = getenv_local_ref_n(&shell->env, "IFS", 3, &len);
+
+  if (c->valid && (ifs ? !c->unset && c->len == len &&
+                             memcmp(c->value, ifs, len) == 0
+                       : c->unset))
+    return c;
+
+  const char *set = ifs ? ifs : " \t\n";
+  size_t n = ifs ? len : 3;
+  memset(c->cls, 0, sizeof(c->cls));
+  c->ws_only = true;
+  for (size_t i = 0; i < n; i++) {
+    bool ws = is_ifs_whitespace(set[i]);
+    c->cls[(unsigned char)set[i]] |= IFS_SEP | (ws ? IFS_WS : 0);
+    if (!ws)
+      c->ws_only = false;
+  }
+  c->cls['\''] |= IFS_QUOTE;
+  c->cls['"'] |= IFS_QUOTE;
+  ifs_build_nibbles(c);
+
+  c->unset = !ifs;
+  c->len = n <= IFS_CACHE_MAX ? n : 0;
+  if (ifs && n <= IFS_CACHE_MAX)
+    memcpy(c->value, ifs, n);
+  c->valid = !ifs || n <= IFS_CACHE_MAX;
+  return c;
+}
+
+#if defined(__AVX2__)
+#define IFS_BLOCK 32
+typedef __m256i t_ifs_vec;
+typedef uint32_t t_ifs_mask;
+/** @brief bit i set when byte i of the 32 at p is a separator or quote */
+static t_ifs_mask ifs_block(const t_ifs_cache *c, const char *p) {
+  const __m128i lo128 = _mm_loadu_si128((const __m128i *)c->nib_lo);
+  const __m128i hi128 = _mm_loadu_si128((const __m128i *)c->nib_hi);
+  const t_ifs_vec lo = _mm256_broadcastsi128_si256(lo128);
+  const t_ifs_vec hi = _mm256_broadcastsi128_si256(hi128);
+  const t_ifs_vec nib = _mm256_set1_epi8(0x0f);
+  t_ifs_vec v = _mm256_loadu_si256((const t_ifs_vec *)p);
+  t_ifs_vec l = _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nib));
+  t_ifs_vec h =
+      _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib));
+  t_ifs_vec none =
+      _mm256_cmpeq_epi8(_mm256_and_si256(l, h), _mm256_setzero_si256());
+  return ~(t_ifs_mask)_mm256_movemask_epi8(none);
+}
+#elif defined(__SSSE3__)
+#define IFS_BLOCK 16
+typedef uint32_t t_ifs_mask;
+/** @brief bit i set when byte i of the 16 at p is a separator or quote */
+static t_ifs_mask ifs_block(const t_ifs_cache *c, const char *p) {
+  const __m128i lo = _mm_loadu_si128((const __m128i *)c->nib_lo);
+  const __m128i hi = _mm_loadu_si128((const __m128i *)c->nib_hi);
+  const __m128i nib = _mm_set1_epi8(0x0f);
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(v, nib));
+  __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nib));
+  __m128i none = _mm_cmpeq_epi8(_mm_and_si128(l, h), _mm_setzero_si128());
+  return ~(t_ifs_mask)_mm_movemask_epi8(none) & 0xffff;
+}
+#endif
+
+/** @brief first separator or quote in [p, end), end if none */
+static char *ifs_next(const t_ifs_cache *c, char *p, char *end) {
+#ifdef IFS_BLOCK
+  if (c->nib_ok) {
+    for (; end - p >= IFS_BLOCK; p += IFS_BLOCK) {
+      t_ifs_mask m = ifs_block(c, p);
+      if (m)
+        return p + __builtin_ctz(m);
+    }
+  }
+#endif
+  while (p < end && !(c->cls[(unsigned char)*p] & (IFS_SEP | IFS_QUOTE)))
+    p++;
+  return p;
+}
+
+/** @brief counts separators and quotes in [p, end) */
+static size_t ifs_count(const t_ifs_cache *c, const char *p, const char *end) {
+  size_t n = 0;
+#ifdef IFS_BLOCK
+  if (c->nib_ok) {
+    for (; end - p >= IFS_BLOCK; p += IFS_BLOCK)
+      n += __builtin_popcount(ifs_block(c, p));
+  }
+#endif
+  for (; p < end; p++)
+    n += (c->cls[(unsigned char)*p] & (IFS_SEP | IFS_QUOTE)) != 0;
+  return n;
+}
+
+/**
+ * @brief splits buf[0..k) into fields on IFS, quotes kept and honoured
+ *
+ * Only separators and quotes change state, so the scan jumps between them
+ * block by block. Every field but the first follows a separator, and a
+ * non-blank one can add one empty field too, so counting separators bounds
+ * argv before it is filled in one pass.
+ */
 t_err_type split_ifs(t_shell *shell, char *buf, size_t k, char ***argv,
                      t_arena *a) {
-  char *ifs = get_ifs(shell, a);
-  unsigned char is_sep[256] = {0};
-  for (int i = 0; ifs[i]; i++)
-    is_sep[(unsigned char)ifs[i]] = 1;
+  const t_ifs_cache *c = ifs_tables(shell);
+  const unsigned char *cls = c->cls;
+  char *p = buf;
+  char *end = buf + k;
+
+  size_t marks = ifs_count(c, buf, end);
+  size_t cap = (c->ws_only ? marks : 2 * marks) + 2;
+  if (cap < ARGV_INITIAL_LEN)
+    cap = ARGV_INITIAL_LEN;
+  *argv = arena_alloc(a, sizeof(char *) * cap);
+  if (!*argv)
+    return err_fatal;
 
   size_t count = 0;
-  size_t cap = 32;
-  char *p = buf;
   bool in_sq = false;
   bool in_dq = false;
-  *argv = arena_alloc(a, sizeof(char *) * cap);
-  for (size_t i = 0; i < cap; i++)
-    (*argv)[i] = NULL;
-
-  while (*p) {
-    while (*p && !in_sq && !in_dq && is_sep[(unsigned char)*p] &&
-           is_ifs_whitespace(*p)) {
-      p++;
+  while (p < end) {
+    if (!in_sq && !in_dq) {
+      while (p < end && (cls[(unsigned char)*p] & IFS_WS))
+        p++;
     }
-
-    if (!*p)
+    if (p >= end)
       break;
-    if (count >= cap - 1) {
-      size_t old_cap = cap;
-      cap *= 2;
-      *argv = arena_realloc(a, *argv, cap * sizeof(char *),
-                            old_cap * sizeof(char *));
-      for (size_t i = old_cap; i < cap; i++)
-        (*argv)[i] = NULL;
-    }
     (*argv)[count++] = p;
 
-    while (*p) {
+    while (p < end) {
+      if (in_sq || in_dq) {
+        char *q = memchr(p, in_sq ? '\'' : '"', end - p);
+        p = q ? q : end;
+      } else {
+        p = ifs_next(c, p, end);
+      }
+      if (p >= end)
+        break;
+
       if (*p == '\'' && !in_dq) {
         in_sq = !in_sq;
       } else if (*p == '\"' && !in_sq) {
         in_dq = !in_dq;
       }
-      if (!in_sq && !in_dq && is_sep[(unsigned char)*p]) {
+      if (!in_sq && !in_dq && (cls[(unsigned char)*p] & IFS_SEP)) {
         break;
       }
       p++;
     }
-    if (*p) {
+    if (p < end) {
       char delimiter = *p;
       *p = '\0';
       p++;
       if (!is_ifs_whitespace(delimiter)) {
-        if (is_sep[(unsigned char)*p] || !*p) {
-          if (count < cap - 1) {
-            (*argv)[count++] = p;
-          }
-        }
+        if (p >= end || (cls[(unsigned char)*p] & IFS_SEP))
+          (*argv)[count++] = p;
       }
     }
   }
-  (*argv)[count] = NULL;
+  // builtins peek past the terminator, NULL fill at least the old minimum
+  memset(*argv + count, 0, sizeof(char *) * (cap - count));
 
   return err_none;
 }
@@ -1526,6 +1703,8 @@ t_err_type expand_make_argv(t_shell *shell, char ***argv, t_token *orig_tokens,
   char *buf = arena_alloc(a, buf_cap);
   if (!buf)
     return err_fatal;
+  // still split below when an expansion fails before writing anything
+  buf[0] = '\0';
 
   t_err_type err =
       make_buf(shell, vs.tokens, vs.tokens_arr_len, a, &buf, &buf_cap, 0);
@@ -1580,3 +1759,142 @@ t_err_type expand_make_argv(t_shell *shell, char ***argv, t_token *orig_tokens,
 
   return err_none;
 }
+
+/**
+ * @brief checks if c can never start or take part in an expansion
+ */
+static bool is_static_char(char c) {
+  return isalnum((unsigned char)c) || (c && strchr("_-./,:+=@%!", c));
+}
+
+static bool is_static_tok(const t_token *t) {
+  if (t->type != TOKEN_SIMPLE || t->len == 0)
+    return false;
+  for (size_t i = 0; i < t->len; i++) {
+    if (!is_static_char(t->start[i]))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief checks if IFS splits static words exactly at their delimiters
+ */
+static bool ifs_keeps_static(t_shell *shell) {
+  const char *ifs = getenv_local_ref(&shell->env, "IFS");
+  if (!ifs)
+    return true;
+  if (!strchr(ifs, ' '))
+    return false;
+  for (; *ifs; ifs++) {
+    if (is_static_char(*ifs))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief measures the leading tokens of node that expand to themselves
+ *
+ * A static word must end on a delimiter, a word glued to the next one (e.g.
+ * across a redirection) ends the prefix, as does anything after the first
+ * token with expansion syntax since it may span several tokens.
+ */
+static void mark_static_argv(t_ast_n *node) {
+  t_token *t = node->tok_start;
+  size_t len = node->tok_segment_len;
+  size_t i = 0;
+  size_t argc = 0;
+
+  while (i < len) {
+    size_t hop_len = redir_skip_len(&t[i], i + 1 < len ? &t[i + 1] : NULL,
+                                    i + 2 < len ? &t[i + 2] : NULL);
+    if (hop_len) {
+      i += hop_len;
+      continue;
+    }
+    if (!is_static_tok(&t[i]) || (!t[i].trailing_delim && i + 1 < len))
+      break;
+    argc++;
+    i++;
+  }
+
+  node->static_toks = i < len ? i : len;
+  node->static_argc = argc;
+}
+
+t_err_type expand_node_argv(t_shell *shell, char ***argv, t_ast_n *node,
+                            t_arena *a, bool *literal_cmd) {
+  if (node->static_toks == STATIC_ARGV_UNSET)
+    mark_static_argv(node);
+  if (literal_cmd)
+    *literal_cmd = false;
+
+  if (node->static_argc == 0 || !ifs_keeps_static(shell))
+    return expand_make_argv(shell, argv, node->tok_start,
+                            node->tok_segment_len, a);
+
+  char **rest = NULL;
+  size_t rest_len = 0;
+  if (node->static_toks < node->tok_segment_len) {
+    t_err_type err = expand_make_argv(
+        shell, &rest, node->tok_start + node->static_toks,
+        node->tok_segment_len - node->static_toks, a);
+    if (err != err_none)
+      return err;
+    while (rest && rest[rest_len])
+      rest_len++;
+  }
+
+  // builtins peek past the terminator, keep split_ifs' NULL filled minimum
+  size_t cap = node->static_argc + rest_len + 1;
+  if (cap < ARGV_INITIAL_LEN)
+    cap = ARGV_INITIAL_LEN;
+  char **out = arena_alloc(a, sizeof(char *) * cap);
+  if (!out)
+    return err_fatal;
+  memset(out, 0, sizeof(char *) * cap);
+
+  t_token *t = node->tok_start;
+  size_t len = node->tok_segment_len;
+  size_t n = 0;
+  for (size_t i = 0; n < node->static_argc; i++) {
+    size_t hop_len = redir_skip_len(&t[i], i + 1 < len ? &t[i + 1] : NULL,
+                                    i + 2 < len ? &t[i + 2] : NULL);
+    if (hop_len) {
+      i += hop_len - 1;
+      continue;
+    }
+    out[n] = arena_alloc(a, t[i].len + 1);
+    memcpy(out[n], t[i].start, t[i].len);
+    out[n][t[i].len] = '\0';
+    n++;
+  }
+
+  if (rest_len)
+    memcpy(out + n, rest, sizeof(char *) * rest_len);
+  out[n + rest_len] = NULL;
+
+  *argv = out;
+  if (literal_cmd)
+    *literal_cmd = true;
+  return err_none;
+}
+
+const t_token *literal_cmd_word(t_shell *shell, t_ast_n *node) {
+  if (node->static_toks == STATIC_ARGV_UNSET)
+    mark_static_argv(node);
+  if (node->static_argc == 0 || !ifs_keeps_static(shell))
+    return NULL;
+
+  t_token *t = node->tok_start;
+  size_t len = node->tok_segment_len;
+  for (size_t i = 0; i < node->static_toks; i++) {
+    size_t hop_len = redir_skip_len(&t[i], i + 1 < len ? &t[i + 1] : NULL,
+                                    i + 2 < len ? &t[i + 2] : NULL);
+    if (!hop_len)
+      return &t[i];
+    i += hop_len - 1;
+  }
+  return NULL;
+}
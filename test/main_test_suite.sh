@@ -42,6 +42,8 @@ run 'unset x; export x=abc; echo $x' 'abc'
 run 'echo $(echo hello)' 'hello'
 run 'echo $(printf abc)' 'abc'
 run 'x=$(printf hello); echo $x' 'hello'
+run 'f() { printf %s "$1"; }; echo $(f hi)' 'hi'
+run 'x=$(cd /); pwd' "$PWD"
 run 'echo $((1+1))' '2'
 run 'echo $((2*3))' '6'
 run 'echo $((8/2))' '4'
@@ -150,6 +152,64 @@ run 'x=1; (x=2); echo $x' '1'
 run '(echo one; echo two)' 'one
 two'
 run 'readonly x=1; echo $x' '1'
+run 'readonly ro14=1; ro14=$((ro14+1)); echo $ro14' 'readonly variable: ro14
+1'
+run 'f(){ local l14=4; l14=$((l14*2)); echo $l14; }; f' '8'
+run 'f(){ local l14=1; l14=$((l14+1)); echo "[$l14]"; }; f' '[2]'
+run 'export ex14=5; ex14=$((ex14+1)); printenv ex14' '6'
+run 'export ex14=9; ex14=$((ex14*ex14)); env | grep "^ex14=" | cut -d= -f2' '81'
+run 'z14=3; z14=$((z14/0)); echo "[$z14]"' 'msh: div by zero
+[]'
+run 'z14=3; z14=$((z14%0)); echo "[$z14]"' 'msh: div by zero
+[]'
+
+rm -rf /tmp/msh_glob
+mkdir -p /tmp/msh_glob/d
+touch /tmp/msh_glob/b /tmp/msh_glob/a /tmp/msh_glob/10 /tmp/msh_glob/9
+touch /tmp/msh_glob/.h /tmp/msh_glob/d/x "/tmp/msh_glob/q'x"
+run 'echo /tmp/msh_glob/*' "/tmp/msh_glob/10 /tmp/msh_glob/9 /tmp/msh_glob/a /tmp/msh_glob/b /tmp/msh_glob/d /tmp/msh_glob/q'x"
+run 'echo /tmp/msh_glob/[ab9]' '/tmp/msh_glob/9 /tmp/msh_glob/a /tmp/msh_glob/b'
+run 'echo /tmp/msh_glob/*/' '/tmp/msh_glob/d/'
+run 'echo /tmp/msh_glob/.h*' '/tmp/msh_glob/.h'
+run 'echo /tmp/msh_glob/?' '/tmp/msh_glob/9 /tmp/msh_glob/a /tmp/msh_glob/b /tmp/msh_glob/d'
+run 'echo /tmp/msh_glob/q*' "/tmp/msh_glob/q'x"
+run 'echo /tmp/msh_glob/nomatch*' '/tmp/msh_glob/nomatch*'
+rm -rf /tmp/msh_glob
+
+rm -rf /tmp/msh_gstar
+mkdir -p /tmp/msh_gstar/a/b /tmp/msh_gstar/c /tmp/msh_gstar/t/u
+touch /tmp/msh_gstar/z.c /tmp/msh_gstar/a/x.c /tmp/msh_gstar/a/b/y.c /tmp/msh_gstar/t/u/w.c
+ln -s /tmp/msh_gstar/t /tmp/msh_gstar/l
+shopt -s globstar
+run 'echo /tmp/msh_gstar/**/' '/tmp/msh_gstar/ /tmp/msh_gstar/a/ /tmp/msh_gstar/a/b/ /tmp/msh_gstar/c/ /tmp/msh_gstar/l/ /tmp/msh_gstar/t/ /tmp/msh_gstar/t/u/'
+run 'echo /tmp/msh_gstar/**/*.c' '/tmp/msh_gstar/a/b/y.c /tmp/msh_gstar/a/x.c /tmp/msh_gstar/t/u/w.c /tmp/msh_gstar/z.c'
+run 'echo /tmp/msh_gstar/l/**/*.c' '/tmp/msh_gstar/l/u/w.c'
+shopt -u globstar
+run 'echo /tmp/msh_gstar/**/*.c' '/tmp/msh_gstar/a/x.c'
+rm -rf /tmp/msh_gstar
+
+rm -rf /tmp/msh_path
+mkdir -p /tmp/msh_path/a /tmp/msh_path/b
+msh_path_old=$PATH
+PATH=/tmp/msh_path/a:/tmp/msh_path/b:$PATH
+run 'mshpathcmd' 'msh: command "mshpathcmd" not found'
+printf '#!/bin/sh\necho b\n' >/tmp/msh_path/b/mshpathcmd
+chmod +x /tmp/msh_path/b/mshpathcmd
+run 'mshpathcmd' 'b'
+printf '#!/bin/sh\necho a\n' >/tmp/msh_path/a/mshpathcmd
+chmod +x /tmp/msh_path/a/mshpathcmd
+run 'f() { mshpathcmd; }; f' 'a'
+rm /tmp/msh_path/a/mshpathcmd
+run 'f' 'b'
+run 'mshpathcmd' 'b'
+printf '#!/bin/sh\necho a\n' >/tmp/msh_path/a/mshpathcmd
+run 'mshpathcmd' 'b'
+chmod +x /tmp/msh_path/a/mshpathcmd
+run 'hash -r; mshpathcmd' 'a'
+chmod -x /tmp/msh_path/a/mshpathcmd
+run 'PATH=$PATH; mshpathcmd' 'b'
+PATH=$msh_path_old
+rm -rf /tmp/msh_path
 
 echo "PASS: $pass"
 echo "FAIL: $fail"
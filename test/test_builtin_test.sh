@@ -0,0 +1,20 @@
+dir=/tmp/msh_test_builtin
+rm -rf $dir
+mkdir $dir
+touch $dir/empty
+echo data > /tmp/msh_test_builtin/file
+
+test -f $dir/file && echo "file: ok"
+[ -d $dir ] && [ ! -f $dir ] && echo "dir: ok"
+[ -s $dir/file -a ! -s $dir/empty ] && echo "size: ok"
+[ $dir/file -nt $dir/missing ] && echo "newer: ok"
+[ 9223372036854775807 -gt 2147483647 ] && echo "64-bit: ok"
+[ "(" -n x -o -z x ")" -a ! -e $dir/missing ] && echo "grouping: ok"
+
+rm $dir/file
+[ -f $dir/file ] || echo "removed: ok"
+
+[ 1 -eq x ]
+echo "bad integer status: $?"
+
+rm -rf $dir